@@ -2,7 +2,6 @@
 
 #include <algorithm>
 #include <cstdint>
-#include <fstream>
 #include <string>
 #include <vector>
 
@@ -16,92 +15,16 @@
 #include "draw.h"
 #include "event.h"
 #include "http.h"
+#include "id3.h"
+#include "metadata.h"
 #include "player.h"
 #include "vendor/json/single_include/nlohmann/json.hpp"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#define AGMP_ART_SSE2 1
+#include <emmintrin.h>
+#endif
 
-static uint32_t read_be32(const uint8_t* data)
-{
-    return (static_cast<uint32_t>(data[0]) << 24) |
-           (static_cast<uint32_t>(data[1]) << 16) |
-           (static_cast<uint32_t>(data[2]) << 8) |
-           static_cast<uint32_t>(data[3]);
-}
-
-static uint32_t read_syncsafe32(const uint8_t* data)
-{
-    return (static_cast<uint32_t>(data[0]) << 21) |
-           (static_cast<uint32_t>(data[1]) << 14) |
-           (static_cast<uint32_t>(data[2]) << 7) |
-           static_cast<uint32_t>(data[3]);
-}
-
-static size_t skip_text(const uint8_t* data, size_t size, uint8_t encoding)
-{
-    if (encoding == 0 || encoding == 3)
-    {
-        for (size_t i = 0; i < size; ++i)
-        {
-            if (data[i] == 0)
-            {
-                return i + 1;
-            }
-        }
-        return size;
-    }
-
-    for (size_t i = 0; i + 1 < size; i += 2)
-    {
-        if (data[i] == 0 && data[i + 1] == 0)
-        {
-            return i + 2;
-        }
-    }
-    return size;
-}
-
-static bool extract_apic(const uint8_t* frame_data, size_t frame_size, std::vector<unsigned char>& image_data)
-{
-    if (frame_size < 4)
-    {
-        return false;
-    }
-
-    uint8_t encoding = frame_data[0];
-    size_t offset = 1;
-
-    size_t mime_end = offset;
-    while (mime_end < frame_size && frame_data[mime_end] != 0)
-    {
-        ++mime_end;
-    }
-    if (mime_end >= frame_size)
-    {
-        return false;
-    }
-
-    offset = mime_end + 1;
-    if (offset >= frame_size)
-    {
-        return false;
-    }
-
-    offset += 1;
-    if (offset >= frame_size)
-    {
-        return false;
-    }
-
-    size_t desc_skip = skip_text(frame_data + offset, frame_size - offset, encoding);
-    offset += desc_skip;
-    if (offset >= frame_size)
-    {
-        return false;
-    }
-
-    image_data.assign(frame_data + offset, frame_data + frame_size);
-    return !image_data.empty();
-}
 
 static bool fetch_album_art_online(const std::string& artist, const std::string& album, std::vector<unsigned char>& image_data, std::string& error)
 {
@@ -166,8 +89,19 @@ static art_result start_album_art_fetch(
     result.has_art = false;
     result.online_failed = false;
 
+    // The metadata pass already found the picture, so only its bytes need
+    // reading; tracks it saw without art skip the file entirely.
     std::vector<unsigned char> art_data;
-    bool has_art = load_mp3_embedded_art(path, art_data);
+    bool has_art = false;
+    track_metadata_ptr metadata = MetadataCache::instance().find(path);
+    if (metadata && metadata->art_located)
+    {
+        has_art = read_id3_picture(path, metadata->art, art_data);
+    }
+    else
+    {
+        has_art = load_mp3_embedded_art(path, art_data);
+    }
     if (has_art)
     {
         result.ready = true;
@@ -210,106 +144,190 @@ bool load_mp3_embedded_art(const char* path, std::vector<unsigned char>& image_d
 {
     image_data.clear();
 
-    std::ifstream file(path, std::ios::binary);
-    if (!file)
+    id3_tags tags;
+    if (!read_id3_tags(path, tags, id3_art))
     {
         return false;
     }
+    return read_id3_picture(path, tags.picture, image_data);
+}
 
-    file.seekg(0, std::ios::end);
-    std::streamoff file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    uint8_t header[10] = {};
-    file.read(reinterpret_cast<char*>(header), sizeof(header));
-    if (file.gcount() != static_cast<std::streamsize>(sizeof(header)))
+static uint32_t pack_average(uint64_t r, uint64_t g, uint64_t b, uint64_t count)
+{
+    if (count == 0)
     {
-        return false;
+        return 0;
     }
+    uint64_t half = count / 2;
+    return static_cast<uint32_t>((r + half) / count)
+        | (static_cast<uint32_t>((g + half) / count) << 8)
+        | (static_cast<uint32_t>((b + half) / count) << 16)
+        | 0xff000000u;
+}
 
-    if (header[0] != 'I' || header[1] != 'D' || header[2] != '3')
-    {
-        return false;
-    }
+// 16-bit lanes hold up to 257 rows of 8-bit values without overflowing.
+static constexpr int kMaxRowsPerLaneSum = 257;
 
-    uint8_t version_major = header[3];
-    uint8_t flags = header[5];
-    uint32_t tag_size = read_syncsafe32(&header[6]);
-    const uint32_t max_tag_size = 16 * 1024 * 1024;
-    if (tag_size == 0 || tag_size > max_tag_size)
+// Adds one row of bytes into 16-bit lanes.
+static void accumulate_row(const unsigned char* row, uint16_t* lanes, size_t count)
+{
+    size_t i = 0;
+#if defined(AGMP_ART_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16)
     {
-        return false;
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i* low = reinterpret_cast<__m128i*>(lanes + i);
+        __m128i* high = reinterpret_cast<__m128i*>(lanes + i + 8);
+        _mm_storeu_si128(low, _mm_add_epi16(_mm_loadu_si128(low), _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(high, _mm_add_epi16(_mm_loadu_si128(high), _mm_unpackhi_epi8(bytes, zero)));
     }
-    if (file_size > 0 && static_cast<std::streamoff>(tag_size) > file_size - 10)
+#endif
+    for (; i < count; ++i)
     {
-        return false;
-    }
-
-    std::vector<uint8_t> tag_data(tag_size);
-    file.read(reinterpret_cast<char*>(tag_data.data()), static_cast<std::streamsize>(tag_data.size()));
-    if (file.gcount() != static_cast<std::streamsize>(tag_data.size()))
-    {
-        return false;
+        lanes[i] = static_cast<uint16_t>(lanes[i] + row[i]);
     }
+}
 
-    size_t offset = 0;
-    if ((flags & 0x40) != 0 && version_major >= 3)
-    {
-        if (tag_data.size() < 4)
+void scale_art_cells(const unsigned char* rgba, int width, int height, int out_w, int out_h, art_cells& cells)
+{
+    int sample_h = out_h * 2;
+    size_t cell_count = static_cast<size_t>(out_w) * static_cast<size_t>(out_h);
+    cells.width = out_w;
+    cells.height = out_h;
+    cells.top.assign(cell_count, 0);
+    cells.bottom.assign(cell_count, 0);
+
+    // Source column span of every output column. When upscaling a span
+    // would be empty, so it falls back to the single nearest pixel.
+    std::vector<int> column_begin(static_cast<size_t>(out_w));
+    std::vector<int> column_end(static_cast<size_t>(out_w));
+    for (int x = 0; x < out_w; ++x)
+    {
+        int begin = static_cast<int>(static_cast<int64_t>(x) * width / out_w);
+        int end = static_cast<int>(static_cast<int64_t>(x + 1) * width / out_w);
+        column_begin[static_cast<size_t>(x)] = std::min(begin, width - 1);
+        column_end[static_cast<size_t>(x)] = std::max(end, column_begin[static_cast<size_t>(x)] + 1);
+    }
+
+    int mid_x = out_w / 2;
+    int mid_sample = (out_h / 2) * 2;
+    uint64_t quadrant_sums[4][3] = {};
+    uint64_t quadrant_counts[4] = {};
+
+    // Each sample row first sums its source rows into per-pixel 16-bit
+    // lanes, then reduces those lanes across each output column, so every
+    // source byte is read exactly once.
+    size_t row_bytes = static_cast<size_t>(width) * 4;
+    std::vector<uint16_t> lanes(row_bytes);
+    std::vector<uint32_t> column_sums(static_cast<size_t>(out_w) * 3);
+    for (int sy = 0; sy < sample_h; ++sy)
+    {
+        int y_begin = std::min(static_cast<int>(static_cast<int64_t>(sy) * height / sample_h), height - 1);
+        int y_end = std::max(static_cast<int>(static_cast<int64_t>(sy + 1) * height / sample_h), y_begin + 1);
+
+        std::fill(column_sums.begin(), column_sums.end(), 0u);
+        for (int chunk = y_begin; chunk < y_end; chunk += kMaxRowsPerLaneSum)
         {
-            return false;
+            int chunk_end = std::min(y_end, chunk + kMaxRowsPerLaneSum);
+            std::fill(lanes.begin(), lanes.end(), static_cast<uint16_t>(0));
+            for (int y = chunk; y < chunk_end; ++y)
+            {
+                accumulate_row(rgba + static_cast<size_t>(y) * row_bytes, lanes.data(), row_bytes);
+            }
+
+            for (int x = 0; x < out_w; ++x)
+            {
+                const uint16_t* lane = lanes.data() + static_cast<size_t>(column_begin[static_cast<size_t>(x)]) * 4;
+                const uint16_t* lane_end = lanes.data() + static_cast<size_t>(column_end[static_cast<size_t>(x)]) * 4;
+                uint32_t* sum = column_sums.data() + static_cast<size_t>(x) * 3;
+                for (; lane < lane_end; lane += 4)
+                {
+                    sum[0] += lane[0];
+                    sum[1] += lane[1];
+                    sum[2] += lane[2];
+                }
+            }
         }
 
-        uint32_t ext_size = (version_major == 4)
-            ? read_syncsafe32(tag_data.data())
-            : read_be32(tag_data.data());
-        offset += static_cast<size_t>(ext_size) + 4;
-        if (offset >= tag_data.size())
+        std::vector<uint32_t>& target = (sy & 1) ? cells.bottom : cells.top;
+        size_t target_row = static_cast<size_t>(sy / 2) * static_cast<size_t>(out_w);
+        int quadrant_row = sy < mid_sample ? 0 : 2;
+        uint64_t rows = static_cast<uint64_t>(y_end - y_begin);
+        for (int x = 0; x < out_w; ++x)
         {
-            return false;
+            const uint32_t* sum = column_sums.data() + static_cast<size_t>(x) * 3;
+            uint64_t count = rows * static_cast<uint64_t>(column_end[static_cast<size_t>(x)] - column_begin[static_cast<size_t>(x)]);
+            target[target_row + static_cast<size_t>(x)] = pack_average(sum[0], sum[1], sum[2], count);
+
+            int quadrant = quadrant_row + (x < mid_x ? 0 : 1);
+            quadrant_sums[quadrant][0] += sum[0];
+            quadrant_sums[quadrant][1] += sum[1];
+            quadrant_sums[quadrant][2] += sum[2];
+            quadrant_counts[quadrant] += count;
         }
     }
 
-    if (version_major < 3)
+    for (int quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        cells.quadrants[quadrant] = pack_average(
+            quadrant_sums[quadrant][0],
+            quadrant_sums[quadrant][1],
+            quadrant_sums[quadrant][2],
+            quadrant_counts[quadrant]);
+    }
+}
+
+static bool render_art_cells(const std::vector<unsigned char>& image_data, int out_w, int out_h, art_cells& cells)
+{
+    if (image_data.empty() || out_w <= 0 || out_h <= 0)
     {
         return false;
     }
 
-    while (offset + 10 <= tag_data.size())
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* pixels = stbi_load_from_memory(
+        image_data.data(),
+        static_cast<int>(image_data.size()),
+        &width,
+        &height,
+        &channels,
+        4);
+
+    if (pixels == nullptr || width <= 0 || height <= 0)
     {
-        const uint8_t* frame = tag_data.data() + offset;
-        if (frame[0] == 0 && frame[1] == 0 && frame[2] == 0 && frame[3] == 0)
-        {
-            break;
-        }
+        stbi_image_free(pixels);
+        return false;
+    }
 
-        uint32_t frame_size = (version_major == 4)
-            ? read_syncsafe32(frame + 4)
-            : read_be32(frame + 4);
-        if (frame_size == 0)
-        {
-            break;
-        }
+    scale_art_cells(pixels, width, height, out_w, out_h, cells);
+    stbi_image_free(pixels);
+    return true;
+}
 
-        if (frame[0] == 'A' && frame[1] == 'P' && frame[2] == 'I' && frame[3] == 'C')
-        {
-            size_t data_offset = offset + 10;
-            if (data_offset + frame_size <= tag_data.size())
-            {
-                return extract_apic(tag_data.data() + data_offset, frame_size, image_data);
-            }
-            return false;
-        }
+// Scaled cells for the image at this size, decoding only on a cache miss.
+static art_cells_ptr get_art_cells(
+    const std::string& cache_directory,
+    uint64_t key,
+    const std::vector<unsigned char>& image_data,
+    const glm::ivec2& size)
+{
+    if (art_cells_ptr cached = ArtCache::instance().find(cache_directory, key, size.x, size.y))
+    {
+        return cached;
+    }
 
-        size_t next = offset + 10 + static_cast<size_t>(frame_size);
-        if (next <= offset || next > tag_data.size())
-        {
-            break;
-        }
-        offset = next;
+    auto cells = std::make_shared<art_cells>();
+    if (!render_art_cells(image_data, size.x, size.y, *cells))
+    {
+        return nullptr;
     }
 
-    return false;
+    art_cells_ptr result = std::move(cells);
+    ArtCache::instance().store(cache_directory, key, result);
+    return result;
 }
 
 AlbumArt::AlbumArt() = default;
@@ -322,7 +340,7 @@ AlbumArt::AlbumArt(const glm::ivec2& location, const glm::ivec2& size)
 
 AlbumArt::~AlbumArt()
 {
-    wait_for_fetch();
+    cancel_fetch();
 }
 
 bool AlbumArt::load(const std::vector<unsigned char>& image_data)
@@ -344,60 +362,148 @@ void AlbumArt::set_track(
     _current_track = path;
     _current_artist = artist;
     _current_album = album;
+    start_fetch(config);
+}
 
-    if (config.safe_mode)
+void AlbumArt::start_fetch(const app_config& config)
+{
+    const std::string& path = _current_track;
+    const std::string& artist = _current_artist;
+    const std::string& album = _current_album;
+
+    cancel_fetch();
+    int generation = 0;
     {
-        _pending.store(false, std::memory_order_release);
-        return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        generation = _generation.fetch_add(1) + 1;
     }
 
-    wait_for_fetch();
-
-    art_result result = start_album_art_fetch(path.c_str(), config, artist, album);
+    if (config.safe_mode)
     {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _result = std::move(result);
+        _pending.store(false, std::memory_order_release);
+        return;
     }
 
-    bool pending = !_result.ready;
-    _pending.store(pending, std::memory_order_release);
-    if (!pending)
+    // A recently shown track renders straight from the cache without
+    // touching the file or the decoder.
+    glm::ivec2 size = get_render_size(config);
+    uint64_t known_key = 0;
+    if (size.x > 0 && ArtCache::instance().find_track(path, known_key))
     {
-        _dirty.store(true, std::memory_order_release);
-        EventBus::instance().publish(Event{"album_art.updated", _current_track});
+        if (art_cells_ptr cells = ArtCache::instance().find_in_memory(known_key, size.x, size.y))
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _result = art_result{};
+                _result.ready = true;
+                _result.has_art = true;
+                _result.key = known_key;
+                _result.cells = std::move(cells);
+            }
+            _dirty.store(true, std::memory_order_release);
+            _pending.store(false, std::memory_order_release);
+            EventBus::instance().post(topics::album_art_updated, path);
+            return;
+        }
     }
 
-    if (!_result.ready && config.enable_online_art)
+    std::string cache_directory = _cache_directory;
+    _pending.store(true, std::memory_order_release);
+    _task = TaskScheduler::instance().submit(
+        task_priority::high,
+        [this, path, config, artist, album, generation, size, cache_directory](const TaskToken& token)
     {
-        std::string artist_copy = artist;
-        std::string album_copy = album;
-        _thread = std::thread([this, config, artist_copy, album_copy]()
+        art_result result = start_album_art_fetch(path.c_str(), config, artist, album);
+        if (token.is_cancelled())
+        {
+            return;
+        }
+        bool online = !result.ready && config.enable_online_art;
+        if (online)
         {
-            try
+            // Online art is keyed by album, so a cached copy skips the network.
+            result.key = hash_art_album(artist, album);
+            art_cells_ptr cached = size.x > 0
+                ? ArtCache::instance().find(cache_directory, result.key, size.x, size.y)
+                : nullptr;
+            if (cached)
             {
-                art_result local;
-                {
-                    std::lock_guard<std::mutex> lock(_mutex);
-                    local = _result;
-                }
-                complete_album_art_fetch(local, config, artist_copy, album_copy);
-                {
-                    std::lock_guard<std::mutex> lock(_mutex);
-                    _result = std::move(local);
-                }
-                if (_result.ready && _result.has_art && !_result.online_failed)
-                {
-                    EventBus::instance().publish(Event{"album_art.online_updated", _current_track});
-                }
-                _dirty.store(true, std::memory_order_release);
-                EventBus::instance().publish(Event{"album_art.updated", _current_track});
+                result.ready = true;
+                result.has_art = true;
+                result.cells = std::move(cached);
             }
-            catch (...)
+            else
             {
+                complete_album_art_fetch(result, config, artist, album);
             }
-            _pending.store(false, std::memory_order_release);
-        });
+        }
+        else if (result.has_art)
+        {
+            // Tracks of one album usually embed the same image, so keying
+            // by its bytes shares the scaled cells across the album.
+            result.key = hash_art_image(result.data);
+        }
+
+        if (token.is_cancelled())
+        {
+            return;
+        }
+        if (result.has_art && !result.cells && size.x > 0)
+        {
+            result.cells = get_art_cells(cache_directory, result.key, result.data, size);
+        }
+        if (result.cells)
+        {
+            ArtCache::instance().remember_track(path, result.key);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (token.is_cancelled() || _generation.load() != generation)
+            {
+                return;
+            }
+            _result = std::move(result);
+            online = online && _result.has_art && !_result.online_failed;
+        }
+
+        _dirty.store(true, std::memory_order_release);
+        _pending.store(false, std::memory_order_release);
+        if (online)
+        {
+            EventBus::instance().post(topics::album_art_online_updated, path);
+        }
+        EventBus::instance().post(topics::album_art_updated, path);
+    });
+}
+
+bool AlbumArt::is_fetching() const
+{
+    return _pending.load(std::memory_order_acquire);
+}
+
+void AlbumArt::set_cache_directory(const std::string& cache_directory)
+{
+    _cache_directory = cache_directory;
+}
+
+glm::ivec2 AlbumArt::get_render_size(const app_config& config) const
+{
+    auto renderer = Renderer::get();
+    if (!renderer)
+    {
+        return glm::ivec2(0);
+    }
+
+    auto size = renderer->get_terminal_size();
+    if (size.x <= 0 || size.y <= 0)
+    {
+        return glm::ivec2(0);
     }
+
+    return glm::ivec2(
+        std::max(1, std::min(size.x, config.art_width_chars)),
+        std::max(1, std::min(size.y, config.art_height_chars)));
 }
 
 bool AlbumArt::refresh(const app_config& config, int origin_x, int origin_y)
@@ -421,53 +527,49 @@ bool AlbumArt::render_current(
         snapshot = _result;
     }
 
-    auto renderer = Renderer::get();
-    if (!renderer)
-    {
-        return false;
-    }
-    auto size = renderer->get_terminal_size();
-
-    int max_cols = size.x;
-    int max_rows = size.y;
-    if (max_cols <= 0 || max_rows <= 0)
-    {
-        return false;
-    }
-
-    max_cols = std::min(max_cols, config.art_width_chars);
-    max_rows = std::min(max_rows, config.art_height_chars);
-
-    int out_w = std::max(1, max_cols);
-    int out_h = std::max(1, max_rows);
-    if (out_w <= 0 || out_h <= 0)
+    glm::ivec2 size = get_render_size(config);
+    if (size.x <= 0 || size.y <= 0)
     {
         return false;
     }
 
     int top_left_y = origin_y;
     ActuallyGoodModule::set_location(glm::ivec2(origin_x, top_left_y));
-    ActuallyGoodModule::set_size(glm::ivec2(out_w, out_h));
+    ActuallyGoodModule::set_size(size);
 
     if (!snapshot.ready || !snapshot.has_art)
     {
         return false;
     }
 
-    if (!load(snapshot.data))
+    // The terminal may have been resized since the fetch scaled the art.
+    art_cells_ptr cells = snapshot.cells;
+    if (!cells || cells->width != size.x || cells->height != size.y)
     {
-        return false;
+        cells = get_art_cells(_cache_directory, snapshot.key, snapshot.data, size);
+        if (!cells)
+        {
+            // Cache hits keep only the scaled cells, not the image, so
+            // fetch again at the new size.
+            if (snapshot.cells && snapshot.data.empty())
+            {
+                start_fetch(config);
+            }
+            return false;
+        }
     }
 
+    apply_cells(*cells);
     draw();
     return true;
 }
 
-void AlbumArt::wait_for_fetch()
+void AlbumArt::cancel_fetch()
 {
-    if (_thread.joinable())
+    if (_task)
     {
-        _thread.join();
+        _task->cancel();
+        _task.reset();
     }
 }
 
@@ -478,80 +580,47 @@ bool AlbumArt::load_image_data(const std::vector<unsigned char>& image_data)
         return false;
     }
 
-    int width = 0;
-    int height = 0;
-    int channels = 0;
-    unsigned char* pixels = stbi_load_from_memory(
-        image_data.data(),
-        static_cast<int>(image_data.size()),
-        &width,
-        &height,
-        &channels,
-        4);
-
-    if (pixels == nullptr || width <= 0 || height <= 0)
-    {
-        return false;
-    }
-
     if (_size.x <= 0 || _size.y <= 0)
     {
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        if (!stbi_info_from_memory(image_data.data(), static_cast<int>(image_data.size()), &width, &height, &channels))
+        {
+            return false;
+        }
         _size = glm::ivec2(width, height);
     }
 
     int out_w = std::max(1, _size.x);
     int out_h = std::max(1, _size.y);
-    _pixels.assign(static_cast<size_t>(out_w * out_h), Terminal::Character{});
-
-    int sample_h = std::max(1, out_h * 2);
-    for (int y = 0; y < out_h; ++y)
+    art_cells cells;
+    if (!render_art_cells(image_data, out_w, out_h, cells))
     {
-        int src_y_top = static_cast<int>((static_cast<float>(y * 2) / static_cast<float>(sample_h)) * height);
-        int src_y_bottom = static_cast<int>((static_cast<float>(y * 2 + 1) / static_cast<float>(sample_h)) * height);
-        if (src_y_top >= height)
-        {
-            src_y_top = height - 1;
-        }
-        if (src_y_bottom >= height)
-        {
-            src_y_bottom = height - 1;
-        }
-
-        for (int x = 0; x < out_w; ++x)
-        {
-            int src_x = static_cast<int>((static_cast<float>(x) / static_cast<float>(out_w)) * width);
-            if (src_x >= width)
-            {
-                src_x = width - 1;
-            }
-
-            size_t src_index_top = static_cast<size_t>((src_y_top * width + src_x) * 4);
-            size_t src_index_bottom = static_cast<size_t>((src_y_bottom * width + src_x) * 4);
-            float inv = 1.0f / 255.0f;
-
-            glm::vec4 top_colour(
-                pixels[src_index_top + 0] * inv,
-                pixels[src_index_top + 1] * inv,
-                pixels[src_index_top + 2] * inv,
-                1.0f);
-            glm::vec4 bottom_colour(
-                pixels[src_index_bottom + 0] * inv,
-                pixels[src_index_bottom + 1] * inv,
-                pixels[src_index_bottom + 2] * inv,
-                1.0f);
-
-            size_t dst_index = static_cast<size_t>(y * out_w + x);
-            Terminal::Character& cell = _pixels[dst_index];
-            cell.set_glyph(U'▄');
-            cell.set_glyph_colour(bottom_colour);
-            cell.set_background_colour(top_colour);
-        }
+        return false;
     }
 
-    stbi_image_free(pixels);
+    apply_cells(cells);
     return true;
 }
 
+void AlbumArt::apply_cells(const art_cells& cells)
+{
+    _size = glm::ivec2(cells.width, cells.height);
+    _pixels.assign(cells.top.size(), Terminal::Character{});
+    for (size_t i = 0; i < cells.top.size(); ++i)
+    {
+        Terminal::Character& cell = _pixels[i];
+        cell.set_glyph(U'▄');
+        cell.set_glyph_colour(Terminal::unpack_colour(cells.bottom[i]));
+        cell.set_background_colour(Terminal::unpack_colour(cells.top[i]));
+    }
+    for (size_t quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        _quadrant_colours[quadrant] = Terminal::unpack_colour(cells.quadrants[quadrant]);
+    }
+}
+
 void AlbumArt::draw() const
 {
     spdlog::trace("AlbumArt::draw()");
@@ -613,118 +682,9 @@ bool AlbumArt::get_quadrant_colours(glm::vec4& top_left, glm::vec4& top_right, g
         return false;
     }
 
-    average_colour(top_left, top_right, bottom_left, bottom_right);
+    top_left = _quadrant_colours[0];
+    top_right = _quadrant_colours[1];
+    bottom_left = _quadrant_colours[2];
+    bottom_right = _quadrant_colours[3];
     return true;
 }
-
-void AlbumArt::average_colour(glm::vec4& top_left, glm::vec4& top_right, glm::vec4& bottom_left, glm::vec4& bottom_right) const
-{
-    top_left = glm::vec4(0.0f);
-    top_right = glm::vec4(0.0f);
-    bottom_left = glm::vec4(0.0f);
-    bottom_right = glm::vec4(0.0f);
-
-    if (_pixels.empty() || _size.x <= 0 || _size.y <= 0)
-    {
-        return;
-    }
-
-    int mid_x = _size.x / 2;
-    int mid_y = _size.y / 2;
-
-    double sum_tl_r = 0.0;
-    double sum_tl_g = 0.0;
-    double sum_tl_b = 0.0;
-    double sum_tr_r = 0.0;
-    double sum_tr_g = 0.0;
-    double sum_tr_b = 0.0;
-    double sum_bl_r = 0.0;
-    double sum_bl_g = 0.0;
-    double sum_bl_b = 0.0;
-    double sum_br_r = 0.0;
-    double sum_br_g = 0.0;
-    double sum_br_b = 0.0;
-
-    double count_tl = 0.0;
-    double count_tr = 0.0;
-    double count_bl = 0.0;
-    double count_br = 0.0;
-
-    for (int y = 0; y < _size.y; ++y)
-    {
-        for (int x = 0; x < _size.x; ++x)
-        {
-            size_t index = static_cast<size_t>(y * _size.x + x);
-            if (index >= _pixels.size())
-            {
-                continue;
-            }
-
-            glm::vec4 colour = _pixels[index].get_glyph_colour();
-            bool left = x < mid_x;
-            bool top = y < mid_y;
-
-            if (top && left)
-            {
-                sum_tl_r += colour.r;
-                sum_tl_g += colour.g;
-                sum_tl_b += colour.b;
-                count_tl += 1.0;
-            }
-            else if (top && !left)
-            {
-                sum_tr_r += colour.r;
-                sum_tr_g += colour.g;
-                sum_tr_b += colour.b;
-                count_tr += 1.0;
-            }
-            else if (!top && left)
-            {
-                sum_bl_r += colour.r;
-                sum_bl_g += colour.g;
-                sum_bl_b += colour.b;
-                count_bl += 1.0;
-            }
-            else
-            {
-                sum_br_r += colour.r;
-                sum_br_g += colour.g;
-                sum_br_b += colour.b;
-                count_br += 1.0;
-            }
-        }
-    }
-
-    if (count_tl > 0.0)
-    {
-        top_left = glm::vec4(
-            static_cast<float>(sum_tl_r / count_tl),
-            static_cast<float>(sum_tl_g / count_tl),
-            static_cast<float>(sum_tl_b / count_tl),
-            1.0f);
-    }
-    if (count_tr > 0.0)
-    {
-        top_right = glm::vec4(
-            static_cast<float>(sum_tr_r / count_tr),
-            static_cast<float>(sum_tr_g / count_tr),
-            static_cast<float>(sum_tr_b / count_tr),
-            1.0f);
-    }
-    if (count_bl > 0.0)
-    {
-        bottom_left = glm::vec4(
-            static_cast<float>(sum_bl_r / count_bl),
-            static_cast<float>(sum_bl_g / count_bl),
-            static_cast<float>(sum_bl_b / count_bl),
-            1.0f);
-    }
-    if (count_br > 0.0)
-    {
-        bottom_right = glm::vec4(
-            static_cast<float>(sum_br_r / count_br),
-            static_cast<float>(sum_br_g / count_br),
-            static_cast<float>(sum_br_b / count_br),
-            1.0f);
-    }
-}
@@ -2,15 +2,16 @@
 #pragma once
 
 #include "actually_good_module.h"
+#include "art_cache.h"
 #include "terminal.h"
 #include "config.h"
+#include "task_scheduler.h"
 
 class Player;
 class Renderer;
 
 #include <atomic>
 #include <mutex>
-#include <thread>
 #include <string>
 #include <vector>
 
@@ -21,10 +22,16 @@ struct art_result
     bool online_failed = false;
     std::vector<unsigned char> data;
     std::string error_message;
+    uint64_t key = 0;
+    art_cells_ptr cells;
 };
 
 bool load_mp3_embedded_art(const char* path, std::vector<unsigned char>& image_data);
 
+// Area-averages an RGBA8 image into out_w x out_h half-block cells and the
+// four quadrant colours in a single pass over the source rows.
+void scale_art_cells(const unsigned char* rgba, int width, int height, int out_w, int out_h, art_cells& cells);
+
 
 class AlbumArt : public ActuallyGoodModule
 {
@@ -48,27 +55,34 @@ public:
         const app_config& config,
         int origin_x,
         int origin_y);
-    void wait_for_fetch();
+    void cancel_fetch();
+    bool is_fetching() const;
+    void set_cache_directory(const std::string& cache_directory);
 
 
 private:
-    void average_colour(glm::vec4& top_left, glm::vec4& top_right, glm::vec4& bottom_left, glm::vec4& bottom_right) const;
     bool render_current(
         const app_config& config,
         int origin_x,
         int origin_y);
+    void start_fetch(const app_config& config);
     bool load_image_data(const std::vector<unsigned char>& image_data);
+    glm::ivec2 get_render_size(const app_config& config) const;
+    void apply_cells(const art_cells& cells);
 
 private:
     mutable std::mutex _mutex;
     art_result _result;
     std::atomic<bool> _dirty{false};
     std::atomic<bool> _pending{false};
-    std::thread _thread;
+    std::atomic<int> _generation{0};
+    task_token_ptr _task;
     std::string _current_track;
     std::string _current_artist;
     std::string _current_album;
+    std::string _cache_directory;
 
 private:
     std::vector<Terminal::Character> _pixels;
+    glm::vec4 _quadrant_colours[4] = {glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f)};
 };
@@ -0,0 +1,400 @@
+#include "alloc_stats.h"
+
+// Only the AllocTrack build replaces the global allocator; elsewhere every
+// call below is a stub and the counts stay zero.
+#if defined(AGMP_ALLOC_TRACKING)
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if defined(_WIN32)
+#include <intrin.h>
+#include <windows.h>
+#else
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+#if defined(_MSC_VER)
+#define AGMP_CALLER_ADDRESS() _ReturnAddress()
+#else
+#define AGMP_CALLER_ADDRESS() __builtin_return_address(0)
+#endif
+
+namespace
+{
+    thread_local alloc_counts thread_counts;
+
+    constexpr int kSiteDepth = 12;
+    constexpr size_t kMaxSites = 1024;
+
+    struct alloc_site
+    {
+        uint64_t key = 0;
+        void* frames[kSiteDepth] = {};
+        int depth = 0;
+        uint8_t zone = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+    };
+
+    thread_local uint8_t thread_zone = 0;
+    thread_local alloc_counts thread_zone_counts[kAllocZoneCount];
+    thread_local bool thread_sites = false;
+    thread_local bool thread_in_capture = false;
+
+    // Shared by every tracked thread; a spin lock keeps the hook free of
+    // anything that could allocate.
+    alloc_site sites[kMaxSites];
+    std::atomic_flag sites_lock = ATOMIC_FLAG_INIT;
+    std::atomic<uint64_t> dropped_allocations{0};
+
+    int capture_stack(void** frames, int depth)
+    {
+#if defined(_WIN32)
+        return static_cast<int>(CaptureStackBackTrace(0, static_cast<DWORD>(depth), frames, nullptr));
+#else
+        return backtrace(frames, depth);
+#endif
+    }
+
+    // `caller` is operator new's return address; frames before it belong
+    // to the hook.
+    void record_site(size_t size, void* caller)
+    {
+        void* frames[kSiteDepth + 4];
+        int depth = capture_stack(frames, kSiteDepth + 4);
+        int skip = 0;
+        for (int i = 0; i < depth; ++i)
+        {
+            if (frames[i] == caller)
+            {
+                skip = i;
+                break;
+            }
+        }
+        depth = std::min(depth - skip, kSiteDepth);
+
+        uint64_t key = 1469598103934665603ull ^ thread_zone;
+        for (int i = 0; i < depth; ++i)
+        {
+            key = (key ^ reinterpret_cast<uintptr_t>(frames[skip + i])) * 1099511628211ull;
+        }
+        key |= 1;
+
+        while (sites_lock.test_and_set(std::memory_order_acquire))
+        {
+        }
+        size_t slot = static_cast<size_t>(key % kMaxSites);
+        for (size_t probe = 0; probe < kMaxSites; ++probe)
+        {
+            alloc_site& site = sites[(slot + probe) % kMaxSites];
+            if (site.key == 0)
+            {
+                site.key = key;
+                site.depth = depth;
+                site.zone = thread_zone;
+                std::memcpy(site.frames, frames + skip, sizeof(void*) * static_cast<size_t>(depth));
+            }
+            if (site.key == key)
+            {
+                ++site.allocations;
+                site.bytes += size;
+                sites_lock.clear(std::memory_order_release);
+                return;
+            }
+        }
+        sites_lock.clear(std::memory_order_release);
+        dropped_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void describe_frame(void* frame, char* text, size_t size)
+    {
+#if defined(_WIN32)
+        std::snprintf(text, size, "%p", frame);
+#else
+        Dl_info info;
+        if (!dladdr(frame, &info) || !info.dli_fname)
+        {
+            std::snprintf(text, size, "%p", frame);
+            return;
+        }
+
+        // The module offset is what addr2line wants for static functions,
+        // which dladdr can't name.
+        uintptr_t offset = reinterpret_cast<uintptr_t>(frame) - reinterpret_cast<uintptr_t>(info.dli_fbase);
+        const char* module = std::strrchr(info.dli_fname, '/');
+        module = module ? module + 1 : info.dli_fname;
+        if (!info.dli_sname)
+        {
+            std::snprintf(text, size, "%s+0x%zx", module, static_cast<size_t>(offset));
+            return;
+        }
+
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::snprintf(text, size, "%s (%s+0x%zx)", status == 0 ? demangled : info.dli_sname, module, static_cast<size_t>(offset));
+        std::free(demangled);
+#endif
+    }
+
+    // Library frames say little about who allocated, so the site is
+    // labelled by the first frame outside them.
+    bool is_library_frame(const char* text)
+    {
+        static const char* const kPrefixes[] = {
+            "operator new", "std::", "void std::", "__gnu_cxx::", "void __gnu_cxx::", "libstdc++", "libc.so",
+        };
+        for (const char* prefix : kPrefixes)
+        {
+            if (std::strncmp(text, prefix, std::strlen(prefix)) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void* allocate(std::size_t size, void* caller)
+    {
+        ++thread_counts.allocations;
+        thread_counts.bytes += size;
+        alloc_counts& zone_counts = thread_zone_counts[thread_zone];
+        ++zone_counts.allocations;
+        zone_counts.bytes += size;
+        if (thread_sites && !thread_in_capture)
+        {
+            // backtrace() allocates the first time it loads the unwinder.
+            thread_in_capture = true;
+            record_site(size, caller);
+            thread_in_capture = false;
+        }
+        if (size == 0)
+        {
+            size = 1;
+        }
+        for (;;)
+        {
+            if (void* memory = std::malloc(size))
+            {
+                return memory;
+            }
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+            {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+    }
+
+    void* allocate_nothrow(std::size_t size, void* caller) noexcept
+    {
+        try
+        {
+            return allocate(size, caller);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+}
+
+alloc_counts get_thread_alloc_counts()
+{
+    return thread_counts;
+}
+
+uint8_t set_thread_alloc_zone(uint8_t zone)
+{
+    uint8_t previous = thread_zone;
+    thread_zone = zone < kAllocZoneCount ? zone : 0;
+    return previous;
+}
+
+alloc_counts get_thread_zone_alloc_counts(uint8_t zone)
+{
+    return zone < kAllocZoneCount ? thread_zone_counts[zone] : alloc_counts{};
+}
+
+void set_thread_alloc_sites(bool enabled)
+{
+    if (enabled)
+    {
+        // Loads the unwinder now rather than inside the first tracked frame.
+        void* frame = nullptr;
+        thread_in_capture = true;
+        capture_stack(&frame, 1);
+        thread_in_capture = false;
+    }
+    thread_sites = enabled;
+}
+
+void clear_alloc_sites()
+{
+    while (sites_lock.test_and_set(std::memory_order_acquire))
+    {
+    }
+    for (alloc_site& site : sites)
+    {
+        site = alloc_site{};
+    }
+    sites_lock.clear(std::memory_order_release);
+    dropped_allocations.store(0, std::memory_order_relaxed);
+}
+
+void report_alloc_sites(std::FILE* out, size_t max_sites, const char* (*zone_name)(uint8_t zone))
+{
+    // Reporting allocates; keep it out of the table it is reading.
+    const bool was_tracking = thread_sites;
+    thread_sites = false;
+
+    std::vector<alloc_site> copy;
+    while (sites_lock.test_and_set(std::memory_order_acquire))
+    {
+    }
+    for (const alloc_site& site : sites)
+    {
+        if (site.key != 0)
+        {
+            copy.push_back(site);
+        }
+    }
+    sites_lock.clear(std::memory_order_release);
+
+    std::sort(copy.begin(), copy.end(), [](const alloc_site& a, const alloc_site& b)
+    {
+        return a.allocations > b.allocations;
+    });
+    if (copy.size() > max_sites)
+    {
+        copy.resize(max_sites);
+    }
+
+    char text[512];
+    for (const alloc_site& site : copy)
+    {
+        if (site.depth == 0)
+        {
+            continue;
+        }
+
+        int label = 0;
+        for (int i = 0; i < site.depth; ++i)
+        {
+            describe_frame(site.frames[i], text, sizeof(text));
+            if (!is_library_frame(text))
+            {
+                label = i;
+                break;
+            }
+        }
+        describe_frame(site.frames[label], text, sizeof(text));
+        std::fprintf(
+            out,
+            "%8llu allocs %10llu bytes  [%s]  %s\n",
+            static_cast<unsigned long long>(site.allocations),
+            static_cast<unsigned long long>(site.bytes),
+            zone_name ? zone_name(site.zone) : "",
+            text);
+        for (int i = 0; i < site.depth; ++i)
+        {
+            describe_frame(site.frames[i], text, sizeof(text));
+            std::fprintf(out, "        %s %s\n", i == label ? "*" : " ", text);
+        }
+    }
+
+    uint64_t dropped = dropped_allocations.load(std::memory_order_relaxed);
+    if (dropped > 0)
+    {
+        std::fprintf(out, "%llu allocations from sites beyond the first %zu\n", static_cast<unsigned long long>(dropped), kMaxSites);
+    }
+    thread_sites = was_tracking;
+}
+
+void* operator new(std::size_t size)
+{
+    return allocate(size, AGMP_CALLER_ADDRESS());
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocate(size, AGMP_CALLER_ADDRESS());
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_nothrow(size, AGMP_CALLER_ADDRESS());
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate_nothrow(size, AGMP_CALLER_ADDRESS());
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+    std::free(memory);
+}
+
+#else
+
+alloc_counts get_thread_alloc_counts()
+{
+    return alloc_counts{};
+}
+
+uint8_t set_thread_alloc_zone(uint8_t)
+{
+    return 0;
+}
+
+alloc_counts get_thread_zone_alloc_counts(uint8_t)
+{
+    return alloc_counts{};
+}
+
+void set_thread_alloc_sites(bool)
+{
+}
+
+void clear_alloc_sites()
+{
+}
+
+void report_alloc_sites(std::FILE* out, size_t, const char* (*)(uint8_t))
+{
+    std::fprintf(out, "call sites are only recorded by the AllocTrack build\n");
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(AGMP_ALLOC_TRACKING)
+constexpr bool kAllocTracking = true;
+#else
+constexpr bool kAllocTracking = false;
+#endif
+
+// Tag 0 collects allocations made outside any tagged zone.
+constexpr size_t kAllocZoneCount = 16;
+
+struct alloc_counts
+{
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+// Everything here only records in the AllocTrack configuration, which
+// defines AGMP_ALLOC_TRACKING and replaces the global operator new; other
+// builds keep the standard allocator and every count stays zero.
+
+// Every operator new made on the calling thread since it started.
+alloc_counts get_thread_alloc_counts();
+
+// Tags this thread's allocations with `zone` and returns the previous tag so
+// scopes can nest.
+uint8_t set_thread_alloc_zone(uint8_t zone);
+alloc_counts get_thread_zone_alloc_counts(uint8_t zone);
+
+// Captures a stack for every allocation on this thread while enabled.
+void set_thread_alloc_sites(bool enabled);
+void clear_alloc_sites();
+// Lists the busiest call sites, `zone_name` labelling each site's zone tag.
+void report_alloc_sites(std::FILE* out, size_t max_sites, const char* (*zone_name)(uint8_t zone));
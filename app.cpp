@@ -4,21 +4,24 @@
 #include <chrono>
 #include <filesystem>
 #include <string>
-#include <thread>
 
 #include "app.h"
 #include "canvas.h"
 #include "draw.h"
 #include "event.h"
+#include "event_loop.h"
 #include "http.h"
 #include "input.h"
+#include "library.h"
 #include "metadata.h"
 #include "net.h"
 #include "player.h"
+#include "profiler.h"
 #include "spectrum_analyzer.h"
 #include "state.h"
 #include "terminal.h"
 #include "rice.h"
+#include "task_scheduler.h"
 
 #include <glm/vec4.hpp>
 
@@ -28,6 +31,30 @@
 #include <windows.h>
 #endif
 
+static constexpr std::chrono::milliseconds kMetadataRetryPeriod(250);
+static constexpr std::chrono::milliseconds kMetadataRevalidatePeriod(2000);
+
+// Without workers (the headless modes) the metadata read in setup_frame
+// stands for the whole run.
+static void request_metadata_check(frame_state& frame)
+{
+    if (frame.current_meta_path.empty() || TaskScheduler::instance().get_thread_count() == 0)
+    {
+        return;
+    }
+
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    frame.meta_check_done = done;
+    frame.meta_check_pending = true;
+    TaskScheduler::instance().submit(
+        task_priority::low,
+        [path = frame.current_meta_path, done](const TaskToken&)
+    {
+        MetadataCache::instance().get(path);
+        done->store(true, std::memory_order_release);
+    });
+}
+
 static char normalize_key(char value)
 {
     unsigned char ch = static_cast<unsigned char>(value);
@@ -76,6 +103,8 @@ void ActuallyGoodMP::init()
 
     http_init();
     input_init();
+    EventLoop::instance().init();
+    EventBus::instance().set_dispatch_thread();
 
     _config = load_config("config.toml");
     if (_config.safe_mode)
@@ -83,32 +112,31 @@ void ActuallyGoodMP::init()
         _config.enable_online_art = false;
     }
 
-    Renderer::init(_terminal);
+    TaskScheduler::instance().start(_config.worker_threads);
+    _player.init();
+    _scrubber.set_cache_directory(_config.cache_directory);
+    _album_art.set_cache_directory(_config.cache_directory);
 
-    if (auto renderer = Renderer::get())
+    if (!_config.library_index_path.empty())
     {
-        _canvas.resize(renderer->get_terminal_size());
-        if (_config.draw_grid_canvas)
-        {
-            _canvas.build_grid(_config);
-        }
-        else
-        {
-            _canvas.build_default(_config);
-        }
-        renderer->set_canvas(_canvas.get_buffer());
+        LibraryIndex::instance().load(_config.library_index_path);
+        LibraryIndex::instance().set_scan_threads(_config.library_scan_threads);
+        LibraryIndex::instance().start_background_rescan(_config.library_path, _config.library_index_path);
     }
 
+    Renderer::init(_terminal);
+    init_canvas();
+
     _mp3_selected_subscription = EventBus::instance().subscribe(
-        "browser.mp3_selected",
-        [this](const Event& event)
+        topics::mp3_selected,
+        [this](const std::string& path)
         {
-            if (event.payload.empty())
+            if (path.empty())
             {
                 return;
             }
 
-            _player.set_current_track(event.payload);
+            _player.set_current_track(path);
             _player.stop_playback();
             _player.start_playback(_player.get_current_track());
 
@@ -120,33 +148,34 @@ void ActuallyGoodMP::init()
 
             int scrubber_columns = std::max(1, _config.scrubber_width - 2);
             _scrubber.request_waveform(_player.get_current_track(), scrubber_columns);
+            prefetch_upcoming_metadata();
         });
 
     _album_art_subscription = EventBus::instance().subscribe(
-        "album_art.updated",
-        [this](const Event&)
+        topics::album_art_updated,
+        [this](const std::string&)
         {
             _album_art.refresh(_config, _config.art_origin_x, _config.art_origin_y);
             update_canvas_from_album();
         });
 
     _album_art_online_subscription = EventBus::instance().subscribe(
-        "album_art.online_updated",
-        [this](const Event&)
+        topics::album_art_online_updated,
+        [this](const std::string&)
         {
             _album_art.refresh(_config, _config.art_origin_x, _config.art_origin_y);
             update_canvas_from_album();
             if (auto renderer = Renderer::get())
             {
-                renderer->set_layer("wallpaper", _canvas.get_buffer());
+                renderer->set_layer(Terminal::Layer::wallpaper, _canvas.get_buffer());
             }
         });
 
     _track_changed_subscription = EventBus::instance().subscribe(
-        "player.track_changed",
-        [this](const Event& event)
+        topics::track_changed,
+        [this](const std::string& path)
         {
-            if (event.payload.empty())
+            if (path.empty())
             {
                 return;
             }
@@ -159,38 +188,39 @@ void ActuallyGoodMP::init()
 
             int scrubber_columns = std::max(1, _config.scrubber_width - 2);
             _scrubber.request_waveform(_player.get_current_track(), scrubber_columns);
+            prefetch_upcoming_metadata();
         });
 
     _queue_subscription = EventBus::instance().subscribe(
-        "queue.enqueue",
-        [this](const Event& event)
+        topics::queue_enqueue,
+        [this](const std::string& path)
         {
-            if (event.payload.empty())
+            if (path.empty())
             {
                 return;
             }
 
-            _queue.enqueue(event.payload);
+            _queue.enqueue(path);
             _queue.draw(_config);
         });
 
     _stop_play_subscription = EventBus::instance().subscribe(
-        "player.stop",
-        [this](const Event&)
+        topics::player_stop,
+        [this](const no_payload&)
         {
             _player.stop_playback();
         });
 
     _play_rest_subscription = EventBus::instance().subscribe(
-        "queue.play_rest",
-        [this](const Event& event)
+        topics::queue_play_rest,
+        [this](const std::string& track)
         {
-            if (event.payload.empty())
+            if (track.empty())
             {
                 return;
             }
 
-            std::filesystem::path selected(event.payload);
+            std::filesystem::path selected(track);
             std::filesystem::path album_path = selected.parent_path();
             if (album_path.empty())
             {
@@ -233,20 +263,25 @@ void ActuallyGoodMP::init()
     init_browsers();
 }
 
-void ActuallyGoodMP::run()
+void ActuallyGoodMP::init_headless(const app_config& config, int output_fd, const glm::ivec2& size, const std::string& track_path)
 {
-    _rice.run(_config);
-    
-    MetadataPanel metadata_panel;
+    _config = config;
+    _terminal.set_output_fd(output_fd);
+    _terminal.set_fixed_size(size);
+
+    EventLoop::instance().init();
+    EventBus::instance().set_dispatch_thread();
+    Renderer::init(_terminal);
+    init_canvas();
+    init_browsers();
 
-    SpectrumAnalyzer analyzer;
+    _player.set_current_track(track_path);
+}
 
-    int metadata_origin_x = _config.metadata_origin_x;
-    int metadata_origin_y = _config.metadata_origin_y;
-    int metadata_width = _config.metadata_width;
-    int metadata_height = _config.metadata_height;
-    metadata_panel.set_location(glm::ivec2(metadata_origin_x, metadata_origin_y));
-    metadata_panel.set_size(glm::ivec2(metadata_width, metadata_height));
+void ActuallyGoodMP::setup_frame(frame_state& frame)
+{
+    frame.metadata_panel.set_location(glm::ivec2(_config.metadata_origin_x, _config.metadata_origin_y));
+    frame.metadata_panel.set_size(glm::ivec2(_config.metadata_width, _config.metadata_height));
 
     _queue.set_location(glm::ivec2(_config.queue_origin_x, _config.queue_origin_y));
     _queue.set_size(glm::ivec2(_config.queue_width, _config.queue_height));
@@ -254,9 +289,10 @@ void ActuallyGoodMP::run()
     _scrubber.set_location(glm::ivec2(_config.scrubber_origin_x, _config.scrubber_origin_y));
     _scrubber.set_size(glm::ivec2(_config.scrubber_width, _config.scrubber_height));
 
-    analyzer.set_location(glm::ivec2(_config.spectrum_origin_x, _config.spectrum_origin_y));
-    analyzer.set_size(glm::ivec2(_config.spectrum_width, _config.spectrum_height));
-    _player.set_spectrum_analyzer(&analyzer);
+    frame.analyzer.set_location(glm::ivec2(_config.spectrum_origin_x, _config.spectrum_origin_y));
+    frame.analyzer.set_size(glm::ivec2(_config.spectrum_width, _config.spectrum_height));
+    frame.analyzer.set_fft_size(_config.spectrum_fft_size);
+    _player.set_spectrum_analyzer(&frame.analyzer);
     _player.set_queue(&_queue);
 
     _artist_browser.draw();
@@ -267,15 +303,41 @@ void ActuallyGoodMP::run()
     _scrubber.draw(_config);
     if (!_config.safe_mode)
     {
-        track_metadata meta;
-        if (read_track_metadata(_player.get_current_track(), meta))
-        {
-            metadata_panel.draw(_config, meta);
-        }
+        frame.metadata_panel.draw(_config, MetadataCache::instance().get(_player.get_current_track()));
     }
     _terminal.mark_all_dirty();
     _terminal.update();
 
+    int target_rate = std::max(1, _config.target_refresh_rate);
+    frame.frame_period = std::chrono::duration_cast<frame_state::clock::duration>(
+        std::chrono::duration<double>(1.0 / static_cast<double>(target_rate)));
+    frame.last_frame = frame_state::clock::now();
+    frame.next_frame = frame.last_frame;
+}
+
+void ActuallyGoodMP::init_canvas()
+{
+    if (auto renderer = Renderer::get())
+    {
+        _canvas.resize(renderer->get_terminal_size());
+        if (_config.draw_grid_canvas)
+        {
+            _canvas.build_grid(_config);
+        }
+        else
+        {
+            _canvas.build_default(_config);
+        }
+        renderer->set_canvas(_canvas.get_buffer());
+    }
+}
+
+void ActuallyGoodMP::run()
+{
+    _rice.run(_config);
+
+    frame_state frame;
+    setup_frame(frame);
 
     net_info info;
     bool network_started = start_network(_config.listen_port, info);
@@ -317,174 +379,299 @@ void ActuallyGoodMP::run()
  
     if (!_config.safe_mode)
     {
-        track_metadata initial_meta;
-        if (read_track_metadata(_player.get_current_track(), initial_meta) && initial_meta.duration_ms > 0)
+        track_metadata_ptr initial_meta = MetadataCache::instance().get(_player.get_current_track());
+        if (initial_meta && initial_meta->duration_ms > 0)
         {
-            if (state.context.position_ms >= initial_meta.duration_ms)
+            if (state.context.position_ms >= initial_meta->duration_ms)
             {
                 state.context.position_ms = 0;
             }
         }
     }
 
-    bool playback_active = _player.start_playback(_player.get_current_track()) == 0;
-    if (_config.auto_resume_playback && playback_active
+    frame.playback_active = _player.start_playback(_player.get_current_track()) == 0;
+    if (_config.auto_resume_playback && frame.playback_active
         && state.context.position_ms > 0
         && _player.get_current_track() == state.context.track_path)
     {
         _player.seek_ms(state.context.position_ms);
     }
 
-    using clock = std::chrono::steady_clock;
-    auto last_frame = clock::now();
-    double delta_time = 0.0;
-    double smoothed_fps = 0.0;
-    int target_rate = std::max(1, _config.target_refresh_rate);
-    double target_frame_time = 1.0 / static_cast<double>(target_rate);
+    frame.last_frame = frame_state::clock::now();
+    frame.next_frame = frame.last_frame;
 
     _terminal.mark_all_dirty();
     bool quit = false;
     while (!quit)
     {
-        auto frame_start = clock::now();
-        delta_time = std::chrono::duration<double>(frame_start - last_frame).count();
-        last_frame = frame_start;
-        if (delta_time > 0.0)
+        quit = run_frame(frame);
+    }
+
+    return;
+}
+
+// One pass of the main loop: wait for the next frame, key or wakeup, then
+// update and draw everything. Returns true once a key asked to quit.
+bool ActuallyGoodMP::run_frame(frame_state& frame)
+{
+    using clock = frame_state::clock;
+
+    // The frame timer only runs while something moves; otherwise the
+    // loop sleeps until a key, a resize or a background wakeup.
+    int timeout_ms = -1;
+    if (frame.animating)
+    {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(frame.next_frame - clock::now());
+        timeout_ms = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, remaining.count()));
+    }
+    loop_wakeup wakeup = EventLoop::instance().wait(timeout_ms);
+    frame.input_ready = frame.input_ready || wakeup.input;
+
+    auto frame_start = clock::now();
+    if (frame_start >= frame.next_frame)
+    {
+        frame.next_frame = std::max(frame.next_frame + frame.frame_period, frame_start);
+    }
+    double delta_time = std::chrono::duration<double>(frame_start - frame.last_frame).count();
+    frame.last_frame = frame_start;
+    if (delta_time > 0.0)
+    {
+        double fps = 1.0 / delta_time;
+        if (frame.smoothed_fps <= 0.0)
         {
-            double fps = 1.0 / delta_time;
-            if (smoothed_fps <= 0.0)
-            {
-                smoothed_fps = fps;
-            }
-            else
-            {
-                smoothed_fps = smoothed_fps * 0.9 + fps * 0.1;
-            }
+            frame.smoothed_fps = fps;
+        }
+        else
+        {
+            frame.smoothed_fps = frame.smoothed_fps * 0.9 + fps * 0.1;
+        }
+    }
+
+    Profiler& profiler = Profiler::instance();
+    const uint64_t frame_start_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(frame_start.time_since_epoch()).count());
+
+    _player.update();
+    if (frame.playback_active && _player.is_done())
+    {
+        _player.handle_track_finished();
+    }
+
+    EventBus::instance().dispatch_deferred();
+
+    int duration_ms = 0;
+    if (!_config.safe_mode)
+    {
+        ProfileScope scope(profile_zone::metadata);
+        const std::string& track_path = _player.get_current_track();
+        if (track_path != frame.current_meta_path)
+        {
+            frame.current_meta_path = track_path;
+            frame.current_meta = MetadataCache::instance().find(track_path);
+            frame.meta_check_pending = false;
+            frame.next_meta_check = frame_start;
         }
 
-        if (playback_active && _player.is_done())
+        // The file is stat-ed, and re-read if it changed, on a worker; the
+        // frame only picks the result up from the cache. A failed read is
+        // retried shortly; a good one is revalidated now and then so a
+        // retagged file shows up mid-track.
+        if (frame.meta_check_pending && frame.meta_check_done->load(std::memory_order_acquire))
+        {
+            frame.meta_check_pending = false;
+            frame.current_meta = MetadataCache::instance().find(frame.current_meta_path);
+            frame.next_meta_check = frame_start + (frame.current_meta ? kMetadataRevalidatePeriod : kMetadataRetryPeriod);
+        }
+        if (!frame.meta_check_pending && frame_start >= frame.next_meta_check)
         {
-            _player.handle_track_finished();
+            request_metadata_check(frame);
+            frame.next_meta_check = frame_start + kMetadataRevalidatePeriod;
         }
 
-        int duration_ms = 0;
-        if (!_config.safe_mode)
+        if (frame.current_meta)
         {
-            track_metadata meta;
-            if (read_track_metadata(_player.get_current_track(), meta))
+            frame.metadata_panel.draw(_config, frame.current_meta);
+            duration_ms = frame.current_meta->duration_ms;
+            if (frame.current_meta->duration_ms > 0)
             {
-                metadata_panel.draw(_config, meta);
-                duration_ms = meta.duration_ms;
-                if (meta.duration_ms > 0)
-                {
-                    float progress = static_cast<float>(_player.get_position_ms()) / static_cast<float>(meta.duration_ms);
-                    _scrubber.set_progress(progress);
-                    _scrubber.set_time_ms(_player.get_position_ms(), meta.duration_ms);
-                }
+                float progress = static_cast<float>(_player.get_position_ms()) / static_cast<float>(frame.current_meta->duration_ms);
+                _scrubber.set_progress(progress);
+                _scrubber.set_time_ms(_player.get_position_ms(), frame.current_meta->duration_ms);
             }
         }
+    }
 
+    {
+        ProfileScope scope(profile_zone::scrubber);
         _scrubber.draw(_config);
+    }
 
-        float gain = _scrubber.consume_peak_gain();
-        if (gain >= 0.0f)
-        {
-            _player.set_volume(gain);
-            analyzer.set_gain(gain);
-        }
+    float gain = _scrubber.consume_peak_gain();
+    if (gain >= 0.0f)
+    {
+        _player.set_volume(gain);
+        frame.analyzer.set_gain(gain);
+    }
 
-        analyzer.update();
-        analyzer.draw();
+    {
+        ProfileScope scope(profile_zone::analyzer_update);
+        frame.analyzer.update();
+    }
+    {
+        ProfileScope scope(profile_zone::analyzer_draw);
+        frame.analyzer.draw(_config);
+    }
 
+    {
+        ProfileScope scope(profile_zone::particles);
         _particles.set_angle_bias(_config.particle_angle_bias);
         _particles.update(static_cast<float>(delta_time));
         _particles.draw(_config);
+    }
 
-        glm::ivec2 term_size = _terminal.get_size();
-        int fps_value = static_cast<int>(smoothed_fps + 0.5);
-        std::string fps_text = std::to_string(fps_value) + " fps";
-        static int fps_text_width = 0;
-        if (static_cast<int>(fps_text.size()) > fps_text_width)
-        {
-            fps_text_width = static_cast<int>(fps_text.size());
-        }
-        if (static_cast<int>(fps_text.size()) < fps_text_width)
-        {
-            fps_text.append(static_cast<size_t>(fps_text_width - static_cast<int>(fps_text.size())), ' ');
-        }
-        int fps_x = term_size.x - fps_text_width;
+    glm::ivec2 term_size = _terminal.get_size();
+    int fps_value = static_cast<int>(frame.smoothed_fps + 0.5);
+    std::string& fps_text = frame.fps_text;
+    fps_text = std::to_string(fps_value);
+    fps_text += " fps";
+    if (static_cast<int>(fps_text.size()) > frame.fps_text_width)
+    {
+        frame.fps_text_width = static_cast<int>(fps_text.size());
+    }
+    if (static_cast<int>(fps_text.size()) < frame.fps_text_width)
+    {
+        fps_text.append(static_cast<size_t>(frame.fps_text_width - static_cast<int>(fps_text.size())), ' ');
+    }
+    int fps_x = term_size.x - frame.fps_text_width;
+
+    if (fps_x < 0)
+    {
+        fps_x = 0;
+    }
+
+    if (auto renderer = Renderer::get())
+    {
+        renderer->draw_string(fps_text, glm::ivec2(fps_x, 0));
+    }
 
-        if (fps_x < 0)
+    if (profiler.is_enabled())
+    {
+        int overlay_x = std::max(0, term_size.x - ProfilerOverlay::kWidth - 1);
+        _profiler_overlay.set_location(glm::ivec2(overlay_x, 1));
+        _profiler_overlay.set_size(glm::ivec2(ProfilerOverlay::kWidth, ProfilerOverlay::kHeight));
+        _profiler_overlay.set_latency(_player.get_latency_stats());
+        _profiler_overlay.draw(_config);
+    }
+
+    bool quit = false;
+    if (frame.input_ready)
+    {
+        ProfileScope scope(profile_zone::input);
+        frame.input_ready = false;
+        int raw_key = -1;
+        while (!quit && (raw_key = input_poll_key()) != -1)
         {
-            fps_x = 0;
+            quit = handle_key(raw_key, duration_ms);
         }
+    }
 
-        if (auto renderer = Renderer::get())
+    _terminal.update();
+
+    if (profiler.is_enabled())
+    {
+        profiler.record(profile_zone::frame, frame_start_ns, Profiler::now_ns());
+        profiler.end_frame();
+    }
+
+    frame.animating = profiler.is_enabled()
+        || (_player.is_playing() && !_player.is_done())
+        || _particles.has_particles()
+        || frame.analyzer.is_animating()
+        || _album_art.is_fetching();
+    return quit;
+}
+
+bool ActuallyGoodMP::handle_key(int raw_key, int duration_ms)
+{
+    int key = raw_key;
+    if (!_config.use_arrow_keys)
+    {
+        if (raw_key == input_key_up || raw_key == input_key_down || raw_key == input_key_left || raw_key == input_key_right)
         {
-            renderer->draw_string(fps_text, glm::ivec2(fps_x, 0));
+            key = -1;
         }
+    }
+    key = map_navigation_key(_config, key);
+    if (key == -1)
+    {
+        return false;
+    }
 
-        int raw_key = input_poll_key();
-        int key = raw_key;
-        if (!_config.use_arrow_keys)
+    char ch = normalize_key(static_cast<char>(key));
+    char pause_key = normalize_key(_config.play_pause_key);
+    char quit_key = normalize_key(_config.quit_key);
+    char next_key = normalize_key(_config.skip_next_key);
+    char prev_key = normalize_key(_config.skip_prev_key);
+    if (ch == normalize_key(_config.profiler_key))
+    {
+        toggle_profiler();
+        return false;
+    }
+    if (ch >= '0' && ch <= '9')
+    {
+        if (duration_ms > 0)
         {
-            if (raw_key == input_key_up || raw_key == input_key_down || raw_key == input_key_left || raw_key == input_key_right)
-            {
-                key = -1;
-            }
+            int digit = ch - '0';
+            float fraction = static_cast<float>(digit) / 10.0f;
+            int target_ms = static_cast<int>(std::round(static_cast<float>(duration_ms) * fraction));
+            _player.seek_ms(target_ms);
         }
-        key = map_navigation_key(_config, key);
-        if (key != -1)
-        {
-            char ch = normalize_key(static_cast<char>(key));
-            char pause_key = normalize_key(_config.play_pause_key);
-            char quit_key = normalize_key(_config.quit_key);
-            char next_key = normalize_key(_config.skip_next_key);
-            char prev_key = normalize_key(_config.skip_prev_key);
-            if (ch >= '0' && ch <= '9')
-            {
-                if (duration_ms > 0)
-                {
-                    int digit = ch - '0';
-                    float fraction = static_cast<float>(digit) / 10.0f;
-                    int target_ms = static_cast<int>(std::round(static_cast<float>(duration_ms) * fraction));
-                    _player.seek_ms(target_ms);
-                }
-                continue;
-            }
-            if (ch == next_key)
-            {
-                _player.skip_next();
-                continue;
-            }
-            if (ch == prev_key)
-            {
-                _player.skip_previous();
-                continue;
-            }
-            if (ch == pause_key)
-            {
-                _player.toggle_pause();
-            }
-            if (ch == quit_key)
-            {
-                quit = true;
-            }
+        return false;
+    }
+    if (ch == next_key)
+    {
+        _player.skip_next();
+        return false;
+    }
+    if (ch == prev_key)
+    {
+        _player.skip_previous();
+        return false;
+    }
+    if (ch == pause_key)
+    {
+        _player.toggle_pause();
+    }
 
-            _artist_browser.update(key);
-        }
+    _artist_browser.update(key);
+    return ch == quit_key;
+}
 
-        _terminal.update();
-        auto frame_end = clock::now();
-        double frame_time = std::chrono::duration<double>(frame_end - frame_start).count();
-        double sleep_time = target_frame_time - frame_time;
-        if (sleep_time > 0.0)
-        {
-            std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
-        }
+void ActuallyGoodMP::toggle_profiler()
+{
+    Profiler& profiler = Profiler::instance();
+    if (!profiler.is_enabled())
+    {
+        profiler.set_enabled(true);
+        return;
     }
 
-    return;
+    profiler.set_enabled(false);
+    _profiler_overlay.clear();
+    _artist_browser.draw();
+    _album_browser.draw();
+    _song_browser.draw();
+    _action_browser.draw();
+    _queue.draw(_config);
+
+    if (profiler.write_trace(_config.profiler_trace_path))
+    {
+        spdlog::info("Profiler: wrote {} trace events to {}", profiler.get_trace_event_count(), _config.profiler_trace_path);
+    }
+    else
+    {
+        spdlog::warn("Profiler: cannot write trace to {}", _config.profiler_trace_path);
+    }
 }
 
 const app_config& ActuallyGoodMP::get_config() const
@@ -509,9 +696,17 @@ void ActuallyGoodMP::shutdown()
     save.queue_paths = _queue.get_paths();
     save_state("state.toml", save);
 
-    _player.stop_playback();
+    if (Profiler::instance().is_enabled())
+    {
+        toggle_profiler();
+    }
+
+    _player.shutdown();
+    LibraryIndex::instance().stop();
+    TaskScheduler::instance().stop();
 
     _terminal.shutdown();
+    EventLoop::instance().shutdown();
 
     if (_mp3_selected_subscription != 0)
     {
@@ -561,6 +756,13 @@ void ActuallyGoodMP::shutdown()
     stop_network();
 }
 
+void ActuallyGoodMP::prefetch_upcoming_metadata()
+{
+    std::vector<std::string> upcoming = _queue.get_paths();
+    upcoming.push_back(_song_browser.get_next_song_path());
+    MetadataCache::instance().prefetch(upcoming);
+}
+
 void ActuallyGoodMP::update_canvas_from_album()
 {
     auto renderer = Renderer::get();
@@ -578,7 +780,7 @@ void ActuallyGoodMP::update_canvas_from_album()
     {
         _canvas.build_from_album(_config, _album_art);
     }
-    renderer->set_layer("wallpaper", _canvas.get_buffer());
+    renderer->set_layer(Terminal::Layer::wallpaper, _canvas.get_buffer());
 }
 
 void ActuallyGoodMP::init_browsers()
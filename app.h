@@ -1,16 +1,48 @@
 #pragma once
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+
 #include "album_art.h"
 #include "browser.h"
 #include "canvas.h"
+#include "metadata.h"
 #include "player.h"
+#include "profiler.h"
 #include "queue.h"
 #include "rice.h"
 #include "scrubber.h"
+#include "spectrum_analyzer.h"
 #include "terminal.h"
 #include "particles.h"
 
+// What the main loop carries from one frame to the next.
+struct frame_state
+{
+    using clock = std::chrono::steady_clock;
+
+    MetadataPanel metadata_panel;
+    SpectrumAnalyzer analyzer;
+    clock::time_point last_frame;
+    clock::time_point next_frame;
+    clock::duration frame_period{};
+    double smoothed_fps = 0.0;
+    std::string fps_text;
+    int fps_text_width = 0;
+    std::string current_meta_path;
+    track_metadata_ptr current_meta;
+    clock::time_point next_meta_check;
+    // Set by the worker revalidating current_meta_path once it is done.
+    std::shared_ptr<std::atomic<bool>> meta_check_done;
+    bool meta_check_pending = false;
+    bool playback_active = false;
+    bool animating = true;
+    bool input_ready = true;
+};
+
 class ActuallyGoodMP
 {
 public:
@@ -20,6 +52,12 @@ public:
     void run();
     void shutdown();
 
+    // Draws into output_fd at a fixed size; no console, audio, network or
+    // library scan. Used by agmp --check-allocs.
+    void init_headless(const app_config& config, int output_fd, const glm::ivec2& size, const std::string& track_path);
+    void setup_frame(frame_state& frame);
+    bool run_frame(frame_state& frame);
+
     const app_config& get_config() const;
     Canvas* get_canvas();
 
@@ -31,7 +69,11 @@ public:
     void init_browsers();
 
 private:
+    void init_canvas();
     void update_canvas_from_album();
+    void prefetch_upcoming_metadata();
+    bool handle_key(int raw_key, int duration_ms);
+    void toggle_profiler();
 
 private:
     ActuallyGoodMP() = default;
@@ -59,5 +101,6 @@ private:
     Queue _queue;
     Scrubber _scrubber;
     ParticleSystem _particles;
+    ProfilerOverlay _profiler_overlay;
 
 };
@@ -0,0 +1,222 @@
+#include "art_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+static constexpr char kArtMagic[4] = {'A', 'G', 'A', 'C'};
+static constexpr uint32_t kArtVersion = 2;
+static constexpr int kMaxArtDimension = 1024;
+
+struct art_file_header
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    uint32_t quadrants[4];
+};
+
+static uint64_t fnv1a(const unsigned char* data, size_t size, uint64_t hash = 1469598103934665603ull)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t hash_art_image(const std::vector<unsigned char>& image_data)
+{
+    return fnv1a(image_data.data(), image_data.size());
+}
+
+uint64_t hash_art_album(const std::string& artist, const std::string& album)
+{
+    std::string key = "online\n" + artist + "\n" + album;
+    return fnv1a(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+}
+
+std::string art_cache_path(const std::string& cache_directory, uint64_t key, int width, int height)
+{
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx_%dx%d.cells", static_cast<unsigned long long>(key), width, height);
+    std::filesystem::path path = std::filesystem::path(cache_directory.empty() ? "." : cache_directory) / "art" / name;
+    return path.string();
+}
+
+bool load_art_cells(const std::string& cache_path, art_cells& cells)
+{
+    std::ifstream file(cache_path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    art_file_header header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file
+        || !std::equal(std::begin(kArtMagic), std::end(kArtMagic), header.magic)
+        || header.version != kArtVersion
+        || header.width <= 0 || header.width > kMaxArtDimension
+        || header.height <= 0 || header.height > kMaxArtDimension)
+    {
+        return false;
+    }
+
+    art_cells loaded;
+    loaded.width = header.width;
+    loaded.height = header.height;
+    std::copy(std::begin(header.quadrants), std::end(header.quadrants), loaded.quadrants);
+    size_t count = static_cast<size_t>(header.width) * static_cast<size_t>(header.height);
+    loaded.top.resize(count);
+    loaded.bottom.resize(count);
+    file.read(reinterpret_cast<char*>(loaded.top.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+    file.read(reinterpret_cast<char*>(loaded.bottom.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+    if (!file)
+    {
+        return false;
+    }
+
+    cells = std::move(loaded);
+    return true;
+}
+
+bool save_art_cells(const std::string& cache_path, const art_cells& cells)
+{
+    size_t count = static_cast<size_t>(cells.width) * static_cast<size_t>(cells.height);
+    if (count == 0 || cells.top.size() != count || cells.bottom.size() != count)
+    {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), error);
+
+    std::string temp_path = cache_path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        art_file_header header{};
+        std::copy(std::begin(kArtMagic), std::end(kArtMagic), header.magic);
+        header.version = kArtVersion;
+        header.width = cells.width;
+        header.height = cells.height;
+        std::copy(std::begin(cells.quadrants), std::end(cells.quadrants), header.quadrants);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(cells.top.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        file.write(reinterpret_cast<const char*>(cells.bottom.data()), static_cast<std::streamsize>(count * sizeof(uint32_t)));
+        if (!file)
+        {
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error)
+    {
+        spdlog::warn("save_art_cells: failed to write '{}': {}", cache_path, error.message());
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+ArtCache& ArtCache::instance()
+{
+    static ArtCache cache;
+    return cache;
+}
+
+uint64_t ArtCache::make_slot(uint64_t key, int width, int height)
+{
+    uint64_t size = (static_cast<uint64_t>(static_cast<uint32_t>(width)) << 32) | static_cast<uint32_t>(height);
+    return key ^ (size * 0x9e3779b97f4a7c15ull);
+}
+
+art_cells_ptr ArtCache::find_in_memory(uint64_t key, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Entry* entry = _entries.find(make_slot(key, width, height));
+    if (!entry
+        || entry->key != key
+        || entry->cells->width != width
+        || entry->cells->height != height)
+    {
+        return nullptr;
+    }
+    return entry->cells;
+}
+
+art_cells_ptr ArtCache::find(const std::string& cache_directory, uint64_t key, int width, int height)
+{
+    if (art_cells_ptr cells = find_in_memory(key, width, height))
+    {
+        return cells;
+    }
+
+    auto loaded = std::make_shared<art_cells>();
+    if (!load_art_cells(art_cache_path(cache_directory, key, width, height), *loaded)
+        || loaded->width != width
+        || loaded->height != height)
+    {
+        return nullptr;
+    }
+
+    art_cells_ptr cells = std::move(loaded);
+    std::lock_guard<std::mutex> lock(_mutex);
+    insert_locked(key, cells);
+    return cells;
+}
+
+void ArtCache::store(const std::string& cache_directory, uint64_t key, const art_cells_ptr& cells)
+{
+    if (!cells)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        insert_locked(key, cells);
+    }
+    save_art_cells(art_cache_path(cache_directory, key, cells->width, cells->height), *cells);
+}
+
+void ArtCache::remember_track(const std::string& track_path, uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_track_keys.size() >= kMaxTracks && _track_keys.find(track_path) == _track_keys.end())
+    {
+        _track_keys.clear();
+    }
+    _track_keys[track_path] = key;
+}
+
+bool ArtCache::find_track(const std::string& track_path, uint64_t& key) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _track_keys.find(track_path);
+    if (it == _track_keys.end())
+    {
+        return false;
+    }
+    key = it->second;
+    return true;
+}
+
+void ArtCache::insert_locked(uint64_t key, const art_cells_ptr& cells)
+{
+    _entries.insert(make_slot(key, cells->width, cells->height), Entry{key, cells});
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lru_cache.h"
+
+// Album art already scaled to a grid of half-block cells. Colours are packed
+// RGBA8 with red in the low byte, matching Terminal::pack_colour.
+struct art_cells
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> top;
+    std::vector<uint32_t> bottom;
+    // Area averages of the top-left, top-right, bottom-left and
+    // bottom-right quarters of the image.
+    uint32_t quadrants[4] = {};
+};
+
+using art_cells_ptr = std::shared_ptr<const art_cells>;
+
+uint64_t hash_art_image(const std::vector<unsigned char>& image_data);
+uint64_t hash_art_album(const std::string& artist, const std::string& album);
+std::string art_cache_path(const std::string& cache_directory, uint64_t key, int width, int height);
+bool load_art_cells(const std::string& cache_path, art_cells& cells);
+bool save_art_cells(const std::string& cache_path, const art_cells& cells);
+
+// Scaled art keyed by (image or album hash, width, height), kept in memory
+// and mirrored to disk so a recently shown album never decodes again.
+class ArtCache
+{
+public:
+    static ArtCache& instance();
+
+    art_cells_ptr find(const std::string& cache_directory, uint64_t key, int width, int height);
+    art_cells_ptr find_in_memory(uint64_t key, int width, int height);
+    void store(const std::string& cache_directory, uint64_t key, const art_cells_ptr& cells);
+
+    void remember_track(const std::string& track_path, uint64_t key);
+    bool find_track(const std::string& track_path, uint64_t& key) const;
+
+    ArtCache(const ArtCache&) = delete;
+    ArtCache& operator=(const ArtCache&) = delete;
+
+private:
+    ArtCache() = default;
+
+    struct Entry
+    {
+        uint64_t key = 0;
+        art_cells_ptr cells;
+    };
+
+    static uint64_t make_slot(uint64_t key, int width, int height);
+    void insert_locked(uint64_t key, const art_cells_ptr& cells);
+
+    static constexpr size_t kMaxEntries = 64;
+    static constexpr size_t kMaxTracks = 4096;
+
+    mutable std::mutex _mutex;
+    wynott::lru_cache<uint64_t, Entry> _entries{kMaxEntries};
+    std::unordered_map<std::string, uint64_t> _track_keys;
+};
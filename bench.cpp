@@ -0,0 +1,1098 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "alloc_stats.h"
+#include "app.h"
+#include "composite.h"
+#include "config.h"
+#include "draw.h"
+#include "event.h"
+#include "library.h"
+#include "metadata.h"
+#include "particles.h"
+#include "profiler.h"
+#include "scrubber.h"
+#include "spectrum_analyzer.h"
+#include "terminal.h"
+
+struct bench_size
+{
+    int width;
+    int height;
+};
+
+static const bench_size kTerminalSizes[] = {{80, 24}, {200, 60}, {500, 150}};
+
+static int open_null_output()
+{
+#if defined(_WIN32)
+    return _open("NUL", _O_WRONLY);
+#else
+    return open("/dev/null", O_WRONLY);
+#endif
+}
+
+static void close_output(int fd)
+{
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+static std::vector<Terminal::Character> build_gradient(const glm::ivec2& size)
+{
+    std::vector<Terminal::Character> cells(static_cast<size_t>(size.x * size.y));
+    for (int y = 0; y < size.y; ++y)
+    {
+        for (int x = 0; x < size.x; ++x)
+        {
+            float u = static_cast<float>(x) / static_cast<float>(std::max(1, size.x - 1));
+            float v = static_cast<float>(y) / static_cast<float>(std::max(1, size.y - 1));
+            Terminal::Character& cell = cells[static_cast<size_t>(y * size.x + x)];
+            cell.set_background_colour(glm::vec4(u * 0.3f, v * 0.2f, 0.25f, 1.0f));
+        }
+    }
+    return cells;
+}
+
+// Redraws every cell of the buffer layer with a new glyph and colour each
+// frame, the worst case for the compositor and the emitter.
+int run_terminal_benchmark()
+{
+    using clock = std::chrono::steady_clock;
+
+    int null_fd = open_null_output();
+    if (null_fd < 0)
+    {
+        std::fprintf(stderr, "bench-terminal: cannot open null device\n");
+        return 1;
+    }
+
+    std::printf("%-10s %8s %10s %12s %10s %14s\n", "size", "frames", "draw ms", "composite ms", "emit ms", "bytes/frame");
+    for (const bench_size& bench : kTerminalSizes)
+    {
+        glm::ivec2 size(bench.width, bench.height);
+        Terminal terminal;
+        terminal.set_fixed_size(size);
+        terminal.set_output_fd(null_fd);
+        terminal.set_canvas(build_gradient(size));
+        terminal.update();
+
+        int cells = size.x * size.y;
+        int frames = std::max(20, 4000000 / cells);
+        size_t bytes_before = terminal.get_frame_stats().total_bytes;
+        double draw_ms = 0.0;
+        double composite_ms = 0.0;
+        double emit_ms = 0.0;
+        for (int frame = 0; frame < frames; ++frame)
+        {
+            auto draw_start = clock::now();
+            for (int y = 0; y < size.y; ++y)
+            {
+                for (int x = 0; x < size.x; ++x)
+                {
+                    char32_t glyph = static_cast<char32_t>(U'a' + (x + y + frame) % 26);
+                    float shade = static_cast<float>((x + frame) % 8) / 8.0f;
+                    terminal.set_glyph(glm::ivec2(x, y), glyph, glm::vec4(shade, 0.8f, 0.5f, 1.0f), glm::vec4(0.0f));
+                }
+            }
+            terminal.select_region(glm::ivec2(0, frame % size.y), glm::ivec2(size.x, 1));
+            auto composite_start = clock::now();
+            terminal.eightbitify();
+            auto emit_start = clock::now();
+            terminal.update_eightbit();
+            auto emit_end = clock::now();
+            draw_ms += std::chrono::duration<double, std::milli>(composite_start - draw_start).count();
+            composite_ms += std::chrono::duration<double, std::milli>(emit_start - composite_start).count();
+            emit_ms += std::chrono::duration<double, std::milli>(emit_end - emit_start).count();
+        }
+        size_t bytes = terminal.get_frame_stats().total_bytes - bytes_before;
+
+        char label[32];
+        std::snprintf(label, sizeof(label), "%dx%d", size.x, size.y);
+        std::printf(
+            "%-10s %8d %10.3f %12.3f %10.3f %14.0f\n",
+            label,
+            frames,
+            draw_ms / static_cast<double>(frames),
+            composite_ms / static_cast<double>(frames),
+            emit_ms / static_cast<double>(frames),
+            static_cast<double>(bytes) / static_cast<double>(frames));
+    }
+
+    close_output(null_fd);
+    return 0;
+}
+
+struct bench_layers
+{
+    std::vector<char32_t> glyphs[kCompositeLayerCount];
+    std::vector<uint32_t> foregrounds[kCompositeLayerCount];
+    std::vector<uint32_t> backgrounds[kCompositeLayerCount];
+};
+
+// Opaque wallpaper under a sparse logo, a half-filled buffer with some
+// translucent backgrounds and a scattering of particles.
+static void fill_bench_layers(bench_layers& layers, size_t cells)
+{
+    static const float kCoverage[kCompositeLayerCount] = {1.0f, 0.1f, 0.5f, 0.05f};
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for (size_t layer = 0; layer < kCompositeLayerCount; ++layer)
+    {
+        layers.glyphs[layer].assign(cells, U' ');
+        layers.foregrounds[layer].assign(cells, 0);
+        layers.backgrounds[layer].assign(cells, 0);
+        for (size_t i = 0; i < cells; ++i)
+        {
+            if (unit(rng) >= kCoverage[layer])
+            {
+                continue;
+            }
+            float alpha = (layer == 0 || unit(rng) < 0.5f) ? 1.0f : unit(rng);
+            layers.glyphs[layer][i] = static_cast<char32_t>(U'a' + rng() % 26);
+            layers.foregrounds[layer][i] = Terminal::pack_colour(glm::vec4(unit(rng), unit(rng), unit(rng), 1.0f));
+            layers.backgrounds[layer][i] = Terminal::pack_colour(glm::vec4(unit(rng), unit(rng), unit(rng), alpha));
+        }
+    }
+}
+
+// Composites every cell per frame in the same 64-cell blocks eightbitify()
+// uses, for each kernel this CPU supports, and checks them against scalar.
+int run_composite_benchmark()
+{
+    using clock = std::chrono::steady_clock;
+    static const composite_isa kIsas[] = {composite_isa::scalar, composite_isa::sse2, composite_isa::avx2};
+    constexpr size_t kBlock = 64;
+
+    std::printf("dispatch selects %s\n", get_composite_isa_name(detect_composite_isa()));
+    std::printf("%-10s %-8s %10s %10s %9s\n", "size", "kernel", "ms/frame", "ns/cell", "speedup");
+
+    int result = 0;
+    for (const bench_size& bench : kTerminalSizes)
+    {
+        size_t cells = static_cast<size_t>(bench.width * bench.height);
+        bench_layers layers;
+        fill_bench_layers(layers, cells);
+
+        composite_planes planes;
+        for (size_t layer = 0; layer < kCompositeLayerCount; ++layer)
+        {
+            planes.glyphs[layer] = layers.glyphs[layer].data();
+            planes.foregrounds[layer] = layers.foregrounds[layer].data();
+            planes.backgrounds[layer] = layers.backgrounds[layer].data();
+        }
+
+        std::vector<char32_t> reference_glyphs(cells);
+        std::vector<uint32_t> reference_foregrounds(cells);
+        std::vector<uint32_t> reference_backgrounds(cells);
+        get_composite_kernel(composite_isa::scalar)(
+            planes, 0, cells, reference_glyphs.data(), reference_foregrounds.data(), reference_backgrounds.data());
+
+        int frames = std::max(50, static_cast<int>(20000000 / cells));
+        double scalar_ms = 0.0;
+        for (composite_isa isa : kIsas)
+        {
+            if (!is_composite_isa_supported(isa))
+            {
+                continue;
+            }
+
+            composite_kernel kernel = get_composite_kernel(isa);
+            std::vector<char32_t> glyphs(cells);
+            std::vector<uint32_t> foregrounds(cells);
+            std::vector<uint32_t> backgrounds(cells);
+            auto start = clock::now();
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                for (size_t begin = 0; begin < cells; begin += kBlock)
+                {
+                    size_t count = std::min(kBlock, cells - begin);
+                    kernel(planes, begin, count, &glyphs[begin], &foregrounds[begin], &backgrounds[begin]);
+                }
+            }
+            double frame_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count() / frames;
+            if (isa == composite_isa::scalar)
+            {
+                scalar_ms = frame_ms;
+            }
+
+            bool matches = glyphs == reference_glyphs
+                && foregrounds == reference_foregrounds
+                && backgrounds == reference_backgrounds;
+            if (!matches)
+            {
+                result = 1;
+            }
+
+            char label[32];
+            std::snprintf(label, sizeof(label), "%dx%d", bench.width, bench.height);
+            std::printf(
+                "%-10s %-8s %10.4f %10.3f %8.2fx%s\n",
+                label,
+                get_composite_isa_name(isa),
+                frame_ms,
+                frame_ms * 1.0e6 / static_cast<double>(cells),
+                scalar_ms / frame_ms,
+                matches ? "" : "  MISMATCH");
+        }
+    }
+
+    return result;
+}
+
+// Producer threads post to an ordered and a coalesced topic while this
+// thread drains the queue, as the UI loop does once per frame.
+static int run_deferred_event_benchmark(EventBus& bus)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr int kProducers = 4;
+    constexpr int kPostsPerProducer = 250000;
+
+    Topic<int> ordered = bus.register_topic<int>("bench.deferred");
+    Topic<int> coalesced = bus.register_topic<int>("bench.coalesced", topic_delivery::coalesce);
+
+    int64_t ordered_received = 0;
+    int64_t coalesced_received = 0;
+    int ordered_id = bus.subscribe(ordered, [&ordered_received](int) { ++ordered_received; });
+    int coalesced_id = bus.subscribe(coalesced, [&coalesced_received](int) { ++coalesced_received; });
+
+    std::atomic<int> running{kProducers};
+    std::vector<std::thread> producers;
+    auto start = clock::now();
+    for (int producer = 0; producer < kProducers; ++producer)
+    {
+        producers.emplace_back(
+            [&bus, &running, ordered, coalesced]()
+            {
+                for (int i = 0; i < kPostsPerProducer; ++i)
+                {
+                    bus.post(ordered, i);
+                    bus.post(coalesced, i);
+                }
+                running.fetch_sub(1, std::memory_order_release);
+            });
+    }
+
+    int64_t dispatches = 0;
+    while (running.load(std::memory_order_acquire) > 0)
+    {
+        bus.dispatch_deferred();
+        ++dispatches;
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    bus.dispatch_deferred();
+    ++dispatches;
+    double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+    bus.unsubscribe(ordered_id);
+    bus.unsubscribe(coalesced_id);
+
+    int64_t posted = static_cast<int64_t>(kProducers) * kPostsPerProducer;
+    bool ordered_ok = ordered_received == posted;
+    bool coalesced_ok = coalesced_received > 0 && coalesced_received <= dispatches;
+    std::printf(
+        "deferred: %d producers, %.1f ns/post, %lld of %lld ordered delivered, %lld of %lld coalesced delivered over %lld dispatches%s\n",
+        kProducers,
+        elapsed_ns / static_cast<double>(posted * 2),
+        static_cast<long long>(ordered_received),
+        static_cast<long long>(posted),
+        static_cast<long long>(coalesced_received),
+        static_cast<long long>(posted),
+        static_cast<long long>(dispatches),
+        (ordered_ok && coalesced_ok) ? "" : "  MISMATCH");
+    return (ordered_ok && coalesced_ok) ? 0 : 1;
+}
+
+// Publishes a typed payload to a topic with a growing number of
+// subscribers and reports the sustained publish rate.
+int run_event_benchmark()
+{
+    using clock = std::chrono::steady_clock;
+    static const int kSubscriberCounts[] = {0, 1, 4, 16};
+    constexpr int kPublishes = 2000000;
+
+    EventBus& bus = EventBus::instance();
+    Topic<particle_emit_event> topic = bus.register_topic<particle_emit_event>("bench.publish");
+
+    std::printf("%-12s %12s %14s\n", "subscribers", "ns/publish", "publishes/s");
+
+    int64_t received = 0;
+    std::vector<int> subscriptions;
+    for (int count : kSubscriberCounts)
+    {
+        while (static_cast<int>(subscriptions.size()) < count)
+        {
+            subscriptions.push_back(bus.subscribe(
+                topic,
+                [&received](const particle_emit_event& event)
+                {
+                    received += event.x;
+                }));
+        }
+
+        received = 0;
+        auto start = clock::now();
+        for (int i = 0; i < kPublishes; ++i)
+        {
+            bus.publish(topic, particle_emit_event{1, i, 0.5f});
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if (received != static_cast<int64_t>(kPublishes) * count)
+        {
+            std::printf("subscriber count mismatch: %lld\n", static_cast<long long>(received));
+            return 1;
+        }
+
+        double ns = elapsed_ns / kPublishes;
+        std::printf("%-12d %12.1f %14.0f\n", count, ns, 1.0e9 / ns);
+    }
+
+    for (int id : subscriptions)
+    {
+        bus.unsubscribe(id);
+    }
+
+    return run_deferred_event_benchmark(bus);
+}
+
+struct render_result
+{
+    bench_size size;
+    int frames = 0;
+    double metadata_ns = 0.0;
+    double scrubber_ns = 0.0;
+    double analyzer_ns = 0.0;
+    double particles_ns = 0.0;
+    double composite_ns = 0.0;
+    double emit_ns = 0.0;
+    double bytes = 0.0;
+    double allocations = 0.0;
+    double allocated_bytes = 0.0;
+
+    double total_ns() const
+    {
+        return metadata_ns + scrubber_ns + analyzer_ns + particles_ns + composite_ns + emit_ns;
+    }
+};
+
+// A second of stereo audio made of three sweeping tones, loud enough that the
+// analyzer's bars cross the particle threshold.
+static std::vector<float> build_bench_audio(int sample_rate)
+{
+    std::vector<float> samples(static_cast<size_t>(sample_rate) * 2);
+    const float two_pi = 6.28318530718f;
+    float phases[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < sample_rate; ++i)
+    {
+        float t = static_cast<float>(i) / static_cast<float>(sample_rate);
+        float frequencies[3] = {
+            60.0f + 200.0f * t,
+            400.0f + 3000.0f * t,
+            12000.0f - 8000.0f * t,
+        };
+        float value = 0.0f;
+        for (int tone = 0; tone < 3; ++tone)
+        {
+            phases[tone] += two_pi * frequencies[tone] / static_cast<float>(sample_rate);
+            value += 0.3f * std::sin(phases[tone]);
+        }
+        samples[static_cast<size_t>(i) * 2] = value;
+        samples[static_cast<size_t>(i) * 2 + 1] = value;
+    }
+    return samples;
+}
+
+// The modules the main loop draws every frame, laid out for one terminal
+// size and fed a looping test tone.
+struct render_scene
+{
+    static constexpr int kSampleRate = 44100;
+    static constexpr int kTotalMs = 180000;
+
+    app_config config;
+    SpectrumAnalyzer analyzer;
+    Scrubber scrubber;
+    ParticleSystem particles;
+    MetadataPanel metadata_panel;
+    track_metadata_ptr metadata;
+    std::vector<float> audio;
+    size_t audio_cursor = 0;
+    int frame = 0;
+};
+
+static void setup_render_scene(render_scene& scene, Terminal& terminal, const app_config& config, const bench_size& bench)
+{
+    glm::ivec2 size(bench.width, bench.height);
+    terminal.set_fixed_size(size);
+    terminal.set_canvas(build_gradient(size));
+    terminal.mark_all_dirty();
+    terminal.update();
+
+    // Spectrum and metadata share the top third, the scrubber fills the
+    // rest, all inset by a column so the boxes fit.
+    app_config& layout = scene.config;
+    layout = config;
+    int top_height = std::max(4, size.y / 3);
+    int spectrum_width = std::max(1, (size.x - 3) * 2 / 3);
+    layout.spectrum_origin_x = 1;
+    layout.spectrum_origin_y = 1;
+    layout.spectrum_width = spectrum_width;
+    layout.spectrum_height = top_height;
+    layout.metadata_origin_x = spectrum_width + 2;
+    layout.metadata_origin_y = 1;
+    layout.metadata_width = std::max(1, size.x - spectrum_width - 3);
+    layout.metadata_height = top_height;
+    layout.scrubber_origin_x = 1;
+    layout.scrubber_origin_y = top_height + 2;
+    layout.scrubber_width = std::max(1, size.x - 2);
+    layout.scrubber_height = std::max(4, size.y - top_height - 3);
+
+    scene.analyzer.set_location(glm::ivec2(layout.spectrum_origin_x, layout.spectrum_origin_y));
+    scene.analyzer.set_size(glm::ivec2(layout.spectrum_width, layout.spectrum_height));
+    scene.analyzer.set_fft_size(layout.spectrum_fft_size);
+
+    scene.metadata_panel.set_location(glm::ivec2(layout.metadata_origin_x, layout.metadata_origin_y));
+    scene.metadata_panel.set_size(glm::ivec2(layout.metadata_width, layout.metadata_height));
+    auto metadata = std::make_shared<track_metadata>();
+    metadata->title = "A Track Title Long Enough That The Panel Has To Cut It Short";
+    metadata->artist = "Some Artist With A Fairly Long Name";
+    metadata->album = "An Album Whose Name Also Runs Past The Edge Of The Panel";
+    metadata->date = "2024";
+    metadata->genre = "Electronic";
+    metadata->track = "7";
+    metadata->sample_rate = 44100;
+    metadata->channels = 2;
+    metadata->duration_ms = render_scene::kTotalMs;
+    metadata->file_size_bytes = 7340032;
+    metadata->bitrate_kbps = 320;
+    scene.metadata = metadata;
+
+    scene.scrubber.set_location(glm::ivec2(layout.scrubber_origin_x, layout.scrubber_origin_y));
+    scene.scrubber.set_size(glm::ivec2(layout.scrubber_width, layout.scrubber_height));
+    std::vector<float> waveform(static_cast<size_t>(std::max(1, layout.scrubber_width - 2)));
+    for (size_t i = 0; i < waveform.size(); ++i)
+    {
+        waveform[i] = 0.5f + 0.45f * std::sin(static_cast<float>(i) * 0.21f);
+    }
+    scene.scrubber.set_waveform(waveform);
+
+    scene.particles.set_angle_bias(layout.particle_angle_bias);
+    scene.audio = build_bench_audio(render_scene::kSampleRate);
+}
+
+// One pass of the main loop's per-frame work, each stage in the profile
+// zone the app uses for it. Adds stage times and allocations to `result`.
+static void run_render_frame(render_scene& scene, Terminal& terminal, render_result& result)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr float kFrameSeconds = 1.0f / 60.0f;
+    const int samples_per_frame = render_scene::kSampleRate / 60;
+
+    // The audio thread feeds the analyzer in the app, so this stays
+    // outside the measured region.
+    if (scene.audio_cursor + static_cast<size_t>(samples_per_frame) * 2 > scene.audio.size())
+    {
+        scene.audio_cursor = 0;
+    }
+    scene.analyzer.push_samples(&scene.audio[scene.audio_cursor], samples_per_frame, 2);
+    scene.audio_cursor += static_cast<size_t>(samples_per_frame) * 2;
+
+    int elapsed_ms = (scene.frame * 16) % render_scene::kTotalMs;
+    ++scene.frame;
+
+    alloc_counts allocs_before = get_thread_alloc_counts();
+    auto metadata_start = clock::now();
+    {
+        ProfileScope scope(profile_zone::metadata);
+        scene.metadata_panel.draw(scene.config, scene.metadata);
+    }
+    auto scrubber_start = clock::now();
+    {
+        ProfileScope scope(profile_zone::scrubber);
+        scene.scrubber.set_progress(static_cast<float>(elapsed_ms) / static_cast<float>(render_scene::kTotalMs));
+        scene.scrubber.set_time_ms(elapsed_ms, render_scene::kTotalMs);
+        scene.scrubber.draw(scene.config);
+    }
+    auto analyzer_start = clock::now();
+    {
+        ProfileScope scope(profile_zone::analyzer_update);
+        scene.analyzer.update();
+    }
+    {
+        ProfileScope scope(profile_zone::analyzer_draw);
+        scene.analyzer.draw(scene.config);
+    }
+    auto particles_start = clock::now();
+    {
+        ProfileScope scope(profile_zone::particles);
+        scene.particles.update(kFrameSeconds);
+        scene.particles.draw(scene.config);
+    }
+    auto composite_start = clock::now();
+    terminal.eightbitify();
+    auto emit_start = clock::now();
+    terminal.update_eightbit();
+    auto emit_end = clock::now();
+    alloc_counts allocs_after = get_thread_alloc_counts();
+
+    result.metadata_ns += std::chrono::duration<double, std::nano>(scrubber_start - metadata_start).count();
+    result.scrubber_ns += std::chrono::duration<double, std::nano>(analyzer_start - scrubber_start).count();
+    result.analyzer_ns += std::chrono::duration<double, std::nano>(particles_start - analyzer_start).count();
+    result.particles_ns += std::chrono::duration<double, std::nano>(composite_start - particles_start).count();
+    result.composite_ns += std::chrono::duration<double, std::nano>(emit_start - composite_start).count();
+    result.emit_ns += std::chrono::duration<double, std::nano>(emit_end - emit_start).count();
+    result.allocations += static_cast<double>(allocs_after.allocations - allocs_before.allocations);
+    result.allocated_bytes += static_cast<double>(allocs_after.bytes - allocs_before.bytes);
+}
+
+static render_result run_render_size(Terminal& terminal, const app_config& config, const bench_size& bench, int frames)
+{
+    constexpr int kWarmupFrames = 60;
+
+    render_scene scene;
+    setup_render_scene(scene, terminal, config, bench);
+
+    render_result warmup;
+    for (int frame = 0; frame < kWarmupFrames; ++frame)
+    {
+        run_render_frame(scene, terminal, warmup);
+    }
+
+    render_result result;
+    size_t bytes_before = terminal.get_frame_stats().total_bytes;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        run_render_frame(scene, terminal, result);
+    }
+    result.size = bench;
+    result.frames = frames;
+    result.bytes = static_cast<double>(terminal.get_frame_stats().total_bytes - bytes_before);
+
+    const double count = static_cast<double>(frames);
+    result.metadata_ns /= count;
+    result.scrubber_ns /= count;
+    result.analyzer_ns /= count;
+    result.particles_ns /= count;
+    result.composite_ns /= count;
+    result.emit_ns /= count;
+    result.bytes /= count;
+    result.allocations /= count;
+    result.allocated_bytes /= count;
+    return result;
+}
+
+static void write_render_json(std::FILE* file, const std::vector<render_result>& results)
+{
+    std::fprintf(file, "{\n  \"benchmark\": \"render\",\n");
+    std::fprintf(file, "  \"composite_isa\": \"%s\",\n", get_composite_isa_name(detect_composite_isa()));
+    std::fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const render_result& result = results[i];
+        // Only the AllocTrack build counts allocations.
+        char allocations[32] = "null";
+        char allocated_bytes[32] = "null";
+        if (kAllocTracking)
+        {
+            std::snprintf(allocations, sizeof(allocations), "%.2f", result.allocations);
+            std::snprintf(allocated_bytes, sizeof(allocated_bytes), "%.1f", result.allocated_bytes);
+        }
+        std::fprintf(
+            file,
+            "    {\"width\": %d, \"height\": %d, \"frames\": %d, \"ns_per_frame\": %.0f, "
+            "\"stages_ns\": {\"metadata\": %.0f, \"scrubber\": %.0f, \"analyzer\": %.0f, \"particles\": %.0f, \"composite\": %.0f, \"emit\": %.0f}, "
+            "\"bytes_per_frame\": %.1f, \"allocations_per_frame\": %s, \"allocated_bytes_per_frame\": %s}%s\n",
+            result.size.width,
+            result.size.height,
+            result.frames,
+            result.total_ns(),
+            result.metadata_ns,
+            result.scrubber_ns,
+            result.analyzer_ns,
+            result.particles_ns,
+            result.composite_ns,
+            result.emit_ns,
+            result.bytes,
+            allocations,
+            allocated_bytes,
+            (i + 1 < results.size()) ? "," : "");
+    }
+    std::fprintf(file, "  ]\n}\n");
+}
+
+// agmp --bench-render [WxH ...] [--frames N] [--json path|-]
+// Runs the per-frame draw path of the main loop - metadata, scrubber,
+// spectrum analyzer, particles, composite and emit - against /dev/null.
+// Allocation counts read n/a outside the AllocTrack build.
+int run_render_benchmark(int argc, char** argv)
+{
+    std::vector<bench_size> sizes;
+    int frames = 600;
+    std::string json_path;
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bench_size size{};
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--json" && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (std::sscanf(arg.c_str(), "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0)
+        {
+            sizes.push_back(size);
+        }
+        else
+        {
+            std::fprintf(stderr, "bench-render: unknown argument '%s'\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (sizes.empty())
+    {
+        sizes.assign(std::begin(kTerminalSizes), std::end(kTerminalSizes));
+    }
+
+    int null_fd = open_null_output();
+    if (null_fd < 0)
+    {
+        std::fprintf(stderr, "bench-render: cannot open null device\n");
+        return 1;
+    }
+
+    app_config config = load_config("config.toml");
+    // Low enough that the bench tones keep a steady stream of particles.
+    config.spectrum_particle_threshold = 0.6f;
+
+    // The renderer binds to one terminal for the life of the process, so
+    // every size reuses it.
+    Terminal terminal;
+    terminal.set_output_fd(null_fd);
+    Renderer::init(terminal);
+
+    const bool json_to_stdout = json_path == "-";
+    if (!json_to_stdout)
+    {
+        std::printf(
+            "%-10s %7s %11s %10s %10s %10s %10s %10s %10s %12s %10s\n",
+            "size", "frames", "ns/frame", "metadata", "scrubber", "analyzer", "particles", "composite", "emit", "bytes/frame", "allocs");
+    }
+
+    std::vector<render_result> results;
+    for (const bench_size& bench : sizes)
+    {
+        render_result result = run_render_size(terminal, config, bench, frames);
+        results.push_back(result);
+        if (json_to_stdout)
+        {
+            continue;
+        }
+
+        char label[32];
+        std::snprintf(label, sizeof(label), "%dx%d", bench.width, bench.height);
+        std::printf(
+            "%-10s %7d %11.0f %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %12.0f",
+            label,
+            result.frames,
+            result.total_ns(),
+            result.metadata_ns,
+            result.scrubber_ns,
+            result.analyzer_ns,
+            result.particles_ns,
+            result.composite_ns,
+            result.emit_ns,
+            result.bytes);
+        if (kAllocTracking)
+        {
+            std::printf(" %10.2f\n", result.allocations);
+        }
+        else
+        {
+            std::printf(" %10s\n", "n/a");
+        }
+    }
+    close_output(null_fd);
+
+    if (json_to_stdout)
+    {
+        write_render_json(stdout, results);
+    }
+    else if (!json_path.empty())
+    {
+        std::FILE* file = std::fopen(json_path.c_str(), "w");
+        if (!file)
+        {
+            std::fprintf(stderr, "bench-render: cannot write %s\n", json_path.c_str());
+            return 1;
+        }
+        write_render_json(file, results);
+        std::fclose(file);
+    }
+    return 0;
+}
+
+// A second of the bench tone as a 16-bit WAV, so the app has a real track
+// to look metadata up for.
+static bool write_check_track(const std::string& path, const std::vector<float>& audio, int sample_rate)
+{
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+
+    auto put_u16 = [file](uint16_t value)
+    {
+        unsigned char bytes[2] = {static_cast<unsigned char>(value), static_cast<unsigned char>(value >> 8)};
+        std::fwrite(bytes, 1, 2, file);
+    };
+    auto put_u32 = [&put_u16](uint32_t value)
+    {
+        put_u16(static_cast<uint16_t>(value));
+        put_u16(static_cast<uint16_t>(value >> 16));
+    };
+
+    const uint32_t data_bytes = static_cast<uint32_t>(audio.size() * 2);
+    std::fwrite("RIFF", 1, 4, file);
+    put_u32(36 + data_bytes);
+    std::fwrite("WAVEfmt ", 1, 8, file);
+    put_u32(16);
+    put_u16(1);
+    put_u16(2);
+    put_u32(static_cast<uint32_t>(sample_rate));
+    put_u32(static_cast<uint32_t>(sample_rate) * 4);
+    put_u16(4);
+    put_u16(16);
+    std::fwrite("data", 1, 4, file);
+    put_u32(data_bytes);
+    for (float sample : audio)
+    {
+        float clamped = std::max(-1.0f, std::min(1.0f, sample));
+        put_u16(static_cast<uint16_t>(static_cast<int16_t>(clamped * 32767.0f)));
+    }
+    return std::fclose(file) == 0;
+}
+
+// Key presses reach the app through a pipe on stdin, so the event loop,
+// input_poll_key and handle_key run as they do for a terminal.
+static int open_check_keys()
+{
+#if defined(_WIN32)
+    return -1;
+#else
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    return fds[1];
+#endif
+}
+
+static void send_check_key(int fd, char key)
+{
+#if !defined(_WIN32)
+    if (write(fd, &key, 1) != 1)
+    {
+        std::fprintf(stderr, "check-allocs: key pipe is full\n");
+    }
+#else
+    (void)fd;
+    (void)key;
+#endif
+}
+
+// agmp --check-allocs [WxH] [--frames N] [--sites N]
+// Fails when a steady-state frame of the main loop touches the heap, split by
+// profile zone with the call sites responsible. Needs the AllocTrack build.
+int run_alloc_check(int argc, char** argv)
+{
+    constexpr int kWarmupFrames = 120;
+    constexpr int kSampleRate = 44100;
+    constexpr int kKeyInterval = 30;
+
+    bench_size bench{200, 60};
+    int frames = 600;
+    size_t max_sites = 10;
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bench_size size{};
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--sites" && i + 1 < argc)
+        {
+            max_sites = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (std::sscanf(arg.c_str(), "%dx%d", &size.width, &size.height) == 2 && size.width > 0 && size.height > 0)
+        {
+            bench = size;
+        }
+        else
+        {
+            std::fprintf(stderr, "check-allocs: unknown argument '%s'\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    if (!kAllocTracking)
+    {
+        std::fprintf(stderr, "check-allocs: allocations are only counted by the AllocTrack build\n");
+        return 1;
+    }
+
+    int null_fd = open_null_output();
+    if (null_fd < 0)
+    {
+        std::fprintf(stderr, "check-allocs: cannot open null device\n");
+        return 1;
+    }
+
+    std::vector<float> audio = build_bench_audio(kSampleRate);
+    std::error_code error;
+    std::string track_path = (std::filesystem::temp_directory_path(error) / "agmp_check_allocs.wav").string();
+    if (error || !write_check_track(track_path, audio, kSampleRate))
+    {
+        std::fprintf(stderr, "check-allocs: cannot write %s\n", track_path.c_str());
+        close_output(null_fd);
+        return 1;
+    }
+    int key_fd = open_check_keys();
+
+    app_config config = load_config("config.toml");
+    config.safe_mode = false;
+    config.spectrum_particle_threshold = 0.6f;
+
+    // The whole main-loop frame runs, with the profiler overlay up and no
+    // wait between frames; the analyzer is fed the way the audio thread
+    // feeds it, outside the counted region.
+    ActuallyGoodMP& app = ActuallyGoodMP::instance();
+    app.init_headless(config, null_fd, glm::ivec2(bench.width, bench.height), track_path);
+    Profiler::instance().set_enabled(true);
+    frame_state frame;
+    app.setup_frame(frame);
+    frame.frame_period = frame_state::clock::duration::zero();
+
+    const int samples_per_frame = kSampleRate / 60;
+    size_t audio_cursor = 0;
+    bool quit = false;
+    auto run_checked_frame = [&](int index, alloc_counts& counts)
+    {
+        if (audio_cursor + static_cast<size_t>(samples_per_frame) * 2 > audio.size())
+        {
+            audio_cursor = 0;
+        }
+        frame.analyzer.push_samples(&audio[audio_cursor], samples_per_frame, 2);
+        audio_cursor += static_cast<size_t>(samples_per_frame) * 2;
+        if (key_fd >= 0 && index % kKeyInterval == 0)
+        {
+            // Digits seek, which does nothing without an audio device.
+            send_check_key(key_fd, static_cast<char>('0' + (index / kKeyInterval) % 10));
+        }
+
+        alloc_counts before = get_thread_alloc_counts();
+        quit = quit || app.run_frame(frame);
+        alloc_counts after = get_thread_alloc_counts();
+        counts.allocations += after.allocations - before.allocations;
+        counts.bytes += after.bytes - before.bytes;
+    };
+
+    alloc_counts warmup{};
+    for (int index = 0; index < kWarmupFrames; ++index)
+    {
+        run_checked_frame(index, warmup);
+    }
+
+    clear_alloc_sites();
+    set_thread_alloc_sites(true);
+    alloc_counts zones_before[kAllocZoneCount];
+    for (size_t zone = 0; zone < kAllocZoneCount; ++zone)
+    {
+        zones_before[zone] = get_thread_zone_alloc_counts(static_cast<uint8_t>(zone));
+    }
+    alloc_counts total{};
+    for (int index = 0; index < frames; ++index)
+    {
+        run_checked_frame(kWarmupFrames + index, total);
+    }
+    alloc_counts zones_after[kAllocZoneCount];
+    for (size_t zone = 0; zone < kAllocZoneCount; ++zone)
+    {
+        zones_after[zone] = get_thread_zone_alloc_counts(static_cast<uint8_t>(zone));
+    }
+    set_thread_alloc_sites(false);
+    Profiler::instance().set_enabled(false);
+    close_output(null_fd);
+    std::filesystem::remove(track_path, error);
+
+    if (quit)
+    {
+        std::fprintf(stderr, "check-allocs: a checked key quit the app\n");
+        return 1;
+    }
+
+    const double count = static_cast<double>(frames);
+    std::printf("%dx%d, %d frames after %d warm-up frames\n", bench.width, bench.height, frames, kWarmupFrames);
+    std::printf("%-18s %14s %14s\n", "zone", "allocs/frame", "bytes/frame");
+    for (size_t zone = 0; zone < kAllocZoneCount; ++zone)
+    {
+        uint64_t allocations = zones_after[zone].allocations - zones_before[zone].allocations;
+        uint64_t bytes = zones_after[zone].bytes - zones_before[zone].bytes;
+        if (allocations == 0)
+        {
+            continue;
+        }
+        std::printf(
+            "%-18s %14.2f %14.1f\n",
+            get_alloc_zone_name(static_cast<uint8_t>(zone)),
+            static_cast<double>(allocations) / count,
+            static_cast<double>(bytes) / count);
+    }
+    std::printf(
+        "%-18s %14.2f %14.1f\n",
+        "total",
+        static_cast<double>(total.allocations) / count,
+        static_cast<double>(total.bytes) / count);
+
+    if (total.allocations > 0)
+    {
+        if (max_sites > 0)
+        {
+            report_alloc_sites(stdout, max_sites, get_alloc_zone_name);
+        }
+        std::printf("FAIL: the steady-state frame allocates\n");
+        return 1;
+    }
+    std::printf("ok: no allocations\n");
+    return 0;
+}
+
+// agmp --check-library
+// Rescans a small generated tree whose directory links loop back on
+// themselves, serially and on the worker pool, and fails unless each track
+// is queued for a tag read exactly once.
+int run_library_check()
+{
+    namespace fs = std::filesystem;
+    constexpr size_t kExpectedTracks = 4;
+
+    std::error_code error;
+    fs::path base = fs::temp_directory_path(error) / "agmp_check_library";
+    fs::remove_all(base, error);
+    fs::path root = base / "library";
+    fs::path album = root / "artist" / "album";
+    fs::path outside = base / "outside";
+    fs::create_directories(album, error);
+    fs::create_directories(outside, error);
+    for (const fs::path& track : {album / "1.mp3", album / "2.mp3", album / "3.mp3", outside / "4.mp3"})
+    {
+        std::FILE* file = std::fopen(track.string().c_str(), "wb");
+        if (file)
+        {
+            std::fputs("not really an mp3", file);
+            std::fclose(file);
+        }
+    }
+
+    // Back to the root, up past it, into the album again, out to a sibling
+    // that links to itself.
+    fs::create_directory_symlink(root, album / "root", error);
+    if (!error)
+    {
+        fs::create_directory_symlink(base, album / "base", error);
+    }
+    if (!error)
+    {
+        fs::create_directory_symlink(album, root / "album", error);
+    }
+    if (!error)
+    {
+        fs::create_directory_symlink(outside, root / "outside", error);
+    }
+    if (!error)
+    {
+        fs::create_directory_symlink(outside, outside / "self", error);
+    }
+    if (error)
+    {
+        std::fprintf(stderr, "check-library: cannot create directory links: %s\n", error.message().c_str());
+        fs::remove_all(base, error);
+        return 1;
+    }
+
+    EventBus& bus = EventBus::instance();
+    bus.set_dispatch_thread();
+    library_scan_progress last;
+    int subscription = bus.subscribe(topics::library_scan, [&last](const library_scan_progress& progress)
+    {
+        last = progress;
+    });
+
+    LibraryIndex& index = LibraryIndex::instance();
+    bool ok = true;
+    for (int threads : {1, 4})
+    {
+        index.set_scan_threads(threads);
+        auto start = std::chrono::steady_clock::now();
+        index.rescan(root.string());
+        bus.dispatch_deferred();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        bool passed = index.get_track_count() == kExpectedTracks && last.tracks_queued == kExpectedTracks;
+        std::printf(
+            "%d thread%s: %zu tracks, %zu queued, %zu directories, %.1f ms%s\n",
+            threads,
+            threads == 1 ? "" : "s",
+            index.get_track_count(),
+            last.tracks_queued,
+            last.directories,
+            ms,
+            passed ? "" : "  FAIL");
+        ok = ok && passed;
+
+        // Start the next pass from an empty index.
+        index.rescan((base / "missing").string());
+    }
+
+    bus.unsubscribe(subscription);
+    fs::remove_all(base, error);
+    std::printf(ok ? "ok: every track read once\n" : "FAIL: the walk repeats or misses tracks\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+int run_terminal_benchmark();
+int run_composite_benchmark();
+int run_event_benchmark();
+int run_render_benchmark(int argc, char** argv);
+int run_alloc_check(int argc, char** argv);
+int run_library_check();
@@ -1,6 +1,7 @@
 #include "browser.h"
 
 #include <algorithm>
+#include <chrono>
 #include <filesystem>
 
 #include <glm/vec4.hpp>
@@ -10,24 +11,237 @@
 #include "draw.h"
 #include "event.h"
 #include "input.h"
+#include "library.h"
+#include "lru_cache.h"
 #include "player.h"
 #include "spdlog/spdlog.h"
 
-Browser::Browser() = default;
+namespace
+{
+    struct directory_listing
+    {
+        std::vector<std::filesystem::path> folders;
+        std::vector<std::filesystem::path> tracks;
+    };
+
+    std::filesystem::file_time_type directory_modified(const std::filesystem::path& directory)
+    {
+        std::error_code error;
+        auto modified = std::filesystem::last_write_time(directory, error);
+        return error ? std::filesystem::file_time_type{} : modified;
+    }
+
+    // Recently visited directories, shared by every browser and only
+    // touched on the UI thread. A hit is served as is; once an entry is a few
+    // seconds old the hit also queues a stat on a worker, and the entry is
+    // dropped if the directory has changed since it was listed.
+    class ListingCache
+    {
+    public:
+        static ListingCache& instance()
+        {
+            static ListingCache cache;
+            return cache;
+        }
+
+        ~ListingCache()
+        {
+            EventBus::instance().unsubscribe(_checked_subscription);
+        }
+
+        const directory_listing* find(const std::filesystem::path& directory)
+        {
+            Entry* entry = _entries.find(directory.string());
+            if (!entry)
+            {
+                return nullptr;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (!entry->rechecking && now - entry->checked >= kRecheckAfter)
+            {
+                entry->rechecking = true;
+                TaskScheduler::instance().submit(
+                    task_priority::low,
+                    [directory](const TaskToken&)
+                {
+                    EventBus::instance().post(
+                        topics::directory_checked,
+                        directory_stamp{directory, directory_modified(directory)});
+                });
+            }
+            return &entry->listing;
+        }
+
+        void store(
+            const std::filesystem::path& directory,
+            std::filesystem::file_time_type modified,
+            directory_listing listing)
+        {
+            _entries.insert(directory.string(), Entry{modified, std::chrono::steady_clock::now(), false, std::move(listing)});
+        }
+
+        void invalidate(const std::filesystem::path& directory)
+        {
+            _entries.erase(directory.string());
+        }
+
+    private:
+        ListingCache()
+        {
+            _checked_subscription = EventBus::instance().subscribe(
+                topics::directory_checked,
+                [this](const directory_stamp& stamp)
+                {
+                    receive_stamp(stamp);
+                });
+        }
+
+        void receive_stamp(const directory_stamp& stamp)
+        {
+            std::string key = stamp.directory.string();
+            Entry* entry = _entries.find(key);
+            if (!entry)
+            {
+                return;
+            }
+            if (stamp.modified != entry->modified)
+            {
+                _entries.erase(key);
+                return;
+            }
+            entry->checked = std::chrono::steady_clock::now();
+            entry->rechecking = false;
+        }
+
+        struct Entry
+        {
+            std::filesystem::file_time_type modified{};
+            std::chrono::steady_clock::time_point checked;
+            bool rechecking = false;
+            directory_listing listing;
+        };
+
+        static constexpr size_t kMaxEntries = 32;
+        static constexpr auto kRecheckAfter = std::chrono::seconds(5);
+
+        wynott::lru_cache<std::string, Entry> _entries{kMaxEntries};
+        int _checked_subscription = 0;
+    };
+}
+
+static constexpr size_t kScanBatchEntries = 64;
+static constexpr auto kScanBatchInterval = std::chrono::milliseconds(50);
+
+static bool is_mp3_path(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+    {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == ".mp3";
+}
+
+// Runs on a worker thread. Entries are posted back in batches so a large or
+// slow directory fills the browser progressively.
+static void scan_directory(
+    const Browser* owner,
+    const std::filesystem::path& directory,
+    uint64_t generation,
+    const TaskToken& token)
+{
+    namespace fs = std::filesystem;
+    using clock = std::chrono::steady_clock;
+
+    directory_scan_batch batch;
+    batch.owner = owner;
+    batch.generation = generation;
+    auto last_post = clock::now();
+    // Stamped before listing so a change made mid-scan invalidates the entry.
+    auto modified = directory_modified(directory);
+
+    try
+    {
+        if (fs::exists(directory) && fs::is_directory(directory))
+        {
+            for (const auto& entry : fs::directory_iterator(directory))
+            {
+                if (token.is_cancelled())
+                {
+                    return;
+                }
+
+                if (entry.is_directory())
+                {
+                    batch.folders.push_back(entry.path());
+                }
+                else if (entry.is_regular_file() && is_mp3_path(entry.path()))
+                {
+                    batch.tracks.push_back(entry.path());
+                }
+
+                size_t pending = batch.folders.size() + batch.tracks.size();
+                if (pending >= kScanBatchEntries
+                    || (pending > 0 && clock::now() - last_post >= kScanBatchInterval))
+                {
+                    EventBus::instance().post(topics::directory_scan, batch);
+                    batch.folders.clear();
+                    batch.tracks.clear();
+                    last_post = clock::now();
+                }
+            }
+        }
+    }
+    catch (...)
+    {
+    }
+
+    if (token.is_cancelled())
+    {
+        return;
+    }
+
+    batch.complete = true;
+    batch.modified = modified;
+    EventBus::instance().post(topics::directory_scan, std::move(batch));
+}
+
+static bool item_name_less(const std::unique_ptr<BrowserItem>& a, const std::unique_ptr<BrowserItem>& b)
+{
+    return a->get_name() < b->get_name();
+}
+
+Browser::Browser()
+{
+    _scan_subscription = EventBus::instance().subscribe(
+        topics::directory_scan,
+        [this](const directory_scan_batch& batch)
+        {
+            receive_scan_batch(batch);
+        });
+}
 
 Browser::Browser(
     const std::string& name,
     const std::filesystem::path& path,
     const glm::ivec2& location,
     const glm::ivec2& size)
-    : _name(name),
-      _path(path)
+    : Browser()
 {
+    _name = name;
+    _path = path;
     ActuallyGoodModule::set_location(location);
     ActuallyGoodModule::set_size(size);
     refresh_contents();
 }
 
+Browser::~Browser()
+{
+    cancel_scan();
+    EventBus::instance().unsubscribe(_scan_subscription);
+}
+
 
 
 void Browser::set_name(const std::string& name)
@@ -130,34 +344,6 @@ void FolderItem::draw(
     }
 }
 
-void FolderItem::scan_and_populate(
-    const std::filesystem::path& directory,
-    Browser* owner,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    namespace fs = std::filesystem;
-    try
-    {
-        if (!fs::exists(directory) || !fs::is_directory(directory))
-        {
-            return;
-        }
-
-        for (const auto& entry : fs::directory_iterator(directory))
-        {
-            if (!entry.is_directory())
-            {
-                continue;
-            }
-            std::string name = entry.path().filename().string();
-            out.push_back(std::make_unique<FolderItem>(owner, name, entry.path()));
-        }
-    }
-    catch (...)
-    {
-    }
-}
-
 void FolderItem::on_select()
 {
 }
@@ -240,44 +426,6 @@ void Mp3Item::draw(
     }
 }
 
-void Mp3Item::scan_and_populate(
-    const std::filesystem::path& directory,
-    Browser* owner,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    namespace fs = std::filesystem;
-    try
-    {
-        if (!fs::exists(directory) || !fs::is_directory(directory))
-        {
-            return;
-        }
-
-        for (const auto& entry : fs::directory_iterator(directory))
-        {
-            if (!entry.is_regular_file())
-            {
-                continue;
-            }
-            fs::path path = entry.path();
-            std::string extension = path.extension().string();
-            std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
-            {
-                return static_cast<char>(std::tolower(c));
-            });
-            if (extension != ".mp3")
-            {
-                continue;
-            }
-            std::string name = path.filename().string();
-            out.push_back(std::make_unique<Mp3Item>(owner, name, path));
-        }
-    }
-    catch (...)
-    {
-    }
-}
-
 QueueItem::QueueItem(Browser* owner, const std::string& name, const std::filesystem::path& path)
     : BrowserItem(owner, name, path)
 {
@@ -289,10 +437,7 @@ void QueueItem::on_soft_select()
 
 void QueueItem::on_select()
 {
-    EventBus::instance().publish(Event{
-        "queue.enqueue",
-        get_path().string()
-    });
+    EventBus::instance().publish(topics::queue_enqueue, get_path().string());
 }
 
 glm::ivec2 QueueItem::get_size() const
@@ -340,14 +485,6 @@ void QueueItem::draw(const glm::ivec2& location, const glm::ivec2& size) const
     }
 }
 
-void QueueItem::scan_and_populate(
-    const std::filesystem::path&,
-    Browser*,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    (void)out;
-}
-
 Mp3PlayNowItem::Mp3PlayNowItem(Browser* owner, const std::string& name, const std::filesystem::path& path)
     : BrowserItem(owner, name, path)
 {
@@ -369,10 +506,7 @@ void PlayRestItem::on_soft_select()
 
 void PlayRestItem::on_select()
 {
-    EventBus::instance().publish(Event{
-        "queue.play_rest",
-        get_path().string()
-    });
+    EventBus::instance().publish(topics::queue_play_rest, get_path().string());
 }
 
 glm::ivec2 PlayRestItem::get_size() const
@@ -419,24 +553,13 @@ void PlayRestItem::draw(const glm::ivec2& location, const glm::ivec2& size) cons
     }
 }
 
-void PlayRestItem::scan_and_populate(
-    const std::filesystem::path&,
-    Browser*,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    (void)out;
-}
-
 void StopPlayItem::on_soft_select()
 {
 }
 
 void StopPlayItem::on_select()
 {
-    EventBus::instance().publish(Event{
-        "player.stop",
-        std::string()
-    });
+    EventBus::instance().publish(topics::player_stop);
 }
 
 glm::ivec2 StopPlayItem::get_size() const
@@ -483,24 +606,13 @@ void StopPlayItem::draw(const glm::ivec2& location, const glm::ivec2& size) cons
     }
 }
 
-void StopPlayItem::scan_and_populate(
-    const std::filesystem::path&,
-    Browser*,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    (void)out;
-}
-
 void Mp3PlayNowItem::on_soft_select()
 {
 }
 
 void Mp3PlayNowItem::on_select()
 {
-    EventBus::instance().publish(Event{
-        "browser.mp3_selected",
-        get_path().string()
-    });
+    EventBus::instance().publish(topics::mp3_selected, get_path().string());
 }
 
 glm::ivec2 Mp3PlayNowItem::get_size() const
@@ -547,18 +659,16 @@ void Mp3PlayNowItem::draw(const glm::ivec2& location, const glm::ivec2& size) co
     }
 }
 
-void Mp3PlayNowItem::scan_and_populate(
-    const std::filesystem::path&,
-    Browser*,
-    std::vector<std::unique_ptr<BrowserItem>>& out) const
-{
-    (void)out;
-}
-
 
 void Browser::set_path(const std::filesystem::path& path)
 {
     _path = path;
+    if (_left)
+    {
+        // An explicit path here wins over whatever the left browser would
+        // pick once its own scan completes.
+        _left->_soft_select_on_scan = false;
+    }
     refresh_contents();
     set_selected_index(0);
     soft_select();
@@ -571,6 +681,11 @@ void Browser::set_max_size(const glm::ivec2& size)
 
 void Browser::set_selected_index(size_t index)
 {
+    if (_scanning)
+    {
+        _scan_selection = index;
+    }
+
     _selected_index = index;
     if (_contents.empty())
     {
@@ -589,6 +704,7 @@ void Browser::set_selected_index(size_t index)
 
 void Browser::set_custom_contents(std::vector<std::unique_ptr<BrowserItem>> contents)
 {
+    cancel_scan();
     _contents = std::move(contents);
     _scroll_offset = 0;
     if (_contents.empty())
@@ -616,6 +732,7 @@ void Browser::move_selection(int direction)
         return;
     }
 
+    _soft_select_on_scan = false;
     int next = static_cast<int>(_selected_index) + direction;
     next = std::clamp(next, 0, static_cast<int>(_contents.size() - 1));
     set_selected_index(static_cast<size_t>(next));
@@ -898,25 +1015,49 @@ bool Browser::advance_to_next_song(std::string& out_path)
 
 void Browser::refresh_contents()
 {
+    cancel_scan();
     _contents.clear();
     _scroll_offset = 0;
-    FolderItem folder_scanner(this, std::string(), std::filesystem::path());
-    Mp3Item mp3_scanner(this, std::string(), std::filesystem::path());
-    folder_scanner.scan_and_populate(_path, this, _contents);
-    mp3_scanner.scan_and_populate(_path, this, _contents);
+    _selected_index = 0;
+    _scan_selection = 0;
 
-    std::sort(_contents.begin(), _contents.end(), [](const std::unique_ptr<BrowserItem>& a, const std::unique_ptr<BrowserItem>& b)
+    if (_path.empty())
     {
-        return a->get_name() < b->get_name();
-    });
+        resize_to_fit_contents();
+        return;
+    }
 
-    if (_contents.empty())
+    if (const directory_listing* cached = ListingCache::instance().find(_path))
     {
-        _selected_index = 0;
+        append_listing(cached->folders, cached->tracks);
+        resize_to_fit_contents();
+        return;
     }
-    else if (_selected_index >= _contents.size())
+
+    directory_listing indexed;
+    if (LibraryIndex::instance().list_directory(_path, indexed.folders, indexed.tracks))
     {
-        _selected_index = _contents.size() - 1;
+        append_listing(indexed.folders, indexed.tracks);
+        resize_to_fit_contents();
+        return;
+    }
+
+    _scanning = true;
+    _soft_select_on_scan = true;
+    uint64_t generation = _scan_generation;
+    std::filesystem::path directory = _path;
+    _scan_task = TaskScheduler::instance().submit(
+        task_priority::high,
+        [owner = this, directory, generation](const TaskToken& token)
+    {
+        scan_directory(owner, directory, generation, token);
+    });
+    if (_scan_task->is_cancelled())
+    {
+        // No workers running; scan inline and let the batches arrive on the
+        // next dispatch.
+        TaskToken token;
+        scan_directory(this, directory, generation, token);
     }
 
     resize_to_fit_contents();
@@ -924,11 +1065,107 @@ void Browser::refresh_contents()
 
 void Browser::refresh()
 {
+    ListingCache::instance().invalidate(_path);
     refresh_contents();
     set_selected_index(0);
     soft_select();
 }
 
+bool Browser::is_scanning() const
+{
+    return _scanning;
+}
+
+void Browser::cancel_scan()
+{
+    if (_scan_task)
+    {
+        _scan_task->cancel();
+        _scan_task.reset();
+    }
+    // Batches already queued for the old generation are ignored.
+    ++_scan_generation;
+    _scanning = false;
+    _soft_select_on_scan = false;
+    _scan_folders.clear();
+    _scan_tracks.clear();
+}
+
+void Browser::append_listing(
+    const std::vector<std::filesystem::path>& folders,
+    const std::vector<std::filesystem::path>& tracks)
+{
+    size_t previous_count = _contents.size();
+    for (const std::filesystem::path& folder : folders)
+    {
+        _contents.push_back(std::make_unique<FolderItem>(this, folder.filename().string(), folder));
+    }
+    for (const std::filesystem::path& track : tracks)
+    {
+        _contents.push_back(std::make_unique<Mp3Item>(this, track.filename().string(), track));
+    }
+
+    auto middle = _contents.begin() + static_cast<std::ptrdiff_t>(previous_count);
+    std::sort(middle, _contents.end(), item_name_less);
+    std::inplace_merge(_contents.begin(), middle, _contents.end(), item_name_less);
+}
+
+void Browser::receive_scan_batch(const directory_scan_batch& batch)
+{
+    if (batch.owner != this || batch.generation != _scan_generation || !_scanning)
+    {
+        return;
+    }
+
+    // Keep the highlighted entry under the cursor while new entries are
+    // merged in around it.
+    const BrowserItem* selected = nullptr;
+    if (!_soft_select_on_scan && _selected_index < _contents.size())
+    {
+        selected = _contents[_selected_index].get();
+    }
+
+    append_listing(batch.folders, batch.tracks);
+    _scan_folders.insert(_scan_folders.end(), batch.folders.begin(), batch.folders.end());
+    _scan_tracks.insert(_scan_tracks.end(), batch.tracks.begin(), batch.tracks.end());
+
+    size_t index = std::min(_scan_selection, _contents.empty() ? size_t(0) : _contents.size() - 1);
+    if (selected)
+    {
+        for (size_t i = 0; i < _contents.size(); ++i)
+        {
+            if (_contents[i].get() == selected)
+            {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    bool soft_select_now = false;
+    if (batch.complete)
+    {
+        ListingCache::instance().store(_path, batch.modified, directory_listing{std::move(_scan_folders), std::move(_scan_tracks)});
+        _scan_folders.clear();
+        _scan_tracks.clear();
+        _scan_task.reset();
+        _scanning = false;
+        soft_select_now = _soft_select_on_scan;
+        _soft_select_on_scan = false;
+    }
+
+    // Assigned directly so a selection requested before the entries
+    // arrived is not clamped away by a partial listing.
+    _selected_index = index;
+    resize_to_fit_contents();
+    update_scroll_for_selection();
+    draw();
+    if (soft_select_now)
+    {
+        soft_select();
+    }
+}
+
 void Browser::draw() const
 {
     if (_size.x <= 1 || _size.y <= 1)
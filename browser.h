@@ -11,11 +11,13 @@
 
 #include "actually_good_module.h"
 #include "config.h"
+#include "task_scheduler.h"
 
 class Player;
 class Terminal;
 class Renderer;
 class Browser;
+struct directory_scan_batch;
 
 class BrowserItem
 {
@@ -32,10 +34,6 @@ public:
     virtual void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const = 0;
-    virtual void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const = 0;
 
 protected:
     BrowserItem() = default;
@@ -59,10 +57,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class Mp3Item : public BrowserItem
@@ -77,10 +71,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class QueueItem : public BrowserItem
@@ -95,10 +85,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class Mp3PlayNowItem : public BrowserItem
@@ -113,10 +99,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class StopPlayItem : public BrowserItem
@@ -131,10 +113,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class PlayRestItem : public BrowserItem
@@ -149,10 +127,6 @@ public:
     void draw(
         const glm::ivec2& location,
         const glm::ivec2& size) const override;
-    void scan_and_populate(
-        const std::filesystem::path& directory,
-        Browser* owner,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override;
 };
 
 class Browser : public ActuallyGoodModule
@@ -168,6 +142,10 @@ public:
         Player& player);
     Browser();
     Browser(const std::string& name, const std::filesystem::path& path, const glm::ivec2& location, const glm::ivec2& size);
+    ~Browser();
+
+    Browser(const Browser&) = delete;
+    Browser& operator=(const Browser&) = delete;
 
     using ActuallyGoodModule::set_location;
     using ActuallyGoodModule::set_size;
@@ -195,6 +173,7 @@ public:
     std::filesystem::path get_selected_path() const;
     void highlight_selected();
     bool is_focused() const;
+    bool is_scanning() const;
     Browser* get_left() const;
     Browser* get_right() const;
     std::string get_next_song_path() const;
@@ -217,7 +196,23 @@ private:
     glm::vec4 _canvas_sample = glm::vec4(-1.0f);
     glm::ivec2 _max_size = glm::ivec2(0);
 
+    // Directory listings stream in from a background task; until the scan
+    // completes, selection requests are remembered and applied at the end.
+    int _scan_subscription = 0;
+    uint64_t _scan_generation = 0;
+    task_token_ptr _scan_task;
+    bool _scanning = false;
+    bool _soft_select_on_scan = false;
+    size_t _scan_selection = 0;
+    std::vector<std::filesystem::path> _scan_folders;
+    std::vector<std::filesystem::path> _scan_tracks;
+
 private:
     int get_visible_rows() const;
     void update_scroll_for_selection();
+    void cancel_scan();
+    void receive_scan_batch(const directory_scan_batch& batch);
+    void append_listing(
+        const std::vector<std::filesystem::path>& folders,
+        const std::vector<std::filesystem::path>& tracks);
 };
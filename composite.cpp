@@ -0,0 +1,338 @@
+#include "composite.h"
+
+#include "terminal.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define AGMP_COMPOSITE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AGMP_TARGET_AVX2
+#else
+#define AGMP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static_assert(kCompositeLayerCount == Terminal::kLayerCount, "composite planes must cover every terminal layer");
+
+static constexpr size_t kWallpaper = static_cast<size_t>(Terminal::Layer::wallpaper);
+static constexpr size_t kLogo = static_cast<size_t>(Terminal::Layer::logo);
+static constexpr size_t kBuffer = static_cast<size_t>(Terminal::Layer::buffer);
+static constexpr size_t kJuice = static_cast<size_t>(Terminal::Layer::juice);
+
+// Source-over for premultiplied RGBA8: src + dst * (255 - src.a) / 255, with
+// red/blue and green/alpha each scaled as a pair of 16-bit lanes.
+static uint32_t blend_over(uint32_t src, uint32_t dst)
+{
+    uint32_t inverse = 255u - (src >> 24);
+    uint32_t rb = (dst & 0x00FF00FFu) * inverse + 0x00800080u;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+    uint32_t ga = ((dst >> 8) & 0x00FF00FFu) * inverse + 0x00800080u;
+    ga = (ga + ((ga >> 8) & 0x00FF00FFu)) & 0xFF00FF00u;
+    return src + (rb | ga);
+}
+
+static bool is_empty_cell(const composite_planes& planes, size_t layer, size_t index)
+{
+    return planes.glyphs[layer][index] == U' '
+        && planes.foregrounds[layer][index] == 0
+        && planes.backgrounds[layer][index] == 0;
+}
+
+// Empty layers have zero backgrounds, so blending every background
+// unconditionally matches picking the topmost non-empty layer.
+static void composite_scalar(
+    const composite_planes& planes,
+    size_t begin,
+    size_t count,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t index = begin + i;
+        size_t desired = kBuffer;
+        if (is_empty_cell(planes, kBuffer, index))
+        {
+            desired = is_empty_cell(planes, kLogo, index) ? kWallpaper : kLogo;
+        }
+        if (!is_empty_cell(planes, kJuice, index))
+        {
+            desired = kJuice;
+        }
+
+        uint32_t bg = blend_over(planes.backgrounds[kBuffer][index], planes.backgrounds[kWallpaper][index]);
+        bg = blend_over(planes.backgrounds[kJuice][index], bg);
+        glyphs[i] = planes.glyphs[desired][index];
+        foregrounds[i] = blend_over(planes.foregrounds[desired][index], bg);
+        backgrounds[i] = bg;
+    }
+}
+
+#if defined(AGMP_COMPOSITE_X86)
+
+static inline __m128i load_sse2(const void* source)
+{
+    return _mm_loadu_si128(static_cast<const __m128i*>(source));
+}
+
+static inline void store_sse2(void* target, __m128i value)
+{
+    _mm_storeu_si128(static_cast<__m128i*>(target), value);
+}
+
+static inline __m128i select_sse2(__m128i mask, __m128i if_set, __m128i if_clear)
+{
+    return _mm_or_si128(_mm_and_si128(mask, if_set), _mm_andnot_si128(mask, if_clear));
+}
+
+static inline __m128i blend_over_sse2(__m128i src, __m128i dst)
+{
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+    const __m128i bias = _mm_set1_epi16(0x0080);
+    __m128i inverse = _mm_sub_epi32(_mm_set1_epi32(255), _mm_srli_epi32(src, 24));
+    inverse = _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16));
+    __m128i rb = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(dst, low_bytes), inverse), bias);
+    __m128i ga = _mm_add_epi16(_mm_mullo_epi16(_mm_srli_epi16(dst, 8), inverse), bias);
+    rb = _mm_srli_epi16(_mm_add_epi16(rb, _mm_srli_epi16(rb, 8)), 8);
+    ga = _mm_andnot_si128(low_bytes, _mm_add_epi16(ga, _mm_srli_epi16(ga, 8)));
+    return _mm_add_epi32(src, _mm_or_si128(rb, ga));
+}
+
+static inline __m128i empty_mask_sse2(__m128i glyph, __m128i fg, __m128i bg)
+{
+    __m128i blank = _mm_cmpeq_epi32(glyph, _mm_set1_epi32(static_cast<int>(U' ')));
+    __m128i clear = _mm_cmpeq_epi32(_mm_or_si128(fg, bg), _mm_setzero_si128());
+    return _mm_and_si128(blank, clear);
+}
+
+static inline void composite4_sse2(
+    const composite_planes& planes,
+    size_t index,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds)
+{
+    __m128i wallpaper_glyph = load_sse2(planes.glyphs[kWallpaper] + index);
+    __m128i wallpaper_fg = load_sse2(planes.foregrounds[kWallpaper] + index);
+    __m128i wallpaper_bg = load_sse2(planes.backgrounds[kWallpaper] + index);
+    __m128i logo_glyph = load_sse2(planes.glyphs[kLogo] + index);
+    __m128i logo_fg = load_sse2(planes.foregrounds[kLogo] + index);
+    __m128i logo_bg = load_sse2(planes.backgrounds[kLogo] + index);
+    __m128i buffer_glyph = load_sse2(planes.glyphs[kBuffer] + index);
+    __m128i buffer_fg = load_sse2(planes.foregrounds[kBuffer] + index);
+    __m128i buffer_bg = load_sse2(planes.backgrounds[kBuffer] + index);
+    __m128i juice_glyph = load_sse2(planes.glyphs[kJuice] + index);
+    __m128i juice_fg = load_sse2(planes.foregrounds[kJuice] + index);
+    __m128i juice_bg = load_sse2(planes.backgrounds[kJuice] + index);
+
+    __m128i logo_empty = empty_mask_sse2(logo_glyph, logo_fg, logo_bg);
+    __m128i buffer_empty = empty_mask_sse2(buffer_glyph, buffer_fg, buffer_bg);
+    __m128i juice_empty = empty_mask_sse2(juice_glyph, juice_fg, juice_bg);
+
+    __m128i glyph = select_sse2(logo_empty, wallpaper_glyph, logo_glyph);
+    __m128i fg = select_sse2(logo_empty, wallpaper_fg, logo_fg);
+    glyph = select_sse2(buffer_empty, glyph, buffer_glyph);
+    fg = select_sse2(buffer_empty, fg, buffer_fg);
+    glyph = select_sse2(juice_empty, glyph, juice_glyph);
+    fg = select_sse2(juice_empty, fg, juice_fg);
+
+    __m128i bg = blend_over_sse2(juice_bg, blend_over_sse2(buffer_bg, wallpaper_bg));
+    store_sse2(glyphs, glyph);
+    store_sse2(foregrounds, blend_over_sse2(fg, bg));
+    store_sse2(backgrounds, bg);
+}
+
+static void composite_sse2(
+    const composite_planes& planes,
+    size_t begin,
+    size_t count,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        composite4_sse2(planes, begin + i, glyphs + i, foregrounds + i, backgrounds + i);
+        composite4_sse2(planes, begin + i + 4, glyphs + i + 4, foregrounds + i + 4, backgrounds + i + 4);
+    }
+    composite_scalar(planes, begin + i, count - i, glyphs + i, foregrounds + i, backgrounds + i);
+}
+
+AGMP_TARGET_AVX2 static inline __m256i load_avx2(const void* source)
+{
+    return _mm256_loadu_si256(static_cast<const __m256i*>(source));
+}
+
+AGMP_TARGET_AVX2 static inline void store_avx2(void* target, __m256i value)
+{
+    _mm256_storeu_si256(static_cast<__m256i*>(target), value);
+}
+
+AGMP_TARGET_AVX2 static inline __m256i blend_over_avx2(__m256i src, __m256i dst)
+{
+    const __m256i low_bytes = _mm256_set1_epi16(0x00FF);
+    const __m256i bias = _mm256_set1_epi16(0x0080);
+    __m256i inverse = _mm256_sub_epi32(_mm256_set1_epi32(255), _mm256_srli_epi32(src, 24));
+    inverse = _mm256_or_si256(inverse, _mm256_slli_epi32(inverse, 16));
+    __m256i rb = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(dst, low_bytes), inverse), bias);
+    __m256i ga = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_srli_epi16(dst, 8), inverse), bias);
+    rb = _mm256_srli_epi16(_mm256_add_epi16(rb, _mm256_srli_epi16(rb, 8)), 8);
+    ga = _mm256_andnot_si256(low_bytes, _mm256_add_epi16(ga, _mm256_srli_epi16(ga, 8)));
+    return _mm256_add_epi32(src, _mm256_or_si256(rb, ga));
+}
+
+AGMP_TARGET_AVX2 static inline __m256i empty_mask_avx2(__m256i glyph, __m256i fg, __m256i bg)
+{
+    __m256i blank = _mm256_cmpeq_epi32(glyph, _mm256_set1_epi32(static_cast<int>(U' ')));
+    __m256i clear = _mm256_cmpeq_epi32(_mm256_or_si256(fg, bg), _mm256_setzero_si256());
+    return _mm256_and_si256(blank, clear);
+}
+
+AGMP_TARGET_AVX2 static inline void composite8_avx2(
+    const composite_planes& planes,
+    size_t index,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds)
+{
+    __m256i wallpaper_glyph = load_avx2(planes.glyphs[kWallpaper] + index);
+    __m256i wallpaper_fg = load_avx2(planes.foregrounds[kWallpaper] + index);
+    __m256i wallpaper_bg = load_avx2(planes.backgrounds[kWallpaper] + index);
+    __m256i logo_glyph = load_avx2(planes.glyphs[kLogo] + index);
+    __m256i logo_fg = load_avx2(planes.foregrounds[kLogo] + index);
+    __m256i logo_bg = load_avx2(planes.backgrounds[kLogo] + index);
+    __m256i buffer_glyph = load_avx2(planes.glyphs[kBuffer] + index);
+    __m256i buffer_fg = load_avx2(planes.foregrounds[kBuffer] + index);
+    __m256i buffer_bg = load_avx2(planes.backgrounds[kBuffer] + index);
+    __m256i juice_glyph = load_avx2(planes.glyphs[kJuice] + index);
+    __m256i juice_fg = load_avx2(planes.foregrounds[kJuice] + index);
+    __m256i juice_bg = load_avx2(planes.backgrounds[kJuice] + index);
+
+    __m256i logo_empty = empty_mask_avx2(logo_glyph, logo_fg, logo_bg);
+    __m256i buffer_empty = empty_mask_avx2(buffer_glyph, buffer_fg, buffer_bg);
+    __m256i juice_empty = empty_mask_avx2(juice_glyph, juice_fg, juice_bg);
+
+    __m256i glyph = _mm256_blendv_epi8(logo_glyph, wallpaper_glyph, logo_empty);
+    __m256i fg = _mm256_blendv_epi8(logo_fg, wallpaper_fg, logo_empty);
+    glyph = _mm256_blendv_epi8(buffer_glyph, glyph, buffer_empty);
+    fg = _mm256_blendv_epi8(buffer_fg, fg, buffer_empty);
+    glyph = _mm256_blendv_epi8(juice_glyph, glyph, juice_empty);
+    fg = _mm256_blendv_epi8(juice_fg, fg, juice_empty);
+
+    __m256i bg = blend_over_avx2(juice_bg, blend_over_avx2(buffer_bg, wallpaper_bg));
+    store_avx2(glyphs, glyph);
+    store_avx2(foregrounds, blend_over_avx2(fg, bg));
+    store_avx2(backgrounds, bg);
+}
+
+AGMP_TARGET_AVX2 static void composite_avx2(
+    const composite_planes& planes,
+    size_t begin,
+    size_t count,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        composite8_avx2(planes, begin + i, glyphs + i, foregrounds + i, backgrounds + i);
+        composite8_avx2(planes, begin + i + 8, glyphs + i + 8, foregrounds + i + 8, backgrounds + i + 8);
+    }
+    composite_scalar(planes, begin + i, count - i, glyphs + i, foregrounds + i, backgrounds + i);
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+composite_isa detect_composite_isa()
+{
+    if (is_composite_isa_supported(composite_isa::avx2))
+    {
+        return composite_isa::avx2;
+    }
+    if (is_composite_isa_supported(composite_isa::sse2))
+    {
+        return composite_isa::sse2;
+    }
+    return composite_isa::scalar;
+}
+
+bool is_composite_isa_supported(composite_isa isa)
+{
+    switch (isa)
+    {
+    case composite_isa::scalar:
+        return true;
+#if defined(AGMP_COMPOSITE_X86)
+    case composite_isa::sse2:
+        return true;
+    case composite_isa::avx2:
+    {
+        static const bool supported = cpu_has_avx2();
+        return supported;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+composite_kernel get_composite_kernel(composite_isa isa)
+{
+    if (!is_composite_isa_supported(isa))
+    {
+        return composite_scalar;
+    }
+
+    switch (isa)
+    {
+#if defined(AGMP_COMPOSITE_X86)
+    case composite_isa::sse2:
+        return composite_sse2;
+    case composite_isa::avx2:
+        return composite_avx2;
+#endif
+    default:
+        return composite_scalar;
+    }
+}
+
+const char* get_composite_isa_name(composite_isa isa)
+{
+    switch (isa)
+    {
+    case composite_isa::sse2:
+        return "sse2";
+    case composite_isa::avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
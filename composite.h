@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+static constexpr size_t kCompositeLayerCount = 4;
+
+// Layer planes in Terminal::Layer order. Colours are premultiplied RGBA8.
+struct composite_planes
+{
+    const char32_t* glyphs[kCompositeLayerCount];
+    const uint32_t* foregrounds[kCompositeLayerCount];
+    const uint32_t* backgrounds[kCompositeLayerCount];
+};
+
+// Composites cells [begin, begin + count) into opaque glyph, foreground and
+// background values written to the first count entries of each output.
+using composite_kernel = void (*)(
+    const composite_planes& planes,
+    size_t begin,
+    size_t count,
+    char32_t* glyphs,
+    uint32_t* foregrounds,
+    uint32_t* backgrounds);
+
+enum class composite_isa
+{
+    scalar = 0,
+    sse2,
+    avx2,
+};
+
+composite_isa detect_composite_isa();
+bool is_composite_isa_supported(composite_isa isa);
+composite_kernel get_composite_kernel(composite_isa isa);
+const char* get_composite_isa_name(composite_isa isa);
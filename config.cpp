@@ -8,6 +8,8 @@
 
 #include <glm/vec4.hpp>
 
+#include "fft.h"
+
 static const std::vector<std::string> kDefaultRiceArt = {
     "                                                                          ",
     "     ▄▄                         ▄▄ ▄▄          ▄   ▄▄▄▄                   ",
@@ -101,6 +103,10 @@ app_config load_config(const std::string& path)
     app_config config;
     config.default_track = "01 High For This.mp3";
     config.library_path = "library";
+    config.library_index_path = "library.idx";
+    config.cache_directory = "cache";
+    config.worker_threads = 0;
+    config.library_scan_threads = 0;
     config.play_pause_key = ' ';
     config.quit_key = 'q';
     config.skip_next_key = 'l';
@@ -112,6 +118,8 @@ app_config load_config(const std::string& path)
     config.use_arrow_keys = true;
     config.enable_online_art = true;
     config.search_key = '/';
+    config.profiler_key = '`';
+    config.profiler_trace_path = "profile_trace.json";
     config.auto_resume_playback = true;
     config.safe_mode = false;
     config.browser_normal_fg = glm::vec4(0.941f, 0.941f, 0.941f, 1.0f);
@@ -143,6 +151,7 @@ app_config load_config(const std::string& path)
     config.spectrum_colour_high = glm::vec4(1.0f, 0.376f, 0.251f, 1.0f);
     config.spectrum_particle_threshold = 0.995f;
     config.spectrum_juice_multiplier = 1.0f;
+    config.spectrum_fft_size = 4096;
     config.scrubber_colour_low = config.spectrum_colour_low;
     config.scrubber_colour_high = config.spectrum_colour_high;
     config.particle_angle_bias = 12.0f;
@@ -250,6 +259,34 @@ app_config load_config(const std::string& path)
         {
             config.library_path = value;
         }
+        else if (key == "library_index_path")
+        {
+            config.library_index_path = value;
+        }
+        else if (key == "cache_directory")
+        {
+            config.cache_directory = value;
+        }
+        else if (key == "worker_threads")
+        {
+            try
+            {
+                config.worker_threads = std::clamp(std::stoi(value), 0, 16);
+            }
+            catch (...)
+            {
+            }
+        }
+        else if (key == "library_scan_threads")
+        {
+            try
+            {
+                config.library_scan_threads = std::clamp(std::stoi(value), 0, 64);
+            }
+            catch (...)
+            {
+            }
+        }
         else if (key == "play_pause_key")
         {
             if (!value.empty())
@@ -335,6 +372,17 @@ app_config load_config(const std::string& path)
                 config.search_key = value[0];
             }
         }
+        else if (key == "profiler_key")
+        {
+            if (!value.empty())
+            {
+                config.profiler_key = value[0];
+            }
+        }
+        else if (key == "profiler_trace_path")
+        {
+            config.profiler_trace_path = value;
+        }
         else if (key == "auto_resume_playback")
         {
             if (value == "true" || value == "1" || value == "yes")
@@ -526,6 +574,16 @@ app_config load_config(const std::string& path)
             {
             }
         }
+        else if (key == "spectrum_fft_size")
+        {
+            try
+            {
+                config.spectrum_fft_size = RealFft::clamp_size(std::stoi(value));
+            }
+            catch (...)
+            {
+            }
+        }
         else if (key == "scrubber_colour_low")
         {
             config.scrubber_colour_low = parse_color(value, config.scrubber_colour_low);
@@ -9,6 +9,10 @@ struct app_config
 {
     std::string default_track;
     std::string library_path;
+    std::string library_index_path;
+    std::string cache_directory;
+    int worker_threads;
+    int library_scan_threads;
     char play_pause_key;
     char quit_key;
     char skip_next_key;
@@ -20,6 +24,8 @@ struct app_config
     bool use_arrow_keys;
     bool enable_online_art;
     char search_key;
+    char profiler_key;
+    std::string profiler_trace_path;
     bool auto_resume_playback;
     bool safe_mode;
     glm::vec4 browser_normal_fg;
@@ -51,6 +57,7 @@ struct app_config
     glm::vec4 spectrum_colour_high;
     float spectrum_particle_threshold;
     float spectrum_juice_multiplier;
+    int spectrum_fft_size;
     glm::vec4 scrubber_colour_low;
     glm::vec4 scrubber_colour_high;
     float particle_angle_bias;
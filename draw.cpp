@@ -320,11 +320,11 @@ void Renderer::draw_glyph(
     _terminal.set_glyph(location, glyph, foreground, background);
 }
 
-void Renderer::set_layer(const std::string& name, const std::vector<Terminal::Character>& source)
+void Renderer::set_layer(Terminal::Layer layer, const std::vector<Terminal::Character>& source)
 {
     spdlog::trace("Renderer::set_layer() begin");
 
-    _terminal.set_layer(name, source);
+    _terminal.set_layer(layer, source);
 
     spdlog::trace("Renderer::set_layer() end");
 }
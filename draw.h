@@ -32,7 +32,7 @@ public:
     void draw_string_canvas_bg(const std::string& text, const glm::ivec2& location, const glm::vec4& foreground);
     void draw_glyph(const glm::ivec2& location, char32_t glyph, const glm::vec4& foreground, const glm::vec4& background);
     void draw_particle_glyph(const glm::ivec2& location, char32_t glyph, const glm::vec4& foreground, const glm::vec4& background, uint32_t particle_id);
-    void set_layer(const std::string& name, const std::vector<Terminal::Character>& source);
+    void set_layer(Terminal::Layer layer, const std::vector<Terminal::Character>& source);
     void clear_juice();
     void clear_box(const glm::ivec2& min_corner, const glm::ivec2& size);
     void select_region(const glm::ivec2& min_corner, const glm::ivec2& size);
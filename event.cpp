@@ -1,6 +1,25 @@
 #include "event.h"
 
-#include <vector>
+#include "event_loop.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+namespace topics
+{
+    const Topic<std::string> mp3_selected = EventBus::instance().register_topic<std::string>("browser.mp3_selected");
+    const Topic<std::string> album_art_updated = EventBus::instance().register_topic<std::string>("album_art.updated", topic_delivery::coalesce);
+    const Topic<std::string> album_art_online_updated = EventBus::instance().register_topic<std::string>("album_art.online_updated", topic_delivery::coalesce);
+    const Topic<std::string> track_changed = EventBus::instance().register_topic<std::string>("player.track_changed");
+    const Topic<std::string> queue_enqueue = EventBus::instance().register_topic<std::string>("queue.enqueue");
+    const Topic<std::string> queue_play_rest = EventBus::instance().register_topic<std::string>("queue.play_rest");
+    const Topic<no_payload> player_stop = EventBus::instance().register_topic<no_payload>("player.stop");
+    const Topic<particle_emit_event> particle_emit = EventBus::instance().register_topic<particle_emit_event>("debug.particle_emit");
+    const Topic<directory_scan_batch> directory_scan = EventBus::instance().register_topic<directory_scan_batch>("browser.directory_scan");
+    const Topic<directory_stamp> directory_checked = EventBus::instance().register_topic<directory_stamp>("browser.directory_checked");
+    const Topic<library_scan_progress> library_scan = EventBus::instance().register_topic<library_scan_progress>("library.scan_progress", topic_delivery::coalesce);
+}
 
 EventBus& EventBus::instance()
 {
@@ -8,16 +27,58 @@ EventBus& EventBus::instance()
     return bus;
 }
 
-int EventBus::subscribe(const std::string& name, Handler handler)
+EventBus::~EventBus()
 {
-    if (!handler)
+    DeferredEvent* event = _deferred.exchange(nullptr, std::memory_order_acquire);
+    while (event)
     {
-        return 0;
+        DeferredEvent* next = event->next;
+        delete event;
+        event = next;
+    }
+}
+
+topic_id EventBus::intern(std::string_view name, const void* type)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_topics.empty())
+    {
+        // Topic id 0 is reserved so a default-constructed Topic never matches.
+        _topics.push_back(TopicEntry{});
     }
 
+    std::string key(name);
+    auto found = _topic_ids.find(key);
+    if (found != _topic_ids.end())
+    {
+        if (_topics[found->second].type != type)
+        {
+            spdlog::error("event topic {} registered with a different payload type", key);
+            return 0;
+        }
+        return found->second;
+    }
+
+    topic_id id = static_cast<topic_id>(_topics.size());
+    _topics.push_back(TopicEntry{key, type, std::make_shared<const SubscriberList>()});
+    _topic_ids.emplace(std::move(key), id);
+    return id;
+}
+
+int EventBus::add_subscription(topic_id topic, ErasedHandler handler)
+{
     std::lock_guard<std::mutex> lock(_mutex);
+    if (topic == 0 || topic >= _topics.size())
+    {
+        return 0;
+    }
+
     int id = _next_id++;
-    _subscriptions.emplace(id, Subscription{name, std::move(handler)});
+    TopicEntry& entry = _topics[topic];
+    auto subscribers = std::make_shared<SubscriberList>(*entry.subscribers);
+    subscribers->push_back(Subscription{id, std::move(handler)});
+    entry.subscribers = std::move(subscribers);
+    _subscription_topics.emplace(id, topic);
     return id;
 }
 
@@ -28,28 +89,123 @@ void EventBus::unsubscribe(int id)
         return;
     }
 
+    std::shared_ptr<const SubscriberList> released;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _subscription_topics.find(id);
+        if (found == _subscription_topics.end())
+        {
+            return;
+        }
+
+        TopicEntry& entry = _topics[found->second];
+        _subscription_topics.erase(found);
+
+        auto subscribers = std::make_shared<SubscriberList>();
+        subscribers->reserve(entry.subscribers->size());
+        for (const Subscription& sub : *entry.subscribers)
+        {
+            if (sub.id != id)
+            {
+                subscribers->push_back(sub);
+            }
+        }
+        released = std::move(entry.subscribers);
+        entry.subscribers = std::move(subscribers);
+    }
+    // The old list (and any captured state) is destroyed outside the lock.
+}
+
+std::string EventBus::get_topic_name(topic_id id) const
+{
     std::lock_guard<std::mutex> lock(_mutex);
-    _subscriptions.erase(id);
+    if (id >= _topics.size())
+    {
+        return std::string();
+    }
+    return _topics[id].name;
 }
 
-void EventBus::publish(const Event& event)
+void EventBus::dispatch(topic_id topic, const void* payload)
 {
-    std::vector<Handler> handlers;
+    std::shared_ptr<const SubscriberList> subscribers;
     {
         std::lock_guard<std::mutex> lock(_mutex);
-        handlers.reserve(_subscriptions.size());
-        for (const auto& entry : _subscriptions)
+        if (topic == 0 || topic >= _topics.size())
         {
-            const Subscription& sub = entry.second;
-            if (sub.name == event.name)
+            return;
+        }
+        subscribers = _topics[topic].subscribers;
+    }
+
+    for (const Subscription& sub : *subscribers)
+    {
+        sub.handler(payload);
+    }
+
+    EventLoop::instance().wake();
+}
+
+void EventBus::set_dispatch_thread()
+{
+    _dispatch_thread = std::this_thread::get_id();
+    _has_dispatch_thread.store(true, std::memory_order_release);
+}
+
+bool EventBus::is_foreign_thread() const
+{
+    return _has_dispatch_thread.load(std::memory_order_acquire)
+        && std::this_thread::get_id() != _dispatch_thread;
+}
+
+void EventBus::enqueue(DeferredEvent* event)
+{
+    DeferredEvent* head = _deferred.load(std::memory_order_relaxed);
+    do
+    {
+        event->next = head;
+    } while (!_deferred.compare_exchange_weak(head, event, std::memory_order_release, std::memory_order_relaxed));
+
+    EventLoop::instance().wake();
+}
+
+void EventBus::dispatch_deferred()
+{
+    DeferredEvent* head = _deferred.exchange(nullptr, std::memory_order_acquire);
+    if (!head)
+    {
+        return;
+    }
+
+    // The stack is newest first, so the first event seen for a coalesced
+    // topic is the one to keep; the rest are dropped.
+    _deferred_batch.clear();
+    _coalesced_topics.clear();
+    for (DeferredEvent* event = head; event; event = event->next)
+    {
+        if (event->delivery == topic_delivery::coalesce)
+        {
+            if (std::find(_coalesced_topics.begin(), _coalesced_topics.end(), event->topic) != _coalesced_topics.end())
             {
-                handlers.push_back(sub.handler);
+                event->topic = 0;
+            }
+            else
+            {
+                _coalesced_topics.push_back(event->topic);
             }
         }
+        _deferred_batch.emplace_back(event);
     }
 
-    for (const auto& handler : handlers)
+    // Handlers may post again; those events land on the fresh stack and
+    // wait for the next dispatch.
+    for (auto it = _deferred_batch.rbegin(); it != _deferred_batch.rend(); ++it)
     {
-        handler(event);
+        std::unique_ptr<DeferredEvent> event = std::move(*it);
+        if (event->topic != 0)
+        {
+            dispatch(event->topic, event->payload());
+        }
     }
+    _deferred_batch.clear();
 }
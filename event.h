@@ -1,37 +1,224 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
-struct Event
+using topic_id = uint32_t;
+
+// How deferred events on a topic are delivered: every event in order, or
+// only the newest one queued since the last dispatch.
+enum class topic_delivery : uint8_t
+{
+    every,
+    coalesce,
+};
+
+// A topic is an interned name bound to the payload type its subscribers
+// receive; publishing passes the payload by reference without copying it.
+template <typename T>
+struct Topic
+{
+    topic_id id = 0;
+    topic_delivery delivery = topic_delivery::every;
+};
+
+struct no_payload
+{
+};
+
+struct particle_emit_event
+{
+    int x = 0;
+    int y = 0;
+    float norm_x = 0.5f;
+};
+
+class Browser;
+
+// Part of a background directory listing; only the browser that started
+// scan `generation` applies it.
+struct directory_scan_batch
 {
-    std::string name;
-    std::string payload;
+    const Browser* owner = nullptr;
+    uint64_t generation = 0;
+    std::vector<std::filesystem::path> folders;
+    std::vector<std::filesystem::path> tracks;
+    bool complete = false;
+    // On the complete batch, the directory's mtime taken before listing.
+    std::filesystem::file_time_type modified{};
 };
 
+// Posted by a background recheck of a cached directory listing.
+struct directory_stamp
+{
+    std::filesystem::path directory;
+    std::filesystem::file_time_type modified{};
+};
+
+// Posted by library rescans as batches of tags are committed, and once
+// more with `complete` set when the walk and every read has finished.
+struct library_scan_progress
+{
+    size_t directories = 0;
+    size_t tracks_queued = 0;
+    size_t tracks_read = 0;
+    bool complete = false;
+};
+
+namespace topics
+{
+    extern const Topic<std::string> mp3_selected;
+    extern const Topic<std::string> album_art_updated;
+    extern const Topic<std::string> album_art_online_updated;
+    extern const Topic<std::string> track_changed;
+    extern const Topic<std::string> queue_enqueue;
+    extern const Topic<std::string> queue_play_rest;
+    extern const Topic<no_payload> player_stop;
+    extern const Topic<particle_emit_event> particle_emit;
+    extern const Topic<directory_scan_batch> directory_scan;
+    extern const Topic<directory_stamp> directory_checked;
+    extern const Topic<library_scan_progress> library_scan;
+}
+
 class EventBus
 {
 public:
-    using Handler = std::function<void(const Event&)>;
-
     static EventBus& instance();
 
-    int subscribe(const std::string& name, Handler handler);
+    template <typename T>
+    Topic<T> register_topic(std::string_view name, topic_delivery delivery = topic_delivery::every)
+    {
+        return Topic<T>{intern(name, type_key<T>()), delivery};
+    }
+
+    template <typename T, typename Handler>
+    int subscribe(const Topic<T>& topic, Handler handler)
+    {
+        return add_subscription(
+            topic.id,
+            [handler = std::move(handler)](const void* payload)
+            {
+                handler(*static_cast<const T*>(payload));
+            });
+    }
+
+    // Runs handlers immediately on the dispatch thread; from any other
+    // thread the event is queued as if by post().
+    template <typename T>
+    void publish(const Topic<T>& topic, const T& payload)
+    {
+        if (is_foreign_thread())
+        {
+            post(topic, payload);
+            return;
+        }
+        dispatch(topic.id, &payload);
+    }
+
+    void publish(const Topic<no_payload>& topic)
+    {
+        publish(topic, no_payload{});
+    }
+
+    // Queues the event for the next dispatch_deferred(). Safe from any thread.
+    template <typename T>
+    void post(const Topic<T>& topic, T payload)
+    {
+        enqueue(new DeferredPayload<T>(topic, std::move(payload)));
+    }
+
+    void set_dispatch_thread();
+    void dispatch_deferred();
+
     void unsubscribe(int id);
-    void publish(const Event& event);
+    std::string get_topic_name(topic_id id) const;
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
 
 private:
     EventBus() = default;
+    ~EventBus();
+
+    struct DeferredEvent
+    {
+        DeferredEvent(topic_id id, topic_delivery mode) : topic(id), delivery(mode) {}
+        virtual ~DeferredEvent() = default;
+        virtual const void* payload() const = 0;
+
+        DeferredEvent* next = nullptr;
+        topic_id topic = 0;
+        topic_delivery delivery = topic_delivery::every;
+    };
+
+    template <typename T>
+    struct DeferredPayload final : DeferredEvent
+    {
+        DeferredPayload(const Topic<T>& topic, T payload)
+            : DeferredEvent(topic.id, topic.delivery), value(std::move(payload))
+        {
+        }
+
+        const void* payload() const override
+        {
+            return &value;
+        }
+
+        T value;
+    };
+
+    using ErasedHandler = std::function<void(const void*)>;
 
     struct Subscription
+    {
+        int id = 0;
+        ErasedHandler handler;
+    };
+
+    using SubscriberList = std::vector<Subscription>;
+
+    struct TopicEntry
     {
         std::string name;
-        Handler handler;
+        const void* type = nullptr;
+        // Replaced wholesale on subscribe/unsubscribe so publish can hold a
+        // snapshot without the lock.
+        std::shared_ptr<const SubscriberList> subscribers;
     };
 
+    template <typename T>
+    static const void* type_key()
+    {
+        static const char key = 0;
+        return &key;
+    }
+
+    topic_id intern(std::string_view name, const void* type);
+    int add_subscription(topic_id topic, ErasedHandler handler);
+    void dispatch(topic_id topic, const void* payload);
+    void enqueue(DeferredEvent* event);
+    bool is_foreign_thread() const;
+
     int _next_id = 1;
-    std::unordered_map<int, Subscription> _subscriptions;
-    std::mutex _mutex;
+    std::vector<TopicEntry> _topics;
+    std::unordered_map<std::string, topic_id> _topic_ids;
+    std::unordered_map<int, topic_id> _subscription_topics;
+    mutable std::mutex _mutex;
+
+    // Producers push onto a lock-free stack; the dispatch thread takes the
+    // whole stack at once, so nodes are never popped individually.
+    std::atomic<DeferredEvent*> _deferred{nullptr};
+    std::atomic<bool> _has_dispatch_thread{false};
+    std::thread::id _dispatch_thread;
+    std::vector<std::unique_ptr<DeferredEvent>> _deferred_batch;
+    std::vector<topic_id> _coalesced_topics;
 };
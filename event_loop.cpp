@@ -0,0 +1,317 @@
+#include "event_loop.h"
+
+#include <spdlog/spdlog.h>
+
+#include "input.h"
+
+#if defined(_WIN32)
+#include <algorithm>
+#include <conio.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+#if defined(_WIN32)
+// _kbhit()/_getch() only consume key presses. Key releases, focus, mouse and
+// buffer-size records stay queued and keep the input handle signalled, so
+// they are read off here. Returns false when the handle isn't a console.
+static bool drain_console_events(HANDLE input, bool& resized)
+{
+    INPUT_RECORD records[32];
+    DWORD available = 0;
+    for (;;)
+    {
+        if (!GetNumberOfConsoleInputEvents(input, &available))
+        {
+            return false;
+        }
+        if (available == 0)
+        {
+            return true;
+        }
+
+        DWORD read = 0;
+        DWORD wanted = std::min<DWORD>(available, static_cast<DWORD>(sizeof(records) / sizeof(records[0])));
+        if (!ReadConsoleInputW(input, records, wanted, &read) || read == 0)
+        {
+            return false;
+        }
+        for (DWORD i = 0; i < read; ++i)
+        {
+            if (records[i].EventType == WINDOW_BUFFER_SIZE_EVENT)
+            {
+                resized = true;
+            }
+        }
+    }
+}
+#else
+static volatile sig_atomic_t g_signal_fd = -1;
+
+static void signal_wakeup(int fd)
+{
+    int saved_errno = errno;
+#if defined(__linux__)
+    uint64_t value = 1;
+    ssize_t written = write(fd, &value, sizeof(value));
+#else
+    unsigned char value = 1;
+    ssize_t written = write(fd, &value, sizeof(value));
+#endif
+    (void)written;
+    errno = saved_errno;
+}
+
+static void on_resize_signal(int)
+{
+    int fd = g_signal_fd;
+    if (fd >= 0)
+    {
+        signal_wakeup(fd);
+    }
+}
+#endif
+
+EventLoop& EventLoop::instance()
+{
+    static EventLoop loop;
+    return loop;
+}
+
+EventLoop::~EventLoop()
+{
+    shutdown();
+}
+
+bool EventLoop::init()
+{
+    _loop_thread = std::this_thread::get_id();
+
+#if defined(_WIN32)
+    if (!_event)
+    {
+        _event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    }
+    return _event != nullptr;
+#else
+    if (_wake_read >= 0)
+    {
+        return true;
+    }
+
+#if defined(__linux__)
+    _wake_read = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _wake_write = _wake_read;
+#else
+    int fds[2];
+    if (pipe(fds) == 0)
+    {
+        for (int fd : fds)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        _wake_read = fds[0];
+        _wake_write = fds[1];
+    }
+#endif
+    if (_wake_read < 0)
+    {
+        spdlog::error("EventLoop: failed to create wakeup fd: {}", std::strerror(errno));
+        return false;
+    }
+
+    g_signal_fd = _wake_write;
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_resize_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &action, nullptr);
+    return true;
+#endif
+}
+
+void EventLoop::shutdown()
+{
+#if defined(_WIN32)
+    if (_event)
+    {
+        CloseHandle(static_cast<HANDLE>(_event));
+        _event = nullptr;
+    }
+#else
+    if (_wake_read < 0)
+    {
+        return;
+    }
+
+    signal(SIGWINCH, SIG_DFL);
+    g_signal_fd = -1;
+    if (_wake_write != _wake_read)
+    {
+        close(_wake_write);
+    }
+    close(_wake_read);
+    _wake_read = -1;
+    _wake_write = -1;
+#endif
+}
+
+void EventLoop::wake()
+{
+    // The loop thread redraws after whatever it is doing, so it never needs
+    // to wake itself; other threads only signal once per wait.
+    if (std::this_thread::get_id() == _loop_thread
+        || _pending.exchange(true, std::memory_order_acq_rel))
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    if (_event)
+    {
+        SetEvent(static_cast<HANDLE>(_event));
+    }
+#else
+    if (_wake_write >= 0)
+    {
+        signal_wakeup(_wake_write);
+    }
+#endif
+}
+
+loop_wakeup EventLoop::wait(int timeout_ms)
+{
+    loop_wakeup result;
+
+#if defined(_WIN32)
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    ULONGLONG deadline = timeout_ms < 0 ? 0 : GetTickCount64() + static_cast<ULONGLONG>(timeout_ms);
+    for (;;)
+    {
+        HANDLE handles[2];
+        DWORD count = 0;
+        if (!_stdin_closed)
+        {
+            handles[count++] = input;
+        }
+        DWORD event_index = count;
+        if (_event)
+        {
+            handles[count++] = static_cast<HANDLE>(_event);
+        }
+
+        DWORD timeout = INFINITE;
+        if (timeout_ms >= 0)
+        {
+            ULONGLONG now = GetTickCount64();
+            timeout = now >= deadline ? 0 : static_cast<DWORD>(deadline - now);
+        }
+        DWORD status = count > 0 ? WaitForMultipleObjects(count, handles, FALSE, timeout) : WAIT_TIMEOUT;
+        if (count == 0 && timeout != 0)
+        {
+            Sleep(timeout);
+        }
+
+        if (!_stdin_closed && status == WAIT_OBJECT_0)
+        {
+            if (_kbhit())
+            {
+                result.input = true;
+                break;
+            }
+
+            bool resized = false;
+            if (!drain_console_events(input, resized))
+            {
+                spdlog::warn("EventLoop: stdin is not a console, no longer polling for input");
+                _stdin_closed = true;
+            }
+            if (resized)
+            {
+                result.woken = true;
+                break;
+            }
+            // Nothing the UI cares about; wait out the rest of the timeout.
+            continue;
+        }
+        if (_event && status == WAIT_OBJECT_0 + event_index)
+        {
+            result.woken = true;
+            _pending.store(false, std::memory_order_release);
+            break;
+        }
+        result.timed_out = true;
+        break;
+    }
+#else
+    // A stdin at end of file polls readable forever; stop watching it once a
+    // key read has seen the end.
+    if (!_stdin_closed && input_at_eof())
+    {
+        spdlog::warn("EventLoop: stdin reached end of file, no longer polling for input");
+        _stdin_closed = true;
+    }
+
+    pollfd fds[2];
+    fds[0].fd = _stdin_closed ? -1 : STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = _wake_read;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    int ready = poll(fds, 2, timeout_ms);
+    if (ready < 0)
+    {
+        result.woken = errno == EINTR;
+        return result;
+    }
+    if (ready == 0)
+    {
+        result.timed_out = true;
+        return result;
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+        result.input = true;
+    }
+    else if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+    {
+        spdlog::warn("EventLoop: stdin closed, no longer polling for input");
+        _stdin_closed = true;
+    }
+    if (fds[1].revents & POLLIN)
+    {
+        result.woken = true;
+        drain();
+    }
+#endif
+
+    return result;
+}
+
+void EventLoop::drain()
+{
+#if !defined(_WIN32)
+    // Empty the pipe before clearing the flag: a wake() that lands after the
+    // clear writes a fresh byte, and one that lands before it is covered by
+    // the frame this wait is about to run.
+    unsigned char buffer[64];
+    while (read(_wake_read, buffer, sizeof(buffer)) > 0)
+    {
+    }
+    _pending.store(false, std::memory_order_release);
+#endif
+}
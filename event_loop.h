@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+struct loop_wakeup
+{
+    bool input = false;
+    bool woken = false;
+    bool timed_out = false;
+};
+
+// Blocks the UI thread until stdin has input, another thread calls wake(),
+// the terminal is resized or the timeout expires.
+class EventLoop
+{
+public:
+    static EventLoop& instance();
+
+    bool init();
+    void shutdown();
+    void wake();
+    loop_wakeup wait(int timeout_ms);
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+private:
+    EventLoop() = default;
+    ~EventLoop();
+
+    void drain();
+
+    std::atomic<bool> _pending{false};
+    std::thread::id _loop_thread;
+    bool _stdin_closed = false;
+#if defined(_WIN32)
+    void* _event = nullptr;
+#else
+    int _wake_read = -1;
+    int _wake_write = -1;
+#endif
+};
@@ -0,0 +1,160 @@
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double kTwoPi = 6.28318530717958647692;
+
+RealFft::RealFft(int size)
+{
+    resize(size);
+}
+
+int RealFft::clamp_size(int size)
+{
+    size = std::clamp(size, kMinSize, kMaxSize);
+    int power = kMinSize;
+    while (power < size)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+void RealFft::resize(int size)
+{
+    size = clamp_size(size);
+    if (size == _size)
+    {
+        return;
+    }
+
+    _size = size;
+    _half = size / 2;
+
+    _window.resize(static_cast<size_t>(_size));
+    for (int i = 0; i < _size; ++i)
+    {
+        double t = static_cast<double>(i) / static_cast<double>(_size - 1);
+        _window[static_cast<size_t>(i)] = static_cast<float>(0.5 * (1.0 - std::cos(kTwoPi * t)));
+    }
+
+    int bits = 0;
+    while ((1 << bits) < _half)
+    {
+        bits += 1;
+    }
+    _bit_reverse.resize(static_cast<size_t>(_half));
+    for (int i = 0; i < _half; ++i)
+    {
+        uint32_t reversed = 0;
+        for (int b = 0; b < bits; ++b)
+        {
+            if (i & (1 << b))
+            {
+                reversed |= 1u << (bits - 1 - b);
+            }
+        }
+        _bit_reverse[static_cast<size_t>(i)] = reversed;
+    }
+
+    _twiddle_re.resize(static_cast<size_t>(_half / 2));
+    _twiddle_im.resize(static_cast<size_t>(_half / 2));
+    for (int k = 0; k < _half / 2; ++k)
+    {
+        double angle = kTwoPi * static_cast<double>(k) / static_cast<double>(_half);
+        _twiddle_re[static_cast<size_t>(k)] = static_cast<float>(std::cos(angle));
+        _twiddle_im[static_cast<size_t>(k)] = static_cast<float>(-std::sin(angle));
+    }
+
+    _split_re.resize(static_cast<size_t>(_half));
+    _split_im.resize(static_cast<size_t>(_half));
+    for (int k = 0; k < _half; ++k)
+    {
+        double angle = kTwoPi * static_cast<double>(k) / static_cast<double>(_size);
+        _split_re[static_cast<size_t>(k)] = static_cast<float>(std::cos(angle));
+        _split_im[static_cast<size_t>(k)] = static_cast<float>(-std::sin(angle));
+    }
+
+    _re.assign(static_cast<size_t>(_half), 0.0f);
+    _im.assign(static_cast<size_t>(_half), 0.0f);
+}
+
+int RealFft::get_size() const
+{
+    return _size;
+}
+
+int RealFft::get_bin_count() const
+{
+    return _half;
+}
+
+void RealFft::windowed_magnitudes(const float* samples, float* magnitudes)
+{
+    if (_size <= 0 || !samples || !magnitudes)
+    {
+        return;
+    }
+
+    // Pack even/odd samples as one complex sequence of half length, then split.
+    for (int m = 0; m < _half; ++m)
+    {
+        size_t even = static_cast<size_t>(2 * m);
+        size_t target = _bit_reverse[static_cast<size_t>(m)];
+        _re[target] = samples[even] * _window[even];
+        _im[target] = samples[even + 1] * _window[even + 1];
+    }
+
+    transform();
+
+    float inv_count = 1.0f / static_cast<float>(_size);
+    for (int k = 0; k < _half; ++k)
+    {
+        size_t index = static_cast<size_t>(k);
+        size_t mirror = static_cast<size_t>((k == 0) ? 0 : _half - k);
+        float a = _re[index];
+        float b = _im[index];
+        float c = _re[mirror];
+        float d = -_im[mirror];
+
+        float even_re = 0.5f * (a + c);
+        float even_im = 0.5f * (b + d);
+        float odd_re = 0.5f * (b - d);
+        float odd_im = -0.5f * (a - c);
+
+        float wr = _split_re[index];
+        float wi = _split_im[index];
+        float re = even_re + (wr * odd_re - wi * odd_im);
+        float im = even_im + (wr * odd_im + wi * odd_re);
+        magnitudes[index] = std::sqrt(re * re + im * im) * inv_count;
+    }
+}
+
+void RealFft::transform()
+{
+    float* re = _re.data();
+    float* im = _im.data();
+    for (int length = 2; length <= _half; length <<= 1)
+    {
+        int half_length = length / 2;
+        int stride = _half / length;
+        for (int start = 0; start < _half; start += length)
+        {
+            for (int j = 0; j < half_length; ++j)
+            {
+                size_t twiddle = static_cast<size_t>(j * stride);
+                float wr = _twiddle_re[twiddle];
+                float wi = _twiddle_im[twiddle];
+                size_t top = static_cast<size_t>(start + j);
+                size_t bottom = top + static_cast<size_t>(half_length);
+                float tr = re[bottom] * wr - im[bottom] * wi;
+                float ti = re[bottom] * wi + im[bottom] * wr;
+                re[bottom] = re[top] - tr;
+                im[bottom] = im[top] - ti;
+                re[top] += tr;
+                im[top] += ti;
+            }
+        }
+    }
+}
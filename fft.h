@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class RealFft
+{
+public:
+    static constexpr int kMinSize = 256;
+    static constexpr int kMaxSize = 16384;
+
+    RealFft() = default;
+    explicit RealFft(int size);
+
+    static int clamp_size(int size);
+
+    void resize(int size);
+    int get_size() const;
+    int get_bin_count() const;
+
+    void windowed_magnitudes(const float* samples, float* magnitudes);
+
+private:
+    void transform();
+
+    int _size = 0;
+    int _half = 0;
+    std::vector<float> _window;
+    std::vector<uint32_t> _bit_reverse;
+    std::vector<float> _twiddle_re;
+    std::vector<float> _twiddle_im;
+    std::vector<float> _split_re;
+    std::vector<float> _split_im;
+    std::vector<float> _re;
+    std::vector<float> _im;
+};
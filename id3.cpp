@@ -0,0 +1,540 @@
+#include "id3.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const size_t max_text_frame_size = 64 * 1024;
+static const size_t max_picture_header_size = 4096;
+
+static uint32_t read_be24(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(data[0]) << 16) |
+           (static_cast<uint32_t>(data[1]) << 8) |
+           static_cast<uint32_t>(data[2]);
+}
+
+static uint32_t read_be32(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(data[0]) << 24) |
+           (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) |
+           static_cast<uint32_t>(data[3]);
+}
+
+static uint32_t read_syncsafe32(const uint8_t* data)
+{
+    return (static_cast<uint32_t>(data[0]) << 21) |
+           (static_cast<uint32_t>(data[1]) << 14) |
+           (static_cast<uint32_t>(data[2]) << 7) |
+           static_cast<uint32_t>(data[3]);
+}
+
+// Undoes ID3 unsynchronisation: every 0xFF 0x00 pair was written for a
+// single 0xFF byte.
+static void remove_unsynchronisation(std::vector<uint8_t>& data)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[out++] = data[i];
+        if (data[i] == 0xFF && i + 1 < data.size() && data[i + 1] == 0x00)
+        {
+            ++i;
+        }
+    }
+    data.resize(out);
+}
+
+static std::string decode_text(const uint8_t* data, size_t size, uint8_t encoding)
+{
+    if (size == 0)
+    {
+        return std::string();
+    }
+
+    if (encoding == 0 || encoding == 3)
+    {
+        return std::string(reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data + size));
+    }
+
+    bool little_endian = true;
+    size_t offset = 0;
+    if (encoding == 1 && size >= 2)
+    {
+        uint16_t bom = static_cast<uint16_t>(data[0] << 8) | static_cast<uint16_t>(data[1]);
+        if (bom == 0xFEFF)
+        {
+            little_endian = false;
+            offset = 2;
+        }
+        else if (bom == 0xFFFE)
+        {
+            little_endian = true;
+            offset = 2;
+        }
+    }
+    else if (encoding == 2)
+    {
+        little_endian = false;
+    }
+
+    std::string result;
+    result.reserve(size / 2);
+    for (size_t i = offset; i + 1 < size; i += 2)
+    {
+        uint16_t code = little_endian
+            ? static_cast<uint16_t>(data[i] | (data[i + 1] << 8))
+            : static_cast<uint16_t>((data[i] << 8) | data[i + 1]);
+        if (code == 0)
+        {
+            break;
+        }
+        if (code <= 0xFF)
+        {
+            result.push_back(static_cast<char>(code));
+        }
+        else
+        {
+            result.push_back('?');
+        }
+    }
+    return result;
+}
+
+static size_t skip_text(const uint8_t* data, size_t size, uint8_t encoding)
+{
+    if (encoding == 0 || encoding == 3)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (data[i] == 0)
+            {
+                return i + 1;
+            }
+        }
+        return size;
+    }
+
+    for (size_t i = 0; i + 1 < size; i += 2)
+    {
+        if (data[i] == 0 && data[i + 1] == 0)
+        {
+            return i + 2;
+        }
+    }
+    return size;
+}
+
+// Offset of the image bytes within an APIC (or ID3v2.2 PIC) frame body,
+// or zero when the header is malformed.
+static size_t find_picture_data(const uint8_t* data, size_t size, bool v22)
+{
+    if (size < 4)
+    {
+        return 0;
+    }
+
+    uint8_t encoding = data[0];
+    size_t offset = 1;
+    if (v22)
+    {
+        offset += 3;
+    }
+    else
+    {
+        while (offset < size && data[offset] != 0)
+        {
+            ++offset;
+        }
+        if (offset >= size)
+        {
+            return 0;
+        }
+        offset += 1;
+    }
+
+    // Picture type.
+    offset += 1;
+    if (offset >= size)
+    {
+        return 0;
+    }
+
+    offset += skip_text(data + offset, size - offset, encoding);
+    if (offset >= size)
+    {
+        return 0;
+    }
+    return offset;
+}
+
+Id3Reader::~Id3Reader()
+{
+    close();
+}
+
+bool Id3Reader::open(const std::string& path)
+{
+    close();
+
+    _file = MappedFileCache::instance().open(path);
+    if (!_file)
+    {
+        return false;
+    }
+    const uint64_t file_size = _file->size();
+
+    uint8_t header[10] = {};
+    if (file_size < sizeof(header) || !read_at(0, header, sizeof(header)))
+    {
+        close();
+        return false;
+    }
+
+    if (header[0] != 'I' || header[1] != 'D' || header[2] != '3' || header[3] < 2 || header[3] > 4)
+    {
+        close();
+        return false;
+    }
+
+    _version = header[3];
+    _flags = header[5];
+    uint32_t tag_size = read_syncsafe32(&header[6]);
+    // ID3v2.2 used this bit for a compression scheme that was never defined.
+    if (tag_size == 0 || tag_size > file_size - sizeof(header) || (_version == 2 && (_flags & 0x40) != 0))
+    {
+        close();
+        return false;
+    }
+
+    _position = sizeof(header);
+    _end = sizeof(header) + static_cast<uint64_t>(tag_size);
+
+    if ((_flags & 0x40) != 0)
+    {
+        uint8_t ext[4] = {};
+        if (!read_at(_position, ext, sizeof(ext)))
+        {
+            close();
+            return false;
+        }
+        // The ID3v2.4 size covers the whole extended header, the ID3v2.3
+        // size excludes its own four bytes.
+        _position += (_version == 4)
+            ? static_cast<uint64_t>(read_syncsafe32(ext))
+            : static_cast<uint64_t>(read_be32(ext)) + 4;
+    }
+
+    // Before ID3v2.4 unsynchronisation covers the frame headers too, so
+    // such tags are decoded up front and served from memory instead.
+    if ((_flags & 0x80) != 0 && _version < 4)
+    {
+        std::vector<uint8_t> tag(static_cast<size_t>(_end));
+        if (!read_at(0, tag.data(), tag.size()))
+        {
+            close();
+            return false;
+        }
+        remove_unsynchronisation(tag);
+        _end = tag.size();
+        _tag = std::move(tag);
+    }
+    return true;
+}
+
+void Id3Reader::close()
+{
+    _file.reset();
+    _tag.clear();
+    _version = 0;
+    _flags = 0;
+    _position = 0;
+    _end = 0;
+}
+
+bool Id3Reader::read_at(uint64_t offset, void* data, size_t size)
+{
+    const uint8_t* source = _tag.empty() ? (_file ? _file->data() : nullptr) : _tag.data();
+    const uint64_t available = _tag.empty() ? (_file ? _file->size() : 0) : _tag.size();
+    if (!source || offset > available || size > available - offset)
+    {
+        return false;
+    }
+    std::memcpy(data, source + offset, size);
+    return true;
+}
+
+bool Id3Reader::next(id3_frame& frame)
+{
+    const uint64_t header_size = (_version == 2) ? 6 : 10;
+    while (_position + header_size <= _end)
+    {
+        uint8_t header[10] = {};
+        if (!read_at(_position, header, static_cast<size_t>(header_size)))
+        {
+            return false;
+        }
+
+        const size_t id_size = (_version == 2) ? 3 : 4;
+        for (size_t i = 0; i < id_size; ++i)
+        {
+            const char c = static_cast<char>(header[i]);
+            // Padding, or garbage after the last frame.
+            if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+            {
+                return false;
+            }
+        }
+
+        frame = id3_frame{};
+        for (size_t i = 0; i < id_size; ++i)
+        {
+            frame.id[i] = static_cast<char>(header[i]);
+        }
+        if (_version == 2)
+        {
+            frame.size = read_be24(header + 3);
+        }
+        else
+        {
+            frame.size = (_version == 4) ? read_syncsafe32(header + 4) : read_be32(header + 4);
+            frame.flags = static_cast<uint16_t>((header[8] << 8) | header[9]);
+        }
+        frame.offset = _position + header_size;
+        if (frame.offset + frame.size > _end)
+        {
+            return false;
+        }
+
+        _position = frame.offset + frame.size;
+        if (frame.size > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Id3Reader::read_body(const id3_frame& frame, size_t limit, std::vector<uint8_t>& body)
+{
+    body.clear();
+
+    uint64_t offset = frame.offset;
+    uint32_t size = frame.size;
+    if (_version == 3 && (frame.flags & 0x00C0) != 0)
+    {
+        // Compressed or encrypted.
+        return false;
+    }
+    if (_version == 4)
+    {
+        if ((frame.flags & 0x000C) != 0)
+        {
+            return false;
+        }
+        if ((frame.flags & 0x0001) != 0)
+        {
+            // Data length indicator.
+            if (size < 4)
+            {
+                return false;
+            }
+            offset += 4;
+            size -= 4;
+        }
+    }
+
+    size_t count = std::min(static_cast<size_t>(size), limit);
+    body.resize(count);
+    if (count > 0 && !read_at(offset, body.data(), count))
+    {
+        body.clear();
+        return false;
+    }
+    return true;
+}
+
+uint8_t Id3Reader::version() const
+{
+    return _version;
+}
+
+bool Id3Reader::is_unsynchronised(const id3_frame& frame) const
+{
+    if (_version < 4)
+    {
+        return false;
+    }
+    return (_flags & 0x80) != 0 || (frame.flags & 0x0002) != 0;
+}
+
+namespace
+{
+    struct text_frame
+    {
+        const char* id;
+        const char* id_v22;
+        std::string id3_tags::*field;
+        uint32_t bit;
+    };
+
+    const text_frame text_frames[] = {
+        {"TIT2", "TT2", &id3_tags::title, 1u << 0},
+        {"TPE1", "TP1", &id3_tags::artist, 1u << 1},
+        {"TALB", "TAL", &id3_tags::album, 1u << 2},
+        {"TYER", "TYE", &id3_tags::date, 1u << 3},
+        {"TDRC", nullptr, &id3_tags::date, 1u << 3},
+        {"TCON", "TCO", &id3_tags::genre, 1u << 4},
+        {"TRCK", "TRK", &id3_tags::track, 1u << 5},
+    };
+
+    const uint32_t all_text_bits = (1u << 6) - 1;
+    const uint32_t picture_bit = 1u << 6;
+
+    bool same_id(const char* a, const char* b)
+    {
+        return b != nullptr && std::strcmp(a, b) == 0;
+    }
+}
+
+// Locates the image bytes of a picture frame in file terms, reading only the
+// frame's MIME type and description.
+static bool locate_picture(Id3Reader& reader, const id3_frame& frame, id3_picture& picture)
+{
+    std::vector<uint8_t> prefix;
+    if (!reader.read_body(frame, max_picture_header_size, prefix))
+    {
+        return false;
+    }
+
+    const uint64_t skipped = (reader.version() == 4 && (frame.flags & 0x0001) != 0) ? 4 : 0;
+    const uint64_t raw_begin = frame.offset + skipped;
+    const uint64_t raw_end = frame.offset + frame.size;
+
+    bool unsynchronised = reader.is_unsynchronised(frame);
+    // Map each decoded byte back to its position in the file so the image
+    // can be read later straight from disk.
+    std::vector<uint32_t> raw_index;
+    if (unsynchronised)
+    {
+        raw_index.reserve(prefix.size());
+        size_t out = 0;
+        for (size_t i = 0; i < prefix.size(); ++i)
+        {
+            raw_index.push_back(static_cast<uint32_t>(i));
+            prefix[out++] = prefix[i];
+            if (prefix[i] == 0xFF && i + 1 < prefix.size() && prefix[i + 1] == 0x00)
+            {
+                ++i;
+            }
+        }
+        prefix.resize(out);
+    }
+
+    size_t start = find_picture_data(prefix.data(), prefix.size(), reader.version() == 2);
+    if (start == 0)
+    {
+        return false;
+    }
+
+    uint64_t image_offset = raw_begin + (unsynchronised ? raw_index[start] : start);
+    if (image_offset >= raw_end)
+    {
+        return false;
+    }
+
+    picture.offset = image_offset;
+    picture.size = static_cast<uint32_t>(raw_end - image_offset);
+    picture.unsynchronised = unsynchronised;
+    return true;
+}
+
+bool read_id3_tags(const std::string& path, id3_tags& tags, uint32_t fields)
+{
+    tags = id3_tags{};
+
+    Id3Reader reader;
+    if (!reader.open(path))
+    {
+        return false;
+    }
+
+    uint32_t wanted = 0;
+    if ((fields & id3_text) != 0)
+    {
+        wanted |= all_text_bits;
+    }
+    if ((fields & id3_art) != 0)
+    {
+        wanted |= picture_bit;
+    }
+
+    const bool v22 = reader.version() == 2;
+    uint32_t found = 0;
+    id3_frame frame;
+    std::vector<uint8_t> body;
+    while ((found & wanted) != wanted && reader.next(frame))
+    {
+        if ((wanted & picture_bit) != 0 && (found & picture_bit) == 0
+            && same_id(frame.id, v22 ? "PIC" : "APIC"))
+        {
+            if (locate_picture(reader, frame, tags.picture))
+            {
+                found |= picture_bit;
+            }
+            continue;
+        }
+
+        if (frame.id[0] != 'T' || (wanted & all_text_bits) == 0)
+        {
+            continue;
+        }
+
+        for (const text_frame& text : text_frames)
+        {
+            if ((found & text.bit) != 0 || !same_id(frame.id, v22 ? text.id_v22 : text.id))
+            {
+                continue;
+            }
+            if (frame.size > 1 && frame.size <= max_text_frame_size
+                && reader.read_body(frame, max_text_frame_size, body) && body.size() > 1)
+            {
+                if (reader.is_unsynchronised(frame))
+                {
+                    remove_unsynchronisation(body);
+                }
+                tags.*text.field = decode_text(body.data() + 1, body.size() - 1, body[0]);
+                found |= text.bit;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+bool read_id3_picture(const std::string& path, const id3_picture& picture, std::vector<unsigned char>& image_data)
+{
+    image_data.clear();
+    if (picture.size == 0)
+    {
+        return false;
+    }
+
+    Id3Reader reader;
+    if (!reader.open(path))
+    {
+        return false;
+    }
+
+    image_data.resize(picture.size);
+    if (!reader.read_at(picture.offset, image_data.data(), image_data.size()))
+    {
+        image_data.clear();
+        return false;
+    }
+    if (picture.unsynchronised)
+    {
+        remove_unsynchronisation(image_data);
+    }
+    return !image_data.empty();
+}
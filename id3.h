@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Where the embedded picture's image bytes sit in the file, so they can be
+// read later without walking the tag again.
+struct id3_picture
+{
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    bool unsynchronised = false;
+};
+
+struct id3_tags
+{
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string date;
+    std::string genre;
+    std::string track;
+    id3_picture picture;
+};
+
+enum id3_fields : uint32_t
+{
+    id3_text = 1u << 0,
+    id3_art = 1u << 1,
+};
+
+struct id3_frame
+{
+    // Four characters for ID3v2.3/2.4, three for ID3v2.2, NUL-terminated.
+    char id[5] = {};
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    uint16_t flags = 0;
+};
+
+// Walks the frames of an ID3v2.2/2.3/2.4 tag in the file's shared mapping,
+// touching one frame header at a time; bodies are only read when asked for.
+// Offsets are file offsets, except in tags unsynchronised as a whole where
+// they index the decoded tag.
+class Id3Reader
+{
+public:
+    Id3Reader() = default;
+    ~Id3Reader();
+
+    Id3Reader(const Id3Reader&) = delete;
+    Id3Reader& operator=(const Id3Reader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool next(id3_frame& frame);
+    bool read_body(const id3_frame& frame, size_t limit, std::vector<uint8_t>& body);
+    bool read_at(uint64_t offset, void* data, size_t size);
+
+    uint8_t version() const;
+    bool is_unsynchronised(const id3_frame& frame) const;
+
+private:
+    mapped_file_ptr _file;
+    uint8_t _version = 0;
+    uint8_t _flags = 0;
+    uint64_t _position = 0;
+    uint64_t _end = 0;
+    std::vector<uint8_t> _tag;
+};
+
+// Reads the requested fields in one pass over the frame headers, stopping as
+// soon as everything asked for has been seen. Returns false without a tag.
+bool read_id3_tags(const std::string& path, id3_tags& tags, uint32_t fields = id3_text | id3_art);
+bool read_id3_picture(const std::string& path, const id3_picture& picture, std::vector<unsigned char>& image_data);
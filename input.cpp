@@ -14,6 +14,7 @@ namespace
 #if !defined(_WIN32)
 termios g_original;
 bool g_has_original = false;
+bool g_at_eof = false;
 #endif
 }
 
@@ -110,10 +111,19 @@ int input_poll_key()
         }
         return ch;
     }
-    if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    if (result == 0)
     {
-        return -1;
+        g_at_eof = true;
     }
     return -1;
 #endif
 }
+
+bool input_at_eof()
+{
+#if defined(_WIN32)
+    return false;
+#else
+    return g_at_eof;
+#endif
+}
@@ -8,3 +8,5 @@ constexpr int input_key_right = 1004;
 void input_init();
 void input_shutdown();
 int input_poll_key();
+// True once a read of stdin has returned end of file.
+bool input_at_eof();
@@ -0,0 +1,749 @@
+#include "library.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "event.h"
+#include "library_scanner.h"
+#include "spdlog/spdlog.h"
+
+static const char* kIndexHeader = "agmp-library 3";
+
+static bool is_mp3_path(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+    {
+        return static_cast<char>(std::tolower(c));
+    });
+    return extension == ".mp3";
+}
+
+static std::string escape_field(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (char ch : value)
+    {
+        switch (ch)
+        {
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        default:
+            out.push_back(ch);
+            break;
+        }
+    }
+    return out;
+}
+
+static std::string unescape_field(const std::string& value)
+{
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        char ch = value[i];
+        if (ch != '\\' || i + 1 >= value.size())
+        {
+            out.push_back(ch);
+            continue;
+        }
+
+        char next = value[++i];
+        switch (next)
+        {
+        case 't':
+            out.push_back('\t');
+            break;
+        case 'n':
+            out.push_back('\n');
+            break;
+        case 'r':
+            out.push_back('\r');
+            break;
+        default:
+            out.push_back(next);
+            break;
+        }
+    }
+    return out;
+}
+
+static std::vector<std::string> split_fields(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;)
+    {
+        size_t tab = line.find('\t', start);
+        if (tab == std::string::npos)
+        {
+            fields.push_back(unescape_field(line.substr(start)));
+            break;
+        }
+        fields.push_back(unescape_field(line.substr(start, tab - start)));
+        start = tab + 1;
+    }
+    return fields;
+}
+
+static bool read_directory_stamp(const std::string& path, int64_t& modified_time)
+{
+    std::error_code error;
+    auto write_time = std::filesystem::last_write_time(std::filesystem::path(path), error);
+    if (error)
+    {
+        return false;
+    }
+    modified_time = static_cast<int64_t>(write_time.time_since_epoch().count());
+    return true;
+}
+
+// True when `key` is `ancestor` or lies below it.
+static bool is_key_within(const std::string& key, const std::string& ancestor)
+{
+    if (key.compare(0, ancestor.size(), ancestor) != 0)
+    {
+        return false;
+    }
+    return key.size() == ancestor.size() || ancestor.back() == '/' || key[ancestor.size()] == '/';
+}
+
+static std::string parent_key(const std::string& key)
+{
+    return LibraryIndex::make_key(std::filesystem::path(key).parent_path());
+}
+
+LibraryIndex& LibraryIndex::instance()
+{
+    static LibraryIndex index;
+    return index;
+}
+
+std::string LibraryIndex::make_key(const std::filesystem::path& path)
+{
+    std::string key = path.lexically_normal().generic_string();
+    while (key.size() > 1 && key.back() == '/' && key[key.size() - 2] != ':')
+    {
+        key.pop_back();
+    }
+    return key;
+}
+
+bool LibraryIndex::load(const std::string& index_path)
+{
+    std::ifstream file(index_path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kIndexHeader)
+    {
+        spdlog::warn("LibraryIndex::load: ignoring '{}', unknown format", index_path);
+        return false;
+    }
+
+    std::string root;
+    std::unordered_map<std::string, library_directory> directories;
+    std::unordered_map<std::string, library_track> tracks;
+    while (std::getline(file, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::vector<std::string> fields = split_fields(line);
+        try
+        {
+            if (fields[0] == "R" && fields.size() >= 2)
+            {
+                root = fields[1];
+            }
+            else if (fields[0] == "D" && fields.size() >= 3)
+            {
+                library_directory& directory = directories[fields[2]];
+                directory.modified_time = std::stoll(fields[1]);
+            }
+            else if (fields[0] == "T" && fields.size() >= 15)
+            {
+                library_track track;
+                track.path = fields[1];
+                track.modified_time = std::stoll(fields[2]);
+                track.file_size = std::stoll(fields[3]);
+                track.metadata.sample_rate = std::stoi(fields[4]);
+                track.metadata.channels = std::stoi(fields[5]);
+                track.metadata.duration_ms = std::stoi(fields[6]);
+                track.metadata.duration_frames = std::stoll(fields[7]);
+                track.metadata.bitrate_kbps = std::stoi(fields[8]);
+                track.metadata.file_size_bytes = track.file_size;
+                track.metadata.title = fields[9];
+                track.metadata.artist = fields[10];
+                track.metadata.album = fields[11];
+                track.metadata.date = fields[12];
+                track.metadata.genre = fields[13];
+                track.metadata.track = fields[14];
+                if (fields.size() >= 18)
+                {
+                    track.metadata.art.offset = std::stoull(fields[15]);
+                    track.metadata.art.size = static_cast<uint32_t>(std::stoul(fields[16]));
+                    track.metadata.art.unsynchronised = fields[17] == "1";
+                    track.metadata.art_located = true;
+                }
+                std::string key = track.path;
+                tracks[key] = std::move(track);
+            }
+        }
+        catch (...)
+        {
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _root = std::move(root);
+    _directories = std::move(directories);
+    _tracks = std::move(tracks);
+    link_children_locked();
+    _modified = false;
+    spdlog::info("LibraryIndex::load: {} directories, {} tracks from '{}'", _directories.size(), _tracks.size(), index_path);
+    return true;
+}
+
+bool LibraryIndex::save(const std::string& index_path)
+{
+    std::ostringstream stream;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stream << kIndexHeader << "\n";
+        stream << "R\t" << escape_field(_root) << "\n";
+        for (const auto& entry : _directories)
+        {
+            stream << "D\t" << entry.second.modified_time << "\t" << escape_field(entry.first) << "\n";
+        }
+        for (const auto& entry : _tracks)
+        {
+            const library_track& track = entry.second;
+            const track_metadata& meta = track.metadata;
+            stream << "T\t" << escape_field(track.path)
+                   << "\t" << track.modified_time
+                   << "\t" << track.file_size
+                   << "\t" << meta.sample_rate
+                   << "\t" << meta.channels
+                   << "\t" << meta.duration_ms
+                   << "\t" << meta.duration_frames
+                   << "\t" << meta.bitrate_kbps
+                   << "\t" << escape_field(meta.title)
+                   << "\t" << escape_field(meta.artist)
+                   << "\t" << escape_field(meta.album)
+                   << "\t" << escape_field(meta.date)
+                   << "\t" << escape_field(meta.genre)
+                   << "\t" << escape_field(meta.track);
+            if (meta.art_located)
+            {
+                stream << "\t" << meta.art.offset
+                       << "\t" << meta.art.size
+                       << "\t" << (meta.art.unsynchronised ? 1 : 0);
+            }
+            stream << "\n";
+        }
+        _modified = false;
+    }
+
+    std::string temp_path = index_path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        const std::string text = stream.str();
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, index_path, error);
+    if (error)
+    {
+        spdlog::warn("LibraryIndex::save: failed to write '{}': {}", index_path, error.message());
+        return false;
+    }
+    return true;
+}
+
+void LibraryIndex::rescan(const std::string& root)
+{
+    std::string root_key = make_key(root);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_root != root_key)
+        {
+            _directories.clear();
+            _tracks.clear();
+            _root = root_key;
+            _modified = true;
+        }
+        _listed_directories.clear();
+    }
+
+    _scan_directories.store(0, std::memory_order_relaxed);
+    _scan_queued.store(0, std::memory_order_relaxed);
+    _scan_read.store(0, std::memory_order_relaxed);
+
+    std::error_code error;
+    std::filesystem::path canonical_root = std::filesystem::canonical(root_key, error);
+    _canonical_root = error ? root_key : make_key(canonical_root);
+    _linked_directories.clear();
+
+    // This thread walks the tree while the scanner reads tags behind it.
+    LibraryScanner scanner(_scan_threads.load(std::memory_order_relaxed), [this](std::vector<library_track>& tracks)
+    {
+        commit_tracks(tracks);
+    });
+    rescan_directory(root_key, scanner);
+    if (_cancel.load(std::memory_order_acquire))
+    {
+        scanner.cancel();
+
+        // A directory's stamp says its tracks and subdirectories are all in
+        // the index, which a cancelled walk can't promise: the scanner
+        // dropped queued tracks and some subdirectories were never reached.
+        // Zeroing the stamps makes the next rescan list them again, while
+        // the tags that were read are kept.
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const std::string& directory : _listed_directories)
+        {
+            auto it = _directories.find(directory);
+            if (it != _directories.end())
+            {
+                it->second.modified_time = 0;
+            }
+        }
+        _modified = true;
+    }
+    else
+    {
+        scanner.finish();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _listed_directories.clear();
+    }
+    post_progress(true);
+}
+
+// A link into the library would walk it twice, and one to the library or an
+// ancestor of it would walk forever, so only links to directories beside it
+// are followed, each target once per rescan.
+bool LibraryIndex::follow_directory_link(const std::filesystem::path& link)
+{
+    std::error_code error;
+    std::filesystem::path target = std::filesystem::canonical(link, error);
+    if (error)
+    {
+        return false;
+    }
+
+    std::string target_key = make_key(target);
+    if (is_key_within(target_key, _canonical_root) || is_key_within(_canonical_root, target_key))
+    {
+        return false;
+    }
+    return _linked_directories.insert(target_key).second;
+}
+
+void LibraryIndex::start_background_rescan(const std::string& root, const std::string& index_path)
+{
+    stop();
+    _cancel.store(false, std::memory_order_release);
+    _rescanning.store(true, std::memory_order_release);
+    _thread = std::thread([this, root, index_path]()
+    {
+        auto start = std::chrono::steady_clock::now();
+        rescan(root);
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        spdlog::info("LibraryIndex: rescan of '{}' took {:.2f}s, {} tracks", root, elapsed, get_track_count());
+
+        bool modified = false;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            modified = _modified;
+        }
+        if (modified && !index_path.empty())
+        {
+            save(index_path);
+        }
+        _rescanning.store(false, std::memory_order_release);
+    });
+}
+
+void LibraryIndex::stop()
+{
+    _cancel.store(true, std::memory_order_release);
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+bool LibraryIndex::list_directory(
+    const std::filesystem::path& directory,
+    std::vector<std::filesystem::path>& folders,
+    std::vector<std::filesystem::path>& tracks) const
+{
+    std::string key = make_key(directory);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _directories.find(key);
+    if (it == _directories.end())
+    {
+        return false;
+    }
+
+    folders.reserve(folders.size() + it->second.subdirectories.size());
+    for (const std::string& folder : it->second.subdirectories)
+    {
+        folders.emplace_back(folder);
+    }
+    tracks.reserve(tracks.size() + it->second.tracks.size());
+    for (const std::string& track : it->second.tracks)
+    {
+        tracks.emplace_back(track);
+    }
+    return true;
+}
+
+bool LibraryIndex::find_track(
+    const std::string& path,
+    int64_t modified_time,
+    int64_t file_size,
+    track_metadata& metadata) const
+{
+    std::string key = make_key(path);
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _tracks.find(key);
+    if (it == _tracks.end())
+    {
+        return false;
+    }
+
+    const library_track& track = it->second;
+    if (track.modified_time != modified_time || track.file_size != file_size)
+    {
+        return false;
+    }
+
+    metadata = track.metadata;
+    return true;
+}
+
+bool LibraryIndex::is_rescanning() const
+{
+    return _rescanning.load(std::memory_order_acquire);
+}
+
+void LibraryIndex::set_scan_threads(int count)
+{
+    _scan_threads.store(std::max(0, count), std::memory_order_relaxed);
+}
+
+size_t LibraryIndex::get_track_count() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tracks.size();
+}
+
+void LibraryIndex::rescan_directory(const std::string& directory, LibraryScanner& scanner)
+{
+    namespace fs = std::filesystem;
+    if (_cancel.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    int64_t modified_time = 0;
+    if (!read_directory_stamp(directory, modified_time))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        remove_directory_locked(directory);
+        return;
+    }
+
+    std::vector<std::string> known_subdirectories;
+    bool unchanged = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _directories.find(directory);
+        if (it != _directories.end() && it->second.modified_time == modified_time)
+        {
+            known_subdirectories = it->second.subdirectories;
+            unchanged = true;
+        }
+    }
+
+    if (unchanged)
+    {
+        for (const std::string& subdirectory : known_subdirectories)
+        {
+            rescan_directory(subdirectory, scanner);
+        }
+        return;
+    }
+
+    _scan_directories.fetch_add(1, std::memory_order_relaxed);
+    library_directory listing;
+    listing.modified_time = modified_time;
+    bool incomplete = false;
+
+    std::error_code error;
+    for (fs::directory_iterator it(fs::path(directory), error), end; !error && it != end; it.increment(error))
+    {
+        if (_cancel.load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        const fs::directory_entry& entry = *it;
+        std::error_code entry_error;
+        if (entry.is_directory(entry_error))
+        {
+            if (entry.is_symlink(entry_error) && !follow_directory_link(entry.path()))
+            {
+                continue;
+            }
+            listing.subdirectories.push_back(make_key(entry.path()));
+            continue;
+        }
+
+        if (!entry.is_regular_file(entry_error) || !is_mp3_path(entry.path()))
+        {
+            continue;
+        }
+
+        std::string key = make_key(entry.path());
+        listing.tracks.push_back(key);
+
+        library_track track;
+        track.path = key;
+        if (!read_file_stamp(key, track.modified_time, track.file_size))
+        {
+            incomplete = true;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto existing = _tracks.find(key);
+            if (existing != _tracks.end()
+                && existing->second.modified_time == track.modified_time
+                && existing->second.file_size == track.file_size)
+            {
+                continue;
+            }
+        }
+
+        _scan_queued.fetch_add(1, std::memory_order_relaxed);
+        scanner.submit(std::move(track));
+    }
+
+    if (error)
+    {
+        spdlog::warn("LibraryIndex: failed to list '{}': {}", directory, error.message());
+        return;
+    }
+
+    std::sort(listing.subdirectories.begin(), listing.subdirectories.end());
+    std::sort(listing.tracks.begin(), listing.tracks.end());
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto previous = _directories.find(directory);
+        if (previous != _directories.end())
+        {
+            for (const std::string& track : previous->second.tracks)
+            {
+                if (!std::binary_search(listing.tracks.begin(), listing.tracks.end(), track))
+                {
+                    _tracks.erase(track);
+                }
+            }
+            std::vector<std::string> removed_subdirectories;
+            for (const std::string& subdirectory : previous->second.subdirectories)
+            {
+                if (!std::binary_search(listing.subdirectories.begin(), listing.subdirectories.end(), subdirectory))
+                {
+                    removed_subdirectories.push_back(subdirectory);
+                }
+            }
+            for (const std::string& subdirectory : removed_subdirectories)
+            {
+                remove_directory_locked(subdirectory);
+            }
+        }
+
+        // A track that couldn't be stamped never reaches _tracks, so the
+        // directory has to be listed again next time.
+        if (incomplete)
+        {
+            listing.modified_time = 0;
+        }
+
+        known_subdirectories = listing.subdirectories;
+        _directories[directory] = std::move(listing);
+        _listed_directories.push_back(directory);
+        _modified = true;
+    }
+
+    for (const std::string& subdirectory : known_subdirectories)
+    {
+        rescan_directory(subdirectory, scanner);
+    }
+}
+
+void LibraryIndex::commit_tracks(std::vector<library_track>& tracks)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (library_track& track : tracks)
+        {
+            std::string key = track.path;
+            _tracks[key] = std::move(track);
+        }
+        _modified = true;
+    }
+    _scan_read.fetch_add(tracks.size(), std::memory_order_relaxed);
+    post_progress(false);
+}
+
+void LibraryIndex::post_progress(bool complete)
+{
+    library_scan_progress progress;
+    progress.directories = _scan_directories.load(std::memory_order_relaxed);
+    progress.tracks_queued = _scan_queued.load(std::memory_order_relaxed);
+    progress.tracks_read = _scan_read.load(std::memory_order_relaxed);
+    progress.complete = complete;
+    EventBus::instance().post(topics::library_scan, progress);
+}
+
+void LibraryIndex::remove_directory_locked(const std::string& directory)
+{
+    auto it = _directories.find(directory);
+    if (it == _directories.end())
+    {
+        return;
+    }
+
+    library_directory removed = std::move(it->second);
+    _directories.erase(it);
+    for (const std::string& track : removed.tracks)
+    {
+        _tracks.erase(track);
+    }
+    for (const std::string& subdirectory : removed.subdirectories)
+    {
+        remove_directory_locked(subdirectory);
+    }
+    _modified = true;
+}
+
+void LibraryIndex::link_children_locked()
+{
+    for (auto& entry : _directories)
+    {
+        entry.second.subdirectories.clear();
+        entry.second.tracks.clear();
+    }
+
+    for (const auto& entry : _directories)
+    {
+        if (entry.first == _root)
+        {
+            continue;
+        }
+        auto parent = _directories.find(parent_key(entry.first));
+        if (parent != _directories.end() && parent->first != entry.first)
+        {
+            parent->second.subdirectories.push_back(entry.first);
+        }
+    }
+
+    for (const auto& entry : _tracks)
+    {
+        auto parent = _directories.find(parent_key(entry.first));
+        if (parent != _directories.end())
+        {
+            parent->second.tracks.push_back(entry.first);
+        }
+    }
+
+    for (auto& entry : _directories)
+    {
+        std::sort(entry.second.subdirectories.begin(), entry.second.subdirectories.end());
+        std::sort(entry.second.tracks.begin(), entry.second.tracks.end());
+    }
+}
+
+int run_library_scan(const app_config& config)
+{
+    if (config.library_path.empty())
+    {
+        std::fprintf(stderr, "agmp --scan: no library_path configured\n");
+        return 1;
+    }
+
+    LibraryIndex& index = LibraryIndex::instance();
+    if (!config.library_index_path.empty())
+    {
+        index.load(config.library_index_path);
+    }
+    index.set_scan_threads(config.library_scan_threads);
+
+    EventBus& bus = EventBus::instance();
+    bus.set_dispatch_thread();
+    library_scan_progress last;
+    int subscription = bus.subscribe(topics::library_scan, [&last](const library_scan_progress& progress)
+    {
+        last = progress;
+        std::printf("\r%zu directories, %zu/%zu tracks read", progress.directories, progress.tracks_read, progress.tracks_queued);
+        std::fflush(stdout);
+    });
+
+    std::printf("Scanning '%s' with %d tag reader threads\n",
+        config.library_path.c_str(),
+        LibraryScanner::resolve_thread_count(config.library_scan_threads));
+
+    auto start = std::chrono::steady_clock::now();
+    index.start_background_rescan(config.library_path, config.library_index_path);
+    while (index.is_rescanning())
+    {
+        bus.dispatch_deferred();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    index.stop();
+    bus.dispatch_deferred();
+    bus.unsubscribe(subscription);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double rate = seconds > 0.0 ? static_cast<double>(last.tracks_read) / seconds : 0.0;
+    std::printf("\n%zu tracks in the index; read %zu in %.2fs (%.0f tracks/s)\n",
+        index.get_track_count(), last.tracks_read, seconds, rate);
+    return 0;
+}
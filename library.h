@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "metadata.h"
+
+class LibraryScanner;
+
+struct library_track
+{
+    std::string path;
+    int64_t modified_time = 0;
+    int64_t file_size = 0;
+    track_metadata metadata;
+};
+
+struct library_directory
+{
+    int64_t modified_time = 0;
+    std::vector<std::string> subdirectories;
+    std::vector<std::string> tracks;
+};
+
+class LibraryIndex
+{
+public:
+    static LibraryIndex& instance();
+
+    bool load(const std::string& index_path);
+    bool save(const std::string& index_path);
+    void rescan(const std::string& root);
+    void start_background_rescan(const std::string& root, const std::string& index_path);
+    void stop();
+    bool is_rescanning() const;
+
+    // Tag reader threads for rescans; 0 picks from the core count. Network
+    // shares usually want more than the core count to hide latency, a
+    // single spinning disk fewer.
+    void set_scan_threads(int count);
+
+    bool list_directory(
+        const std::filesystem::path& directory,
+        std::vector<std::filesystem::path>& folders,
+        std::vector<std::filesystem::path>& tracks) const;
+    bool find_track(
+        const std::string& path,
+        int64_t modified_time,
+        int64_t file_size,
+        track_metadata& metadata) const;
+    size_t get_track_count() const;
+
+    static std::string make_key(const std::filesystem::path& path);
+
+    LibraryIndex(const LibraryIndex&) = delete;
+    LibraryIndex& operator=(const LibraryIndex&) = delete;
+
+private:
+    LibraryIndex() = default;
+
+    void rescan_directory(const std::string& directory, LibraryScanner& scanner);
+    bool follow_directory_link(const std::filesystem::path& link);
+    void commit_tracks(std::vector<library_track>& tracks);
+    void post_progress(bool complete);
+    void remove_directory_locked(const std::string& directory);
+    void link_children_locked();
+
+    mutable std::mutex _mutex;
+    std::string _root;
+    std::unordered_map<std::string, library_directory> _directories;
+    std::unordered_map<std::string, library_track> _tracks;
+    // Directories listed by the running rescan.
+    std::vector<std::string> _listed_directories;
+    // Walk-thread only: the real root and the link targets already followed.
+    std::string _canonical_root;
+    std::unordered_set<std::string> _linked_directories;
+    std::atomic<bool> _cancel{false};
+    std::atomic<bool> _rescanning{false};
+    std::atomic<int> _scan_threads{0};
+    std::atomic<size_t> _scan_directories{0};
+    std::atomic<size_t> _scan_queued{0};
+    std::atomic<size_t> _scan_read{0};
+    std::thread _thread;
+    bool _modified = false;
+};
+
+// Headless `agmp --scan`: brings the index for config.library_path up to
+// date, printing progress, and saves it.
+int run_library_scan(const app_config& config);
@@ -0,0 +1,155 @@
+#include "library_scanner.h"
+
+#include <algorithm>
+#include <chrono>
+
+LibraryScanner::LibraryScanner(int thread_count, commit_function commit)
+    : _commit(std::move(commit))
+{
+    int count = resolve_thread_count(thread_count);
+    _workers.reserve(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+    {
+        _workers.emplace_back([this]()
+        {
+            worker_loop();
+        });
+    }
+    _writer = std::thread([this]()
+    {
+        writer_loop();
+    });
+}
+
+LibraryScanner::~LibraryScanner()
+{
+    cancel();
+}
+
+int LibraryScanner::resolve_thread_count(int requested)
+{
+    if (requested > 0)
+    {
+        return requested;
+    }
+    unsigned int cores = std::thread::hardware_concurrency();
+    return std::clamp(static_cast<int>(cores), 1, 16);
+}
+
+void LibraryScanner::submit(library_track track)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _space_ready.wait(lock, [this]()
+    {
+        return _queue.size() < kMaxQueued || _closing;
+    });
+    if (_closing)
+    {
+        return;
+    }
+    _queue.push_back(std::move(track));
+    _work_ready.notify_one();
+}
+
+void LibraryScanner::finish()
+{
+    join();
+}
+
+void LibraryScanner::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+    }
+    join();
+}
+
+void LibraryScanner::join()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closing = true;
+    }
+    _work_ready.notify_all();
+    _space_ready.notify_all();
+
+    for (std::thread& worker : _workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    _results_ready.notify_all();
+    if (_writer.joinable())
+    {
+        _writer.join();
+    }
+}
+
+void LibraryScanner::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _work_ready.wait(lock, [this]()
+        {
+            return !_queue.empty() || _closing;
+        });
+        if (_queue.empty())
+        {
+            break;
+        }
+
+        library_track track = std::move(_queue.front());
+        _queue.pop_front();
+        ++_busy;
+        _space_ready.notify_one();
+        lock.unlock();
+
+        read_track_metadata(track.path, track.metadata);
+
+        lock.lock();
+        --_busy;
+        _results.push_back(std::move(track));
+        if (_results.size() >= kBatchSize)
+        {
+            _results_ready.notify_one();
+        }
+    }
+
+    if (_busy == 0)
+    {
+        _results_ready.notify_all();
+    }
+}
+
+void LibraryScanner::writer_loop()
+{
+    // Commits at least every 100 ms so progress keeps moving on slow disks.
+    std::vector<library_track> batch;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _results_ready.wait_for(lock, std::chrono::milliseconds(100), [this]()
+        {
+            return _results.size() >= kBatchSize || (_closing && _queue.empty() && _busy == 0);
+        });
+
+        const bool done = _closing && _queue.empty() && _busy == 0;
+        if (!_results.empty())
+        {
+            batch.swap(_results);
+            lock.unlock();
+            _commit(batch);
+            batch.clear();
+            lock.lock();
+            continue;
+        }
+        if (done)
+        {
+            break;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "library.h"
+
+// Reads tags for the tracks a directory walk submits on a pool of worker
+// threads, handing finished tracks to `commit` in batches from one writer
+// thread so the index lock is taken once per batch rather than per file.
+class LibraryScanner
+{
+public:
+    using commit_function = std::function<void(std::vector<library_track>&)>;
+
+    LibraryScanner(int thread_count, commit_function commit);
+    ~LibraryScanner();
+
+    LibraryScanner(const LibraryScanner&) = delete;
+    LibraryScanner& operator=(const LibraryScanner&) = delete;
+
+    // Blocks while the queue is full, so a fast walk over a slow disk
+    // doesn't hold the whole library in memory.
+    void submit(library_track track);
+
+    // Waits for every submitted track to be read and committed.
+    void finish();
+    // Drops queued tracks and waits for the ones already being read.
+    void cancel();
+
+    static int resolve_thread_count(int requested);
+
+private:
+    void worker_loop();
+    void writer_loop();
+    void join();
+
+    static constexpr size_t kMaxQueued = 4096;
+    static constexpr size_t kBatchSize = 256;
+
+    commit_function _commit;
+    std::mutex _mutex;
+    std::condition_variable _work_ready;
+    std::condition_variable _space_ready;
+    std::condition_variable _results_ready;
+    std::deque<library_track> _queue;
+    std::vector<library_track> _results;
+    size_t _busy = 0;
+    bool _closing = false;
+    std::vector<std::thread> _workers;
+    std::thread _writer;
+};
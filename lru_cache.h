@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace wynott {
+
+// Bounded map that drops its least recently used entry once it holds more
+// than `capacity`. find() and insert() mark an entry as used in O(1); peek()
+// looks without reordering. Not thread-safe; owners lock around it.
+template <typename Key, typename T>
+class lru_cache {
+public:
+    explicit lru_cache(size_t capacity)
+        : _capacity(capacity) {}
+
+    lru_cache() = delete;
+
+    T* find(const Key& key)
+    {
+        auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            return nullptr;
+        }
+        _order.splice(_order.begin(), _order, it->second);
+        return &it->second->second;
+    }
+
+    const T* peek(const Key& key) const
+    {
+        auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            return nullptr;
+        }
+        return &it->second->second;
+    }
+
+    T& insert(const Key& key, T value)
+    {
+        auto it = _index.find(key);
+        if (it != _index.end())
+        {
+            it->second->second = std::move(value);
+            _order.splice(_order.begin(), _order, it->second);
+            return it->second->second;
+        }
+
+        _order.emplace_front(key, std::move(value));
+        _index.emplace(key, _order.begin());
+        while (_order.size() > _capacity && _order.size() > 1)
+        {
+            _index.erase(_order.back().first);
+            _order.pop_back();
+        }
+        return _order.front().second;
+    }
+
+    void erase(const Key& key)
+    {
+        auto it = _index.find(key);
+        if (it == _index.end())
+        {
+            return;
+        }
+        _order.erase(it->second);
+        _index.erase(it);
+    }
+
+    void clear()
+    {
+        _index.clear();
+        _order.clear();
+    }
+
+    size_t size() const
+    {
+        return _order.size();
+    }
+
+private:
+    using entry_list = std::list<std::pair<Key, T>>;
+
+    size_t _capacity;
+    entry_list _order;
+    std::unordered_map<Key, typename entry_list::iterator> _index;
+};
+
+} // namespace wynott
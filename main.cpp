@@ -1,12 +1,76 @@
 #include "app.h"
+#include "bench.h"
+#include "config.h"
+#include "library.h"
 #include "logging.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
 #include <spdlog/spdlog.h>
 
-int main()
+int main(int argc, char** argv)
 {
     init_logging(spdlog::level::info);
 
+    if (argc > 1)
+    {
+        std::string mode = argv[1];
+        if (mode == "--bench-terminal")
+        {
+            int result = run_terminal_benchmark();
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--bench-composite")
+        {
+            int result = run_composite_benchmark();
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--bench-events")
+        {
+            int result = run_event_benchmark();
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--bench-render")
+        {
+            int result = run_render_benchmark(argc - 2, argv + 2);
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--check-allocs")
+        {
+            int result = run_alloc_check(argc - 2, argv + 2);
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--check-library")
+        {
+            int result = run_library_check();
+            shutdown_logging();
+            return result;
+        }
+        if (mode == "--scan")
+        {
+            // agmp --scan [library_path] [threads]
+            app_config config = load_config("config.toml");
+            if (argc > 2)
+            {
+                config.library_path = argv[2];
+            }
+            if (argc > 3)
+            {
+                config.library_scan_threads = std::max(0, std::atoi(argv[3]));
+            }
+            int result = run_library_scan(config);
+            shutdown_logging();
+            return result;
+        }
+    }
+
     auto& app = ActuallyGoodMP::instance();
     app.init();
     app.run();
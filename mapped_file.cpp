@@ -0,0 +1,287 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include "miniaudio.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+#if defined(_WIN32)
+    if (_data)
+    {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping)
+    {
+        CloseHandle(static_cast<HANDLE>(_mapping));
+    }
+#else
+    if (_data)
+    {
+        munmap(const_cast<uint8_t*>(_data), _size);
+    }
+#endif
+}
+
+bool MappedFile::map(const std::string& path)
+{
+    _path = path;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    _mapping = mapping;
+    _data = static_cast<const uint8_t*>(data);
+    _size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file referenced, so the descriptor can go now.
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    _data = static_cast<const uint8_t*>(data);
+    _size = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+const uint8_t* MappedFile::data() const
+{
+    return _data;
+}
+
+size_t MappedFile::size() const
+{
+    return _size;
+}
+
+const std::string& MappedFile::path() const
+{
+    return _path;
+}
+
+void MappedFile::advise_sequential() const
+{
+#if !defined(_WIN32)
+    if (_data)
+    {
+        madvise(const_cast<uint8_t*>(_data), _size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+namespace
+{
+    struct mapped_vfs_file
+    {
+        mapped_file_ptr file;
+        size_t cursor = 0;
+    };
+
+    ma_result vfs_open(ma_vfs*, const char* path, ma_uint32 open_mode, ma_vfs_file* out)
+    {
+        if (!path || !out)
+        {
+            return MA_INVALID_ARGS;
+        }
+        *out = nullptr;
+        if ((open_mode & MA_OPEN_MODE_WRITE) != 0)
+        {
+            return MA_ACCESS_DENIED;
+        }
+
+        mapped_file_ptr file = MappedFileCache::instance().open(path);
+        if (!file)
+        {
+            return MA_DOES_NOT_EXIST;
+        }
+        file->advise_sequential();
+
+        auto* handle = new mapped_vfs_file();
+        handle->file = std::move(file);
+        *out = handle;
+        return MA_SUCCESS;
+    }
+
+    ma_result vfs_close(ma_vfs*, ma_vfs_file file)
+    {
+        delete static_cast<mapped_vfs_file*>(file);
+        return MA_SUCCESS;
+    }
+
+    ma_result vfs_read(ma_vfs*, ma_vfs_file file, void* dst, size_t size, size_t* bytes_read)
+    {
+        auto* handle = static_cast<mapped_vfs_file*>(file);
+        size_t available = handle->file->size() - std::min(handle->cursor, handle->file->size());
+        size_t count = std::min(size, available);
+        if (count > 0)
+        {
+            std::memcpy(dst, handle->file->data() + handle->cursor, count);
+            handle->cursor += count;
+        }
+        if (bytes_read)
+        {
+            *bytes_read = count;
+        }
+        if (count == 0 && size > 0)
+        {
+            return MA_AT_END;
+        }
+        return MA_SUCCESS;
+    }
+
+    ma_result vfs_write(ma_vfs*, ma_vfs_file, const void*, size_t, size_t* bytes_written)
+    {
+        if (bytes_written)
+        {
+            *bytes_written = 0;
+        }
+        return MA_ACCESS_DENIED;
+    }
+
+    ma_result vfs_seek(ma_vfs*, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin)
+    {
+        auto* handle = static_cast<mapped_vfs_file*>(file);
+        ma_int64 base = 0;
+        if (origin == ma_seek_origin_current)
+        {
+            base = static_cast<ma_int64>(handle->cursor);
+        }
+        else if (origin == ma_seek_origin_end)
+        {
+            base = static_cast<ma_int64>(handle->file->size());
+        }
+
+        ma_int64 target = base + offset;
+        if (target < 0 || target > static_cast<ma_int64>(handle->file->size()))
+        {
+            return MA_BAD_SEEK;
+        }
+        handle->cursor = static_cast<size_t>(target);
+        return MA_SUCCESS;
+    }
+
+    ma_result vfs_tell(ma_vfs*, ma_vfs_file file, ma_int64* cursor)
+    {
+        *cursor = static_cast<ma_int64>(static_cast<mapped_vfs_file*>(file)->cursor);
+        return MA_SUCCESS;
+    }
+
+    ma_result vfs_info(ma_vfs*, ma_vfs_file file, ma_file_info* info)
+    {
+        info->sizeInBytes = static_cast<ma_uint64>(static_cast<mapped_vfs_file*>(file)->file->size());
+        return MA_SUCCESS;
+    }
+
+    // miniaudio only needs the callbacks at the start of the object.
+    ma_vfs_callbacks mapped_vfs = {
+        vfs_open,
+        nullptr,
+        vfs_close,
+        vfs_read,
+        vfs_write,
+        vfs_seek,
+        vfs_tell,
+        vfs_info,
+    };
+}
+
+MappedFileCache& MappedFileCache::instance()
+{
+    static MappedFileCache cache;
+    return cache;
+}
+
+mapped_file_ptr MappedFileCache::open(const std::string& path)
+{
+    std::error_code error;
+    auto write_time = std::filesystem::last_write_time(path, error);
+    if (error)
+    {
+        return nullptr;
+    }
+    auto size = std::filesystem::file_size(path, error);
+    if (error)
+    {
+        return nullptr;
+    }
+    const int64_t modified_time = static_cast<int64_t>(write_time.time_since_epoch().count());
+    const int64_t file_size = static_cast<int64_t>(size);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Entry* entry = _entries.find(path);
+        if (entry
+            && entry->modified_time == modified_time
+            && entry->file_size == file_size)
+        {
+            return entry->file;
+        }
+    }
+
+    // Map outside the lock; a racing open of the same path replaces the entry.
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    if (!mapped->map(path))
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.insert(path, Entry{std::move(mapped), modified_time, file_size}).file;
+}
+
+void* MappedFileCache::vfs()
+{
+    return &mapped_vfs;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "lru_cache.h"
+
+// A read-only mapping of a whole file. The mapping is released when the last
+// reference goes away, so a decoder keeps its file mapped even after the
+// cache has moved on.
+class MappedFile
+{
+public:
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const;
+    size_t size() const;
+    const std::string& path() const;
+
+    // Hints that the file will be read front to back, as a decoder does.
+    void advise_sequential() const;
+
+private:
+    friend class MappedFileCache;
+
+    MappedFile() = default;
+    bool map(const std::string& path);
+
+    std::string _path;
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+#if defined(_WIN32)
+    void* _mapping = nullptr;
+#endif
+};
+
+using mapped_file_ptr = std::shared_ptr<const MappedFile>;
+
+// The most recently opened mappings, so the player, waveform, metadata and
+// art readers share one mapping of the current and next track.
+class MappedFileCache
+{
+public:
+    static MappedFileCache& instance();
+
+    mapped_file_ptr open(const std::string& path);
+
+    // An ma_vfs serving miniaudio's file reads from the shared mappings.
+    void* vfs();
+
+    MappedFileCache(const MappedFileCache&) = delete;
+    MappedFileCache& operator=(const MappedFileCache&) = delete;
+
+private:
+    MappedFileCache() = default;
+
+    struct Entry
+    {
+        mapped_file_ptr file;
+        int64_t modified_time = 0;
+        int64_t file_size = 0;
+    };
+
+    static constexpr size_t kMaxEntries = 4;
+
+    std::mutex _mutex;
+    wynott::lru_cache<std::string, Entry> _entries{kMaxEntries};
+};
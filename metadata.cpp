@@ -1,242 +1,218 @@
 #include "metadata.h"
 
 #include <filesystem>
-#include <fstream>
 #include <vector>
 
 #include "draw.h"
+#include "id3.h"
+#include "library.h"
+#include "mapped_file.h"
 #include "miniaudio.h"
+#include "mp3.h"
 
-static uint32_t read_be32(const uint8_t* data)
+static void read_decoder_info(const std::string& path, track_metadata& metadata)
 {
-    return (static_cast<uint32_t>(data[0]) << 24) |
-           (static_cast<uint32_t>(data[1]) << 16) |
-           (static_cast<uint32_t>(data[2]) << 8) |
-           static_cast<uint32_t>(data[3]);
-}
+    ma_decoder decoder;
+    ma_result result = ma_decoder_init_vfs(MappedFileCache::instance().vfs(), path.c_str(), NULL, &decoder);
+    if (result != MA_SUCCESS)
+    {
+        return;
+    }
 
-static uint32_t read_syncsafe32(const uint8_t* data)
-{
-    return (static_cast<uint32_t>(data[0]) << 21) |
-           (static_cast<uint32_t>(data[1]) << 14) |
-           (static_cast<uint32_t>(data[2]) << 7) |
-           static_cast<uint32_t>(data[3]);
+    metadata.sample_rate = static_cast<int>(decoder.outputSampleRate);
+    metadata.channels = static_cast<int>(decoder.outputChannels);
+
+    ma_uint64 frames = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&decoder, &frames) == MA_SUCCESS)
+    {
+        metadata.duration_frames = static_cast<int64_t>(frames);
+        if (decoder.outputSampleRate > 0)
+        {
+            metadata.duration_ms = static_cast<int>((frames * 1000) / decoder.outputSampleRate);
+        }
+    }
+
+    ma_decoder_uninit(&decoder);
+
+    if (metadata.duration_ms > 0 && metadata.file_size_bytes > 0)
+    {
+        double seconds = static_cast<double>(metadata.duration_ms) / 1000.0;
+        double kbps = (static_cast<double>(metadata.file_size_bytes) * 8.0 / 1000.0) / seconds;
+        metadata.bitrate_kbps = static_cast<int>(kbps + 0.5);
+    }
 }
 
-static std::string decode_text(const uint8_t* data, size_t size, uint8_t encoding)
+bool read_track_metadata(const std::string& path, track_metadata& metadata)
 {
-    if (size == 0)
+    metadata = {};
+    metadata.sample_rate = 0;
+    metadata.channels = 0;
+    metadata.duration_ms = 0;
+    metadata.duration_frames = 0;
+    metadata.file_size_bytes = 0;
+    metadata.bitrate_kbps = 0;
+
+    try
     {
-        return std::string();
+        metadata.file_size_bytes = static_cast<long long>(std::filesystem::file_size(path));
     }
-
-    if (encoding == 0 || encoding == 3)
+    catch (...)
     {
-        return std::string(reinterpret_cast<const char*>(data), reinterpret_cast<const char*>(data + size));
     }
 
-    bool little_endian = true;
-    size_t offset = 0;
-    if (encoding == 1 && size >= 2)
+    // MP3 headers give duration and bitrate directly; only other formats,
+    // or streams the header reader can't make sense of, need a decoder.
+    mp3_stream_info stream;
+    mapped_file_ptr file = MappedFileCache::instance().open(path);
+    if (file && read_mp3_stream_info(file->data(), file->size(), stream))
     {
-        uint16_t bom = static_cast<uint16_t>(data[0] << 8) | static_cast<uint16_t>(data[1]);
-        if (bom == 0xFEFF)
-        {
-            little_endian = false;
-            offset = 2;
-        }
-        else if (bom == 0xFFFE)
-        {
-            little_endian = true;
-            offset = 2;
-        }
+        metadata.sample_rate = stream.sample_rate;
+        metadata.channels = stream.channels;
+        metadata.duration_ms = static_cast<int>((stream.total_frames * 1000) / static_cast<uint64_t>(stream.sample_rate));
+        metadata.duration_frames = static_cast<int64_t>(stream.total_frames);
+        metadata.bitrate_kbps = stream.bitrate_kbps;
     }
-    else if (encoding == 2)
+    else
     {
-        little_endian = false;
+        read_decoder_info(path, metadata);
     }
 
-    std::string result;
-    result.reserve(size / 2);
-    for (size_t i = offset; i + 1 < size; i += 2)
+    id3_tags tags;
+    if (read_id3_tags(path, tags))
     {
-        uint16_t code = little_endian
-            ? static_cast<uint16_t>(data[i] | (data[i + 1] << 8))
-            : static_cast<uint16_t>((data[i] << 8) | data[i + 1]);
-        if (code == 0)
-        {
-            break;
-        }
-        if (code <= 0xFF)
-        {
-            result.push_back(static_cast<char>(code));
-        }
-        else
-        {
-            result.push_back('?');
-        }
+        metadata.title = std::move(tags.title);
+        metadata.artist = std::move(tags.artist);
+        metadata.album = std::move(tags.album);
+        metadata.date = std::move(tags.date);
+        metadata.genre = std::move(tags.genre);
+        metadata.track = std::move(tags.track);
+        metadata.art = tags.picture;
     }
-    return result;
+    metadata.art_located = true;
+    return true;
 }
 
-static void parse_id3_text(const std::vector<uint8_t>& tag_data, uint8_t version, track_metadata& metadata)
+bool read_file_stamp(const std::string& path, int64_t& modified_time, int64_t& file_size)
 {
-    size_t offset = 0;
-    while (offset + 10 <= tag_data.size())
-    {
-        const uint8_t* frame = tag_data.data() + offset;
-        if (frame[0] == 0 && frame[1] == 0 && frame[2] == 0 && frame[3] == 0)
-        {
-            break;
-        }
-
-        uint32_t frame_size = (version == 4)
-            ? read_syncsafe32(frame + 4)
-            : read_be32(frame + 4);
-        if (frame_size == 0)
-        {
-            break;
-        }
-
-        size_t data_offset = offset + 10;
-        if (data_offset + frame_size > tag_data.size())
-        {
-            break;
-        }
-
-        const char id0 = static_cast<char>(frame[0]);
-        const char id1 = static_cast<char>(frame[1]);
-        const char id2 = static_cast<char>(frame[2]);
-        const char id3 = static_cast<char>(frame[3]);
-
-        const uint8_t* data = tag_data.data() + data_offset;
-        if (frame_size > 1)
-        {
-            uint8_t encoding = data[0];
-            std::string value = decode_text(data + 1, frame_size - 1, encoding);
-
-            if (id0 == 'T' && id1 == 'I' && id2 == 'T' && id3 == '2')
-            {
-                metadata.title = value;
-            }
-            else if (id0 == 'T' && id1 == 'P' && id2 == 'E' && id3 == '1')
-            {
-                metadata.artist = value;
-            }
-            else if (id0 == 'T' && id1 == 'A' && id2 == 'L' && id3 == 'B')
-            {
-                metadata.album = value;
-            }
-            else if ((id0 == 'T' && id1 == 'Y' && id2 == 'E' && id3 == 'R') ||
-                     (id0 == 'T' && id1 == 'D' && id2 == 'R' && id3 == 'C'))
-            {
-                metadata.date = value;
-            }
-            else if (id0 == 'T' && id1 == 'C' && id2 == 'O' && id3 == 'N')
-            {
-                metadata.genre = value;
-            }
-            else if (id0 == 'T' && id1 == 'R' && id2 == 'C' && id3 == 'K')
-            {
-                metadata.track = value;
-            }
-        }
-
-        offset += 10 + static_cast<size_t>(frame_size);
-    }
+    return read_file_stamp(std::filesystem::path(path), modified_time, file_size);
 }
 
-static void read_id3_tags(const std::string& path, track_metadata& metadata)
+bool read_file_stamp(const std::filesystem::path& file_path, int64_t& modified_time, int64_t& file_size)
 {
-    std::ifstream file(path, std::ios::binary);
-    if (!file)
+    std::error_code error;
+    auto write_time = std::filesystem::last_write_time(file_path, error);
+    if (error)
     {
-        return;
+        return false;
     }
 
-    file.seekg(0, std::ios::end);
-    std::streamoff file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    uint8_t header[10] = {};
-    file.read(reinterpret_cast<char*>(header), sizeof(header));
-    if (file.gcount() != static_cast<std::streamsize>(sizeof(header)))
+    auto size = std::filesystem::file_size(file_path, error);
+    if (error)
     {
-        return;
+        return false;
     }
 
-    if (header[0] != 'I' || header[1] != 'D' || header[2] != '3')
+    modified_time = static_cast<int64_t>(write_time.time_since_epoch().count());
+    file_size = static_cast<int64_t>(size);
+    return true;
+}
+
+MetadataCache& MetadataCache::instance()
+{
+    static MetadataCache cache;
+    return cache;
+}
+
+track_metadata_ptr MetadataCache::get(const std::string& path)
+{
+    if (path.empty())
     {
-        return;
+        return nullptr;
     }
 
-    uint8_t version = header[3];
-    uint32_t tag_size = read_syncsafe32(&header[6]);
-    const uint32_t max_tag_size = 16 * 1024 * 1024;
-    if (tag_size == 0 || tag_size > max_tag_size)
+    int64_t modified_time = 0;
+    int64_t file_size = 0;
+    if (!read_file_stamp(path, modified_time, file_size))
     {
-        return;
+        return nullptr;
     }
-    if (file_size > 0 && static_cast<std::streamoff>(tag_size) > file_size - 10)
+
     {
-        return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        const Entry* entry = _entries.find(path);
+        if (entry
+            && entry->modified_time == modified_time
+            && entry->file_size == file_size)
+        {
+            return entry->metadata;
+        }
     }
 
-    std::vector<uint8_t> tag_data(tag_size);
-    file.read(reinterpret_cast<char*>(tag_data.data()), static_cast<std::streamsize>(tag_data.size()));
-    if (file.gcount() != static_cast<std::streamsize>(tag_data.size()))
+    auto metadata = std::make_shared<track_metadata>();
+    if (!LibraryIndex::instance().find_track(path, modified_time, file_size, *metadata)
+        && !read_track_metadata(path, *metadata))
     {
-        return;
+        return nullptr;
     }
 
-    parse_id3_text(tag_data, version, metadata);
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.insert(path, Entry{modified_time, file_size, std::move(metadata)}).metadata;
 }
 
-bool read_track_metadata(const std::string& path, track_metadata& metadata)
+track_metadata_ptr MetadataCache::find(const std::string& path) const
 {
-    metadata = {};
-    metadata.sample_rate = 0;
-    metadata.channels = 0;
-    metadata.duration_ms = 0;
-    metadata.file_size_bytes = 0;
-    metadata.bitrate_kbps = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    const Entry* entry = _entries.peek(path);
+    return entry ? entry->metadata : nullptr;
+}
 
-    try
+void MetadataCache::prefetch(const std::vector<std::string>& paths)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_prefetch_task)
     {
-        metadata.file_size_bytes = static_cast<long long>(std::filesystem::file_size(path));
+        _prefetch_task->cancel();
+        _prefetch_task.reset();
     }
-    catch (...)
+
+    std::vector<std::string> missing;
+    for (const auto& path : paths)
+    {
+        if (!path.empty() && !_entries.peek(path))
+        {
+            missing.push_back(path);
+        }
+    }
+    if (missing.empty())
     {
+        return;
     }
 
-    ma_decoder decoder;
-    ma_result result = ma_decoder_init_file(path.c_str(), NULL, &decoder);
-    if (result == MA_SUCCESS)
+    _prefetch_task = TaskScheduler::instance().submit(
+        task_priority::low,
+        [this, missing = std::move(missing)](const TaskToken& token)
     {
-        metadata.sample_rate = static_cast<int>(decoder.outputSampleRate);
-        metadata.channels = static_cast<int>(decoder.outputChannels);
-
-        ma_uint64 frames = 0;
-        if (ma_decoder_get_length_in_pcm_frames(&decoder, &frames) == MA_SUCCESS)
+        for (const auto& path : missing)
         {
-            if (decoder.outputSampleRate > 0)
+            if (token.is_cancelled())
             {
-                metadata.duration_ms = static_cast<int>((frames * 1000) / decoder.outputSampleRate);
+                return;
             }
+            get(path);
         }
+    });
+}
 
-        ma_decoder_uninit(&decoder);
-    }
-
-    if (metadata.duration_ms > 0 && metadata.file_size_bytes > 0)
-    {
-        double seconds = static_cast<double>(metadata.duration_ms) / 1000.0;
-        double kbps = (static_cast<double>(metadata.file_size_bytes) * 8.0 / 1000.0) / seconds;
-        metadata.bitrate_kbps = static_cast<int>(kbps + 0.5);
-    }
+void MetadataCache::invalidate(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.erase(path);
+}
 
-    read_id3_tags(path, metadata);
-    return true;
+void MetadataCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
 }
 
 MetadataPanel::MetadataPanel() = default;
@@ -247,26 +223,29 @@ MetadataPanel::MetadataPanel(const glm::ivec2& location, const glm::ivec2& size)
     ActuallyGoodModule::set_size(size);
 }
 
-void MetadataPanel::draw(const app_config& config, const track_metadata& meta)
+void MetadataPanel::build_lines(const track_metadata& meta)
 {
-    if (_size.x <= 0 || _size.y <= 0)
+    _lines.clear();
+    if (!meta.title.empty()) _lines.push_back("Title: " + meta.title);
+    if (!meta.artist.empty()) _lines.push_back("Artist: " + meta.artist);
+    if (!meta.album.empty()) _lines.push_back("Album: " + meta.album);
+    if (!meta.date.empty()) _lines.push_back("Date: " + meta.date);
+    if (!meta.genre.empty()) _lines.push_back("Genre: " + meta.genre);
+    if (!meta.track.empty()) _lines.push_back("Track: " + meta.track);
+    if (meta.sample_rate > 0) _lines.push_back("Hz: " + std::to_string(meta.sample_rate));
+    if (meta.channels > 0) _lines.push_back("Channels: " + std::to_string(meta.channels));
+    if (meta.duration_ms > 0) _lines.push_back("Length: " + std::to_string(meta.duration_ms / 1000) + "s");
+    if (meta.bitrate_kbps > 0) _lines.push_back("Bitrate: " + std::to_string(meta.bitrate_kbps) + " kbps");
+    if (meta.file_size_bytes > 0) _lines.push_back("Size: " + std::to_string(meta.file_size_bytes / 1024) + " KB");
+}
+
+void MetadataPanel::draw(const app_config& config, const track_metadata_ptr& meta)
+{
+    if (_size.x <= 0 || _size.y <= 0 || !meta)
     {
         return;
     }
 
-    std::vector<std::string> lines;
-    if (!meta.title.empty()) lines.push_back("Title: " + meta.title);
-    if (!meta.artist.empty()) lines.push_back("Artist: " + meta.artist);
-    if (!meta.album.empty()) lines.push_back("Album: " + meta.album);
-    if (!meta.date.empty()) lines.push_back("Date: " + meta.date);
-    if (!meta.genre.empty()) lines.push_back("Genre: " + meta.genre);
-    if (!meta.track.empty()) lines.push_back("Track: " + meta.track);
-    if (meta.sample_rate > 0) lines.push_back("Hz: " + std::to_string(meta.sample_rate));
-    if (meta.channels > 0) lines.push_back("Channels: " + std::to_string(meta.channels));
-    if (meta.duration_ms > 0) lines.push_back("Length: " + std::to_string(meta.duration_ms / 1000) + "s");
-    if (meta.bitrate_kbps > 0) lines.push_back("Bitrate: " + std::to_string(meta.bitrate_kbps) + " kbps");
-    if (meta.file_size_bytes > 0) lines.push_back("Size: " + std::to_string(meta.file_size_bytes / 1024) + " KB");
-
     int inner_width = std::max(0, _size.x - 2);
     int inner_height = std::max(0, _size.y - 2);
 
@@ -283,23 +262,34 @@ void MetadataPanel::draw(const app_config& config, const track_metadata& meta)
     inner_width = std::max(0, actual_size.x - 2);
     inner_height = std::max(0, actual_size.y - 2);
 
-    int max_lines = std::min(inner_height, static_cast<int>(lines.size()));
-    for (int i = 0; i < max_lines; ++i)
+    int max_width = inner_width;
+    if (config.metadata_max_width > 0)
     {
-        std::string line = lines[static_cast<size_t>(i)];
-        int max_width = inner_width;
-        if (config.metadata_max_width > 0)
-        {
-            max_width = std::min(max_width, config.metadata_max_width);
-        }
-        if (max_width > 0 && static_cast<int>(line.size()) > max_width)
+        max_width = std::min(max_width, config.metadata_max_width);
+    }
+
+    // Lines are cut to width once per track rather than every frame.
+    if (meta != _lines_source || max_width != _lines_width)
+    {
+        build_lines(*meta);
+        for (std::string& line : _lines)
         {
-            line.resize(static_cast<size_t>(max_width));
+            if (max_width > 0 && static_cast<int>(line.size()) > max_width)
+            {
+                line.resize(static_cast<size_t>(max_width));
+            }
         }
-        
+        _lines_source = meta;
+        _lines_width = max_width;
+    }
+
+    int max_lines = std::min(inner_height, static_cast<int>(_lines.size()));
+    for (int i = 0; i < max_lines; ++i)
+    {
+        glm::ivec2 line_location(_location.x + 1, _location.y + 1 + i);
         if (auto renderer = Renderer::get())
         {
-            renderer->draw_string(line, glm::ivec2(_location.x + 1, _location.y + 1 + i));
+            renderer->draw_string(_lines[static_cast<size_t>(i)], line_location);
         }
     }
 }
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <glm/vec2.hpp>
 
@@ -8,6 +13,9 @@
 
 #include "actually_good_module.h"
 #include "config.h"
+#include "id3.h"
+#include "lru_cache.h"
+#include "task_scheduler.h"
 
 class Renderer;
 
@@ -22,11 +30,52 @@ struct track_metadata
     int sample_rate;
     int channels;
     int duration_ms;
+    // PCM frames at sample_rate, as the decoder will deliver them.
+    int64_t duration_frames;
     int64_t file_size_bytes;
     int bitrate_kbps;
+    // Set when the tag was read from the file rather than the library
+    // index; art.size is then zero for tracks without embedded art.
+    bool art_located = false;
+    id3_picture art;
 };
 
+using track_metadata_ptr = std::shared_ptr<const track_metadata>;
+
 bool read_track_metadata(const std::string& path, track_metadata& metadata);
+bool read_file_stamp(const std::string& path, int64_t& modified_time, int64_t& file_size);
+bool read_file_stamp(const std::filesystem::path& path, int64_t& modified_time, int64_t& file_size);
+
+class MetadataCache
+{
+public:
+    static MetadataCache& instance();
+
+    track_metadata_ptr get(const std::string& path);
+    track_metadata_ptr find(const std::string& path) const;
+    void prefetch(const std::vector<std::string>& paths);
+    void invalidate(const std::string& path);
+    void clear();
+
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+private:
+    MetadataCache() = default;
+
+    struct Entry
+    {
+        int64_t modified_time = 0;
+        int64_t file_size = 0;
+        track_metadata_ptr metadata;
+    };
+
+    static constexpr size_t kMaxEntries = 4096;
+
+    mutable std::mutex _mutex;
+    wynott::lru_cache<std::string, Entry> _entries{kMaxEntries};
+    task_token_ptr _prefetch_task;
+};
 
 class MetadataPanel : public ActuallyGoodModule
 {
@@ -34,6 +83,12 @@ public:
     MetadataPanel();
     MetadataPanel(const glm::ivec2& location, const glm::ivec2& size);
 
-    void draw(const app_config& config, const track_metadata& meta);
+    void draw(const app_config& config, const track_metadata_ptr& meta);
+
+private:
+    void build_lines(const track_metadata& meta);
 
+    track_metadata_ptr _lines_source;
+    int _lines_width = 0;
+    std::vector<std::string> _lines;
 };
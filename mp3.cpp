@@ -0,0 +1,269 @@
+#include "mp3.h"
+
+#include <cstring>
+
+namespace
+{
+    struct frame_header
+    {
+        int version = 0; // 1 = MPEG-1, 2 = MPEG-2, 3 = MPEG-2.5
+        int layer = 0;
+        int bitrate_kbps = 0;
+        int sample_rate = 0;
+        int channels = 0;
+        int samples = 0;
+        size_t frame_bytes = 0;
+        bool crc = false;
+    };
+
+    const int bitrates_v1[3][16] = {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+    };
+
+    const int bitrates_v2[2][16] = {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+    };
+
+    const int sample_rates_v1[3] = {44100, 48000, 32000};
+
+    // How far past the ID3v2 tag to look for the first frame.
+    const size_t max_sync_search = 64 * 1024;
+
+    uint32_t read_be32(const uint8_t* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) |
+               (static_cast<uint32_t>(data[1]) << 16) |
+               (static_cast<uint32_t>(data[2]) << 8) |
+               static_cast<uint32_t>(data[3]);
+    }
+
+    bool parse_frame_header(const uint8_t* data, frame_header& header)
+    {
+        if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0)
+        {
+            return false;
+        }
+
+        const int version_bits = (data[1] >> 3) & 0x03;
+        const int layer_bits = (data[1] >> 1) & 0x03;
+        const int bitrate_index = data[2] >> 4;
+        const int rate_index = (data[2] >> 2) & 0x03;
+        if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+        {
+            return false;
+        }
+
+        header.version = (version_bits == 3) ? 1 : (version_bits == 2 ? 2 : 3);
+        header.layer = 4 - layer_bits;
+        header.bitrate_kbps = (header.version == 1)
+            ? bitrates_v1[header.layer - 1][bitrate_index]
+            : bitrates_v2[header.layer == 1 ? 0 : 1][bitrate_index];
+        header.sample_rate = sample_rates_v1[rate_index] >> (header.version - 1);
+        header.channels = ((data[3] >> 6) == 3) ? 1 : 2;
+        header.crc = (data[1] & 0x01) == 0;
+
+        const int padding = (data[2] >> 1) & 0x01;
+        const int bitrate = header.bitrate_kbps * 1000;
+        if (header.layer == 1)
+        {
+            header.samples = 384;
+            header.frame_bytes = static_cast<size_t>((12 * bitrate / header.sample_rate + padding) * 4);
+        }
+        else
+        {
+            const bool short_frame = header.layer == 3 && header.version != 1;
+            header.samples = short_frame ? 576 : 1152;
+            header.frame_bytes = static_cast<size_t>((short_frame ? 72 : 144) * bitrate / header.sample_rate + padding);
+        }
+        return header.frame_bytes > 4;
+    }
+
+    // Skips any ID3v2 tags at the start of the stream.
+    size_t skip_id3v2(const uint8_t* data, size_t size)
+    {
+        size_t offset = 0;
+        while (offset + 10 <= size
+            && data[offset] == 'I' && data[offset + 1] == 'D' && data[offset + 2] == '3')
+        {
+            const uint8_t* header = data + offset;
+            size_t tag_size = (static_cast<size_t>(header[6] & 0x7F) << 21) |
+                              (static_cast<size_t>(header[7] & 0x7F) << 14) |
+                              (static_cast<size_t>(header[8] & 0x7F) << 7) |
+                              static_cast<size_t>(header[9] & 0x7F);
+            const bool footer = header[3] == 4 && (header[5] & 0x10) != 0;
+            offset += 10 + tag_size + (footer ? 10 : 0);
+        }
+        return offset;
+    }
+
+    // The first frame header followed by another valid header, which rules
+    // out most false syncs in stray data.
+    bool find_first_frame(const uint8_t* data, size_t size, size_t start, size_t& offset, frame_header& header)
+    {
+        const size_t limit = (size - start > max_sync_search) ? start + max_sync_search : size;
+        for (size_t i = start; i + 4 <= limit; ++i)
+        {
+            if (data[i] != 0xFF || !parse_frame_header(data + i, header))
+            {
+                continue;
+            }
+
+            const size_t next = i + header.frame_bytes;
+            frame_header following;
+            if (next + 4 > size)
+            {
+                // A single frame file is still usable.
+                if (next == size)
+                {
+                    offset = i;
+                    return true;
+                }
+                continue;
+            }
+            if (parse_frame_header(data + next, following)
+                && following.version == header.version
+                && following.layer == header.layer
+                && following.sample_rate == header.sample_rate)
+            {
+                offset = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t side_info_size(const frame_header& header)
+    {
+        if (header.version == 1)
+        {
+            return header.channels == 1 ? 17 : 32;
+        }
+        return header.channels == 1 ? 9 : 17;
+    }
+}
+
+bool read_mp3_stream_info(const uint8_t* data, size_t size, mp3_stream_info& info)
+{
+    info = mp3_stream_info{};
+    if (!data || size < 4)
+    {
+        return false;
+    }
+
+    size_t start = skip_id3v2(data, size);
+    if (start >= size)
+    {
+        return false;
+    }
+
+    size_t first = 0;
+    frame_header header;
+    if (!find_first_frame(data, size, start, first, header))
+    {
+        return false;
+    }
+
+    size_t audio_end = size;
+    if (audio_end >= first + 128 && std::memcmp(data + audio_end - 128, "TAG", 3) == 0)
+    {
+        audio_end -= 128;
+    }
+
+    info.sample_rate = header.sample_rate;
+    info.channels = header.channels;
+
+    const uint8_t* frame = data + first;
+    const size_t frame_end = first + header.frame_bytes;
+    uint64_t frame_count = 0;
+    uint64_t stream_bytes = 0;
+    uint32_t delay = 0;
+    uint32_t padding = 0;
+    bool has_frame_count = false;
+
+    const size_t xing_offset = 4 + (header.crc ? 2 : 0) + side_info_size(header);
+    const size_t vbri_offset = 4 + 32;
+    if (header.layer == 3 && first + xing_offset + 8 <= size
+        && (std::memcmp(frame + xing_offset, "Xing", 4) == 0 || std::memcmp(frame + xing_offset, "Info", 4) == 0))
+    {
+        const bool xing = frame[xing_offset] == 'X';
+        const uint32_t flags = read_be32(frame + xing_offset + 4);
+        size_t cursor = first + xing_offset + 8;
+        if ((flags & 0x01) != 0 && cursor + 4 <= size)
+        {
+            frame_count = read_be32(data + cursor);
+            has_frame_count = true;
+            cursor += 4;
+        }
+        if ((flags & 0x02) != 0 && cursor + 4 <= size)
+        {
+            stream_bytes = read_be32(data + cursor);
+            cursor += 4;
+        }
+        if ((flags & 0x04) != 0)
+        {
+            cursor += 100;
+        }
+        if ((flags & 0x08) != 0)
+        {
+            cursor += 4;
+        }
+
+        // The LAME extension stores the encoder delay and padding 21 bytes
+        // in; the decoder trims both, so the duration does too.
+        if (cursor + 24 <= frame_end && data[cursor] != 0)
+        {
+            const uint8_t* lame = data + cursor + 21;
+            const int encoder_delay = static_cast<int>((static_cast<uint32_t>(lame[0]) << 4) | (lame[1] >> 4)) + 529;
+            const int encoder_padding = static_cast<int>(((static_cast<uint32_t>(lame[1]) & 0x0F) << 8) | lame[2]) - 529;
+            delay = static_cast<uint32_t>(encoder_delay);
+            padding = encoder_padding > 0 ? static_cast<uint32_t>(encoder_padding) : 0;
+        }
+
+        info.vbr = xing;
+        // The Xing frame itself carries no audio.
+        first = frame_end;
+    }
+    else if (header.layer == 3 && first + vbri_offset + 18 <= size
+        && std::memcmp(frame + vbri_offset, "VBRI", 4) == 0)
+    {
+        stream_bytes = read_be32(frame + vbri_offset + 10);
+        frame_count = read_be32(frame + vbri_offset + 14);
+        has_frame_count = true;
+        info.vbr = true;
+        first = frame_end;
+    }
+
+    const uint64_t audio_bytes = audio_end > first ? static_cast<uint64_t>(audio_end - first) : 0;
+    if (has_frame_count && frame_count > 0)
+    {
+        uint64_t total = frame_count * static_cast<uint64_t>(header.samples);
+        total = (total > delay) ? total - delay : 0;
+        total = (total > padding) ? total - padding : 0;
+        info.total_frames = total;
+
+        if (stream_bytes == 0 || stream_bytes > size)
+        {
+            stream_bytes = audio_bytes;
+        }
+        const double seconds = static_cast<double>(frame_count * header.samples) / static_cast<double>(header.sample_rate);
+        if (seconds > 0.0)
+        {
+            info.bitrate_kbps = static_cast<int>(static_cast<double>(stream_bytes) * 8.0 / 1000.0 / seconds + 0.5);
+        }
+    }
+    else
+    {
+        if (info.vbr)
+        {
+            // A VBR header without a frame count says nothing about length.
+            return false;
+        }
+        info.bitrate_kbps = header.bitrate_kbps;
+        info.total_frames = (audio_bytes * 8 * static_cast<uint64_t>(header.sample_rate))
+            / (static_cast<uint64_t>(header.bitrate_kbps) * 1000);
+    }
+    return info.total_frames > 0;
+}
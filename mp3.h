@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct mp3_stream_info
+{
+    int sample_rate = 0;
+    int channels = 0;
+    // PCM frames after the encoder delay and padding recorded by LAME.
+    uint64_t total_frames = 0;
+    int bitrate_kbps = 0;
+    bool vbr = false;
+};
+
+// Reads duration and bitrate from the Xing/Info or VBRI header, or from the
+// first frame of a CBR stream, without decoding any audio. Returns false when
+// the data does not look like MPEG audio.
+bool read_mp3_stream_info(const uint8_t* data, size_t size, mp3_stream_info& info);
@@ -6,49 +6,15 @@
 #include "config.h"
 #include "draw.h"
 #include "event.h"
-#include "spdlog/spdlog.h"
 
 ParticleSystem::ParticleSystem()
 {
+    _particles.reserve(kMaxParticles);
     _debug_subscription = EventBus::instance().subscribe(
-        "debug.particle_emit",
-        [this](const Event& event)
+        topics::particle_emit,
+        [this](const particle_emit_event& event)
         {
-            if (event.payload.empty())
-            {
-                return;
-            }
-
-            size_t comma = event.payload.find(',');
-            if (comma == std::string::npos)
-            {
-                return;
-            }
-            size_t comma2 = event.payload.find(',', comma + 1);
-
-            int x = 0;
-            int y = 0;
-            float norm_x = 0.5f;
-            try
-            {
-                x = std::stoi(event.payload.substr(0, comma));
-                if (comma2 == std::string::npos)
-                {
-                    y = std::stoi(event.payload.substr(comma + 1));
-                }
-                else
-                {
-                    y = std::stoi(event.payload.substr(comma + 1, comma2 - comma - 1));
-                    norm_x = std::stof(event.payload.substr(comma2 + 1));
-                }
-            }
-            catch (...)
-            {
-                return;
-            }
-
-            spdlog::info("particle event");
-            emit_debug(x, y, norm_x);
+            emit_debug(event.x, event.y, event.norm_x);
         });
 }
 
@@ -102,6 +68,11 @@ void ParticleSystem::update(float dt_seconds)
         _particles.end());
 }
 
+bool ParticleSystem::has_particles() const
+{
+    return !_particles.empty();
+}
+
 void ParticleSystem::draw(const app_config& config) const
 {
     auto renderer = Renderer::get();
@@ -161,6 +132,11 @@ void ParticleSystem::clear()
 
 void ParticleSystem::emit_debug(int x, int y, float norm_x)
 {
+    if (_particles.size() >= kMaxParticles)
+    {
+        return;
+    }
+
     Particle particle;
     particle.x = static_cast<float>(x);
     particle.y = static_cast<float>(y);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <vector>
 
 struct app_config;
@@ -15,8 +16,13 @@ public:
     void clear();
     void emit_debug(int x, int y, float norm_x);
     void set_angle_bias(float bias);
+    bool has_particles() const;
 
 private:
+    // Reserved up front; emits past it are dropped rather than growing the
+    // vector mid-frame.
+    static constexpr size_t kMaxParticles = 4096;
+
     struct Particle
     {
         float x = 0.0f;
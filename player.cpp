@@ -2,8 +2,11 @@
 #include "event.h"
 
 #include "browser.h"
+#include "mapped_file.h"
+#include "metadata.h"
 #include "queue.h"
 #include "spectrum_analyzer.h"
+#include "task_scheduler.h"
 
 #include <filesystem>
 #include "player.h"
@@ -11,19 +14,254 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
 #include <thread>
 
+#include <spdlog/spdlog.h>
+
+static constexpr int kSoundSlots = 4;
+static constexpr ma_uint64 kStartNever = ~static_cast<ma_uint64>(0);
+
+struct sound_slot
+{
+    ma_sound sound;
+    std::string path;
+    bool loaded = false;
+    uint64_t last_used = 0;
+    // Filled on the UI thread by cache_slot_length(); 0 until known.
+    bool length_resolved = false;
+    bool length_requested = false;
+    std::atomic<ma_uint64> length{0};
+    std::atomic<ma_uint32> sample_rate{0};
+};
+
 static ma_engine g_engine;
-static ma_sound g_sound;
+static int g_engine_initialized = 0;
+static sound_slot g_slots[kSoundSlots];
+static uint64_t g_slot_clock = 0;
+static std::atomic<int> g_current_slot{0};
+static std::atomic<int> g_next_slot{-1};
+static std::atomic<int> g_next_armed{0};
+static std::atomic<int> g_scheduling{0};
+static std::atomic<int> g_paused{0};
 static int g_initialized = 0;
-static int g_paused = 0;
+static float g_volume = 1.0f;
 static SpectrumAnalyzer* g_spectrum_analyzer = nullptr;
 static int g_engine_channels = 0;
 
+static std::atomic<int> g_start_pending{0};
+static std::atomic<int64_t> g_start_requested_ns{0};
+static std::atomic<int64_t> g_first_frame_ns{0};
+static double g_pending_load_ms = 0.0;
+static player_latency_stats g_latency;
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ma_sound* current_sound()
+{
+    return &g_slots[g_current_slot.load(std::memory_order_acquire)].sound;
+}
+
+// Takes a slot's length and sample rate from the track's metadata, which
+// comes from the stream headers. Asking miniaudio instead would count frames
+// on the decoder the audio thread is reading from. On a cache miss the
+// metadata is read once on a worker and picked up on a later frame.
+static void cache_slot_length(int slot)
+{
+    sound_slot& entry = g_slots[slot];
+    if (!entry.loaded || entry.length_resolved)
+    {
+        return;
+    }
+
+    track_metadata_ptr metadata = MetadataCache::instance().find(entry.path);
+    if (!metadata)
+    {
+        if (!entry.length_requested)
+        {
+            entry.length_requested = true;
+            TaskScheduler::instance().submit(
+                task_priority::normal,
+                [path = entry.path](const TaskToken&)
+            {
+                MetadataCache::instance().get(path);
+            });
+        }
+        return;
+    }
+
+    ma_uint64 length = 0;
+    ma_uint32 sample_rate = metadata->sample_rate > 0 ? static_cast<ma_uint32>(metadata->sample_rate) : 0;
+    if (sample_rate > 0)
+    {
+        length = metadata->duration_frames > 0
+            ? static_cast<ma_uint64>(metadata->duration_frames)
+            : static_cast<ma_uint64>(metadata->duration_ms) * sample_rate / 1000;
+    }
+    // Resolved even when the length is unknown; the handoff then falls back
+    // to starting the next sound once the current one reaches its end.
+    entry.length_resolved = true;
+    entry.sample_rate.store(sample_rate, std::memory_order_relaxed);
+    entry.length.store(length, std::memory_order_release);
+}
+
+// Runs on the audio thread after each engine read, when the current sound's
+// cursor and the engine clock agree, so the next sound starts on the exact
+// frame the current one runs out.
+static void schedule_next_sound()
+{
+    g_scheduling.store(1);
+    if (g_next_armed.load())
+    {
+        sound_slot& current = g_slots[g_current_slot.load(std::memory_order_acquire)];
+        ma_sound* next = &g_slots[g_next_slot.load(std::memory_order_acquire)].sound;
+        if (!ma_sound_at_end(&current.sound))
+        {
+            ma_uint64 start = kStartNever;
+            ma_uint64 cursor = 0;
+            ma_uint64 length = current.length.load(std::memory_order_acquire);
+            if (!g_paused.load(std::memory_order_relaxed)
+                && length > 0
+                && ma_sound_get_cursor_in_pcm_frames(&current.sound, &cursor) == MA_SUCCESS)
+            {
+                // The cursor and length count the file's frames; the engine
+                // clock counts the device's.
+                ma_uint64 remaining = (length > cursor) ? length - cursor : 0;
+                ma_uint32 sound_rate = current.sample_rate.load(std::memory_order_relaxed);
+                ma_uint32 engine_rate = ma_engine_get_sample_rate(&g_engine);
+                if (sound_rate != engine_rate)
+                {
+                    remaining = remaining * engine_rate / sound_rate;
+                }
+                start = ma_engine_get_time_in_pcm_frames(&g_engine) + remaining;
+            }
+            ma_sound_set_start_time_in_pcm_frames(next, start);
+        }
+    }
+    g_scheduling.store(0, std::memory_order_release);
+}
+
+static void disarm_next_sound()
+{
+    g_next_armed.store(0);
+    while (g_scheduling.load())
+    {
+        std::this_thread::yield();
+    }
+}
+
+static void unload_slot(int slot)
+{
+    sound_slot& entry = g_slots[slot];
+    if (!entry.loaded)
+    {
+        return;
+    }
+    ma_sound_uninit(&entry.sound);
+    entry.loaded = false;
+    entry.path.clear();
+    entry.length_resolved = false;
+    entry.length_requested = false;
+    entry.length.store(0, std::memory_order_relaxed);
+    entry.sample_rate.store(0, std::memory_order_relaxed);
+}
+
+static void release_next_sound()
+{
+    disarm_next_sound();
+    int slot = g_next_slot.exchange(-1);
+    if (slot >= 0 && g_slots[slot].loaded)
+    {
+        ma_sound_stop(&g_slots[slot].sound);
+    }
+}
+
+// Returns a slot holding `path`, reusing a still-loaded sound when one matches
+// and otherwise recycling a free or least recently used slot.
+static int acquire_slot(const std::string& path, ma_uint32 flags, double& load_ms)
+{
+    load_ms = 0.0;
+    int current = g_initialized ? g_current_slot.load() : -1;
+    int next = g_next_slot.load();
+    int match = -1;
+    int candidate = -1;
+    for (int i = 0; i < kSoundSlots; ++i)
+    {
+        if (i == current || i == next)
+        {
+            continue;
+        }
+        const sound_slot& entry = g_slots[i];
+        if (entry.loaded && entry.path == path)
+        {
+            match = i;
+            break;
+        }
+        if (candidate < 0
+            || (!entry.loaded && g_slots[candidate].loaded)
+            || (entry.loaded == g_slots[candidate].loaded && entry.last_used < g_slots[candidate].last_used))
+        {
+            candidate = i;
+        }
+    }
+
+    int slot = match;
+    if (slot >= 0)
+    {
+        ma_sound_stop(&g_slots[slot].sound);
+        ma_sound_seek_to_pcm_frame(&g_slots[slot].sound, 0);
+    }
+    else
+    {
+        if (candidate < 0)
+        {
+            return -1;
+        }
+        slot = candidate;
+        unload_slot(slot);
+
+        int64_t load_start = now_ns();
+        if (ma_sound_init_from_file(&g_engine, path.c_str(), flags, NULL, NULL, &g_slots[slot].sound) != MA_SUCCESS)
+        {
+            return -1;
+        }
+        load_ms = static_cast<double>(now_ns() - load_start) / 1.0e6;
+        g_slots[slot].loaded = true;
+        g_slots[slot].path = path;
+    }
+
+    g_slots[slot].last_used = ++g_slot_clock;
+    ma_sound_set_volume(&g_slots[slot].sound, g_volume);
+    return slot;
+}
+
+static void begin_start_measurement(ma_sound* sound, double load_ms)
+{
+    ma_node_set_time(sound, 0);
+    g_pending_load_ms = load_ms;
+    g_first_frame_ns.store(0);
+    g_start_requested_ns.store(now_ns());
+    g_start_pending.store(1, std::memory_order_release);
+}
+
 static void engine_process_callback(void* pUserData, float* pFramesOut, ma_uint64 frameCount)
 {
+    schedule_next_sound();
+
+    if (g_start_pending.load(std::memory_order_acquire)
+        && ma_node_get_time(current_sound()) > 0)
+    {
+        g_first_frame_ns.store(now_ns());
+        g_start_pending.store(0, std::memory_order_release);
+    }
+
     if (!pFramesOut || frameCount == 0)
     {
         return;
@@ -44,9 +282,9 @@ static void engine_process_callback(void* pUserData, float* pFramesOut, ma_uint6
     (*analyzer_ptr)->push_samples(pFramesOut, static_cast<int>(frameCount), channels);
 }
 
-static int start_playback_impl(const char* path)
+static int init_engine()
 {
-    if (g_initialized)
+    if (g_engine_initialized)
     {
         return 0;
     }
@@ -54,7 +292,9 @@ static int start_playback_impl(const char* path)
     ma_engine_config engine_config = ma_engine_config_init();
     engine_config.onProcess = engine_process_callback;
     engine_config.pProcessUserData = &g_spectrum_analyzer;
+    engine_config.pResourceManagerVFS = MappedFileCache::instance().vfs();
 
+    int64_t open_start = now_ns();
     ma_result result = ma_engine_init(&engine_config, &g_engine);
     if (result != MA_SUCCESS)
     {
@@ -62,22 +302,49 @@ static int start_playback_impl(const char* path)
         return 1;
     }
 
+    g_latency.device_open_ms = static_cast<double>(now_ns() - open_start) / 1.0e6;
     g_engine_channels = static_cast<int>(ma_engine_get_channels(&g_engine));
+    g_engine_initialized = 1;
+    spdlog::info("Player: audio device opened in {:.1f} ms", g_latency.device_open_ms);
+    return 0;
+}
 
-    result = ma_sound_init_from_file(&g_engine, path, 0, NULL, NULL, &g_sound);
-    if (result != MA_SUCCESS)
+static int start_playback_impl(const char* path)
+{
+    if (g_initialized)
+    {
+        return 0;
+    }
+
+    if (init_engine() != 0)
+    {
+        return 1;
+    }
+
+    double load_ms = 0.0;
+    int slot = acquire_slot(path, 0, load_ms);
+    if (slot < 0)
     {
         std::fprintf(stderr, "Failed to load audio file: %s\n", path);
-        ma_engine_uninit(&g_engine);
         return 1;
     }
 
-    ma_sound_start(&g_sound);
+    ma_sound* sound = &g_slots[slot].sound;
+    cache_slot_length(slot);
+    ma_sound_set_start_time_in_pcm_frames(sound, 0);
+    g_current_slot.store(slot, std::memory_order_release);
+    begin_start_measurement(sound, load_ms);
+    ma_sound_start(sound);
     g_initialized = 1;
-    g_paused = 0;
+    g_paused.store(0);
     return 0;
 }
 
+int Player::init()
+{
+    return init_engine();
+}
+
 int Player::play_file(const std::string& path)
 {
     int result = start_playback(path);
@@ -97,23 +364,157 @@ int Player::play_file(const std::string& path)
 
 int Player::start_playback(const std::string& path)
 {
-    return start_playback_impl(path.c_str());
+    int result = start_playback_impl(path.c_str());
+    if (result == 0)
+    {
+        prepare_next();
+    }
+    return result;
 }
 
 void Player::stop_playback()
 {
-    if (!g_initialized)
+    release_next_sound();
+    if (g_initialized)
+    {
+        ma_sound_stop(current_sound());
+    }
+    g_initialized = 0;
+    g_paused.store(0);
+    g_start_pending.store(0);
+}
+
+void Player::shutdown()
+{
+    stop_playback();
+    for (int slot = 0; slot < kSoundSlots; ++slot)
+    {
+        unload_slot(slot);
+    }
+    if (!g_engine_initialized)
     {
         return;
     }
 
-    ma_sound_uninit(&g_sound);
     ma_engine_uninit(&g_engine);
-    g_initialized = 0;
-    g_paused = 0;
+    g_engine_initialized = 0;
     g_engine_channels = 0;
 }
 
+void Player::update()
+{
+    int64_t first_frame = g_first_frame_ns.exchange(0);
+    if (first_frame != 0)
+    {
+        double start_ms = static_cast<double>(first_frame - g_start_requested_ns.load()) / 1.0e6;
+        g_latency.last_load_ms = g_pending_load_ms;
+        g_latency.last_start_ms = start_ms;
+        g_latency.max_start_ms = std::max(g_latency.max_start_ms, start_ms);
+        g_latency.total_start_ms += start_ms;
+        g_latency.start_count += 1;
+        spdlog::debug("Player: track start {:.1f} ms (load {:.1f} ms)", start_ms, g_pending_load_ms);
+    }
+
+    if (!g_initialized)
+    {
+        return;
+    }
+
+    // The track's metadata may still be on its way when playback starts.
+    cache_slot_length(g_current_slot.load());
+
+    uint64_t queue_revision = _queue ? _queue->get_revision() : 0;
+    size_t browser_index = _song_browser ? _song_browser->get_selected_index() : 0;
+    if (queue_revision != _next_queue_revision || browser_index != _next_browser_index)
+    {
+        prepare_next();
+    }
+}
+
+player_latency_stats Player::get_latency_stats() const
+{
+    return g_latency;
+}
+
+std::string Player::peek_next_track() const
+{
+    std::string next_path;
+    if (_queue)
+    {
+        _queue->peek_next(next_path);
+        return next_path;
+    }
+    if (_song_browser)
+    {
+        next_path = _song_browser->get_next_song_path();
+    }
+    return next_path;
+}
+
+void Player::prepare_next()
+{
+    _next_queue_revision = _queue ? _queue->get_revision() : 0;
+    _next_browser_index = _song_browser ? _song_browser->get_selected_index() : 0;
+
+    std::string path = peek_next_track();
+    int prepared = g_next_slot.load();
+    if (prepared >= 0 && g_next_armed.load())
+    {
+        if (g_slots[prepared].path == path || ma_sound_is_playing(&g_slots[prepared].sound))
+        {
+            return;
+        }
+    }
+
+    release_next_sound();
+    if (path.empty() || !g_initialized)
+    {
+        return;
+    }
+
+    double load_ms = 0.0;
+    int slot = acquire_slot(path, MA_SOUND_FLAG_ASYNC, load_ms);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    ma_sound* next = &g_slots[slot].sound;
+    ma_sound_set_start_time_in_pcm_frames(next, kStartNever);
+    ma_sound_start(next);
+    g_next_slot.store(slot, std::memory_order_release);
+    g_next_armed.store(1);
+}
+
+bool Player::promote_next(const std::string& path)
+{
+    int next = g_next_slot.load();
+    if (!g_initialized || !g_next_armed.load() || next < 0 || g_slots[next].path != path)
+    {
+        return false;
+    }
+
+    int current = g_current_slot.load();
+    disarm_next_sound();
+
+    ma_sound* sound = &g_slots[next].sound;
+    if (!ma_sound_is_playing(sound))
+    {
+        begin_start_measurement(sound, 0.0);
+        ma_sound_set_start_time_in_pcm_frames(sound, 0);
+        ma_sound_start(sound);
+    }
+    ma_sound_stop(&g_slots[current].sound);
+
+    cache_slot_length(next);
+    g_current_slot.store(next, std::memory_order_release);
+    g_next_slot.store(-1);
+    g_slots[next].last_used = ++g_slot_clock;
+    g_paused.store(0);
+    ma_sound_set_volume(sound, g_volume);
+    return true;
+}
+
 void Player::toggle_pause()
 {
     if (!g_initialized)
@@ -121,15 +522,15 @@ void Player::toggle_pause()
         return;
     }
 
-    if (g_paused)
+    if (g_paused.load())
     {
-        ma_sound_start(&g_sound);
-        g_paused = 0;
+        g_paused.store(0);
+        ma_sound_start(current_sound());
     }
     else
     {
-        ma_sound_stop(&g_sound);
-        g_paused = 1;
+        g_paused.store(1);
+        ma_sound_stop(current_sound());
     }
 }
 
@@ -139,12 +540,12 @@ bool Player::is_done() const
     {
         return true;
     }
-    return ma_sound_at_end(&g_sound) != 0;
+    return ma_sound_at_end(current_sound()) != 0;
 }
 
 bool Player::is_playing() const
 {
-    return g_initialized && !g_paused;
+    return g_initialized && !g_paused.load();
 }
 
 int Player::get_position_ms() const
@@ -155,7 +556,7 @@ int Player::get_position_ms() const
     }
 
     ma_uint64 frames = 0;
-    if (ma_sound_get_cursor_in_pcm_frames(&g_sound, &frames) != MA_SUCCESS)
+    if (ma_sound_get_cursor_in_pcm_frames(current_sound(), &frames) != MA_SUCCESS)
     {
         return 0;
     }
@@ -189,7 +590,7 @@ void Player::seek_ms(int position_ms)
     }
 
     ma_uint64 frames = (static_cast<ma_uint64>(position_ms) * sample_rate) / 1000;
-    ma_sound_seek_to_pcm_frame(&g_sound, frames);
+    ma_sound_seek_to_pcm_frame(current_sound(), frames);
 }
 
 void Player::set_current_track(const std::string& path)
@@ -207,7 +608,7 @@ void Player::set_current_track(const std::string& path)
     _current_track = path;
     _context = player_context{};
     _context.track_path = path;
-    EventBus::instance().publish(Event{"player.track_changed", _current_track});
+    EventBus::instance().publish(topics::track_changed, _current_track);
 }
 
 const std::string& Player::get_current_track() const
@@ -280,7 +681,11 @@ void Player::set_volume(float volume)
     {
         volume = 0.0f;
     }
-    ma_sound_set_volume(&g_sound, volume);
+    g_volume = volume;
+    if (g_initialized)
+    {
+        ma_sound_set_volume(current_sound(), volume);
+    }
 }
 
 void Player::handle_track_finished()
@@ -309,30 +714,26 @@ void Player::skip_previous()
 
 void Player::on_track_finished()
 {
+    std::string next_path;
     if (_queue)
     {
-        std::string next_path;
-        if (_queue->pop_next(next_path))
+        if (!_queue->pop_next(next_path))
         {
-            set_current_track(next_path);
-            stop_playback();
-            start_playback(get_current_track());
+            return;
         }
-        return;
     }
-
-    if (!_song_browser)
+    else if (!_song_browser || !_song_browser->advance_to_next_song(next_path))
     {
         return;
     }
 
-    std::string next_path;
-    if (!_song_browser->advance_to_next_song(next_path))
+    set_current_track(next_path);
+    if (promote_next(next_path))
     {
+        prepare_next();
         return;
     }
 
-    set_current_track(next_path);
     stop_playback();
     start_playback(get_current_track());
 }
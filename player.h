@@ -1,6 +1,8 @@
 #pragma once
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -17,12 +19,26 @@ struct player_context
     int position_ms = 0;
 };
 
+struct player_latency_stats
+{
+    double device_open_ms = 0.0;
+    double last_load_ms = 0.0;
+    double last_start_ms = 0.0;
+    double max_start_ms = 0.0;
+    double total_start_ms = 0.0;
+    int start_count = 0;
+};
+
 class Player
 {
 public:
+    int init();
     int play_file(const std::string& path);
     int start_playback(const std::string& path);
     void stop_playback();
+    void shutdown();
+    void update();
+    player_latency_stats get_latency_stats() const;
     void toggle_pause();
     bool is_done() const;
     bool is_playing() const;
@@ -43,6 +59,9 @@ public:
 
 private:
     void on_track_finished();
+    std::string peek_next_track() const;
+    void prepare_next();
+    bool promote_next(const std::string& path);
 
     std::string _current_track;
     player_context _context;
@@ -50,4 +69,6 @@ private:
     SpectrumAnalyzer* _spectrum_analyzer = nullptr;
     Queue* _queue = nullptr;
     std::vector<std::string> _history;
+    uint64_t _next_queue_revision = 0;
+    size_t _next_browser_index = 0;
 };
@@ -1,5 +1,5 @@
 workspace "agmp"
-    configurations { "Debug", "Release" }
+    configurations { "Debug", "Release", "AllocTrack" }
     startproject "agmp"
 
 project "agmp"
@@ -10,12 +10,20 @@ project "agmp"
     objdir "bin-int/%{cfg.buildcfg}"
 
     files {
+        "alloc_stats.cpp",
+        "alloc_stats.h",
         "album_art.cpp",
         "album_art.h",
+        "art_cache.cpp",
+        "art_cache.h",
         "config.cpp",
         "config.h",
+        "composite.cpp",
+        "composite.h",
         "browser.cpp",
         "browser.h",
+        "bench.cpp",
+        "bench.h",
         "app.cpp",
         "app.h",
         "canvas.cpp",
@@ -28,15 +36,29 @@ project "agmp"
         "scrubber.h",
         "event.cpp",
         "event.h",
+        "event_loop.cpp",
+        "event_loop.h",
+        "fft.cpp",
+        "fft.h",
         "http.cpp",
         "http.h",
+        "id3.cpp",
+        "id3.h",
         "input.cpp",
         "input.h",
+        "library.cpp",
+        "library.h",
+        "library_scanner.cpp",
+        "library_scanner.h",
         "logging.cpp",
         "logging.h",
+        "mapped_file.cpp",
+        "mapped_file.h",
         "main.cpp",
         "metadata.cpp",
         "metadata.h",
+        "mp3.cpp",
+        "mp3.h",
         "particles.cpp",
         "particles.h",
         "state.cpp",
@@ -45,12 +67,20 @@ project "agmp"
         "net.h",
         "terminal.cpp",
         "terminal.h",
+        "waveform.cpp",
+        "waveform.h",
+        "task_scheduler.cpp",
+        "task_scheduler.h",
         "player.cpp",
         "player.h",
+        "profiler.cpp",
+        "profiler.h",
         "spectrum_analyzer.cpp",
         "spectrum_analyzer.h",
         "rice.cpp",
         "rice.h",
+        "ring.h",
+        "lru_cache.h",
         "miniaudio.h"
     }
 
@@ -64,6 +94,16 @@ project "agmp"
         optimize "On"
         defines { "NDEBUG" }
 
+    -- Release code with per-zone allocation counts and call-site capture;
+    -- run `agmp --check-allocs` from this build to see where frames allocate.
+    filter "configurations:AllocTrack"
+        optimize "On"
+        symbols "On"
+        defines { "NDEBUG", "AGMP_ALLOC_TRACKING" }
+
+    filter { "configurations:AllocTrack", "system:linux" }
+        linkoptions { "-rdynamic" }
+
     filter "system:linux"
         links { "dl", "pthread", "m", "curl" }
 
@@ -0,0 +1,303 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include <glm/vec4.hpp>
+
+#include "config.h"
+#include "draw.h"
+
+const char* get_profile_zone_name(profile_zone zone)
+{
+    switch (zone)
+    {
+    case profile_zone::frame:
+        return "frame";
+    case profile_zone::input:
+        return "input";
+    case profile_zone::metadata:
+        return "metadata";
+    case profile_zone::scrubber:
+        return "scrubber draw";
+    case profile_zone::analyzer_update:
+        return "analyzer update";
+    case profile_zone::analyzer_draw:
+        return "analyzer draw";
+    case profile_zone::particles:
+        return "particles";
+    case profile_zone::eightbitify:
+        return "eightbitify";
+    case profile_zone::emit:
+        return "ansi emit";
+    case profile_zone::flush:
+        return "flush";
+    case profile_zone::count:
+        break;
+    }
+    return "unknown";
+}
+
+const char* get_alloc_zone_name(uint8_t tag)
+{
+    if (tag == 0 || tag > static_cast<uint8_t>(profile_zone::count))
+    {
+        return "untagged";
+    }
+    return get_profile_zone_name(static_cast<profile_zone>(tag - 1));
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now_ns()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+void Profiler::set_enabled(bool enabled)
+{
+    if (enabled == _enabled)
+    {
+        return;
+    }
+    _enabled = enabled;
+    if (!enabled)
+    {
+        return;
+    }
+
+    // Each capture starts from a clean slate; the trace ring is kept so the
+    // previous capture's storage is reused.
+    _histograms = {};
+    _stats = {};
+    _window_frames = 0;
+    _trace.resize(kMaxTraceEvents);
+    _trace_head = 0;
+    _trace_count = 0;
+}
+
+bool Profiler::is_enabled() const
+{
+    return _enabled;
+}
+
+size_t Profiler::bucket_index(uint64_t ns)
+{
+    if (ns < 4)
+    {
+        return static_cast<size_t>(ns);
+    }
+    int msb = 0;
+    for (uint64_t value = ns; value > 1; value >>= 1)
+    {
+        ++msb;
+    }
+    size_t sub = static_cast<size_t>((ns >> (msb - 2)) & 3);
+    return std::min(kBucketCount - 1, static_cast<size_t>(msb) * kBucketsPerOctave + sub);
+}
+
+uint64_t Profiler::bucket_upper_bound(size_t index)
+{
+    if (index < 4)
+    {
+        return static_cast<uint64_t>(index) + 1;
+    }
+    int msb = static_cast<int>(index / kBucketsPerOctave);
+    uint64_t sub = static_cast<uint64_t>(index % kBucketsPerOctave);
+    return (4 + sub + 1) << (msb - 2);
+}
+
+void Profiler::record(profile_zone zone, uint64_t start_ns, uint64_t end_ns)
+{
+    if (!_enabled || zone == profile_zone::count)
+    {
+        return;
+    }
+
+    uint64_t duration = end_ns > start_ns ? end_ns - start_ns : 0;
+    histogram& bins = _histograms[static_cast<size_t>(zone)];
+    bins.min_ns = (bins.count == 0) ? duration : std::min(bins.min_ns, duration);
+    bins.max_ns = std::max(bins.max_ns, duration);
+    bins.sum_ns += duration;
+    ++bins.count;
+    ++bins.buckets[bucket_index(duration)];
+
+    trace_event& event = _trace[_trace_head];
+    event.start_ns = start_ns;
+    event.duration_ns = static_cast<uint32_t>(std::min<uint64_t>(duration, UINT32_MAX));
+    event.zone = zone;
+    _trace_head = (_trace_head + 1) % kMaxTraceEvents;
+    _trace_count = std::min(_trace_count + 1, kMaxTraceEvents);
+}
+
+void Profiler::end_frame()
+{
+    if (!_enabled)
+    {
+        return;
+    }
+    if (++_window_frames >= kWindowFrames)
+    {
+        fold_window();
+        _window_frames = 0;
+    }
+}
+
+void Profiler::fold_window()
+{
+    for (size_t zone = 0; zone < kZoneCount; ++zone)
+    {
+        histogram& bins = _histograms[zone];
+        profile_zone_stats& stats = _stats[zone];
+        if (bins.count == 0)
+        {
+            stats = profile_zone_stats{};
+            continue;
+        }
+
+        // The p99 is the upper edge of the bucket holding it, which can't
+        // be above the slowest sample seen.
+        uint64_t rank = bins.count - bins.count / 100;
+        uint64_t seen = 0;
+        uint64_t p99 = bins.max_ns;
+        for (size_t i = 0; i < kBucketCount; ++i)
+        {
+            seen += bins.buckets[i];
+            if (seen >= rank)
+            {
+                p99 = std::min(bins.max_ns, bucket_upper_bound(i));
+                break;
+            }
+        }
+
+        stats.samples = bins.count;
+        stats.min_ns = bins.min_ns;
+        stats.avg_ns = bins.sum_ns / bins.count;
+        stats.p99_ns = p99;
+        bins = histogram{};
+    }
+}
+
+const profile_zone_stats& Profiler::get_stats(profile_zone zone) const
+{
+    return _stats[std::min(static_cast<size_t>(zone), kZoneCount - 1)];
+}
+
+size_t Profiler::get_trace_event_count() const
+{
+    return _trace_count;
+}
+
+bool Profiler::write_trace(const std::string& path) const
+{
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"ui\"}}");
+    size_t first = (_trace_head + kMaxTraceEvents - _trace_count) % kMaxTraceEvents;
+    for (size_t i = 0; i < _trace_count; ++i)
+    {
+        const trace_event& event = _trace[(first + i) % kMaxTraceEvents];
+        std::fprintf(
+            file,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+            get_profile_zone_name(event.zone),
+            static_cast<double>(event.start_ns) / 1000.0,
+            static_cast<double>(event.duration_ns) / 1000.0);
+    }
+    std::fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    return std::fclose(file) == 0;
+}
+
+void ProfilerOverlay::set_latency(const player_latency_stats& latency)
+{
+    _latency = latency;
+}
+
+void ProfilerOverlay::draw(const app_config& config) const
+{
+    auto renderer = Renderer::get();
+    if (!renderer || _size.x <= 0 || _size.y <= 0)
+    {
+        return;
+    }
+
+    glm::ivec2 actual_size = renderer->draw_box(_location, _size, config.ui_box_fg, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    int inner_width = actual_size.x - 2;
+    int inner_height = actual_size.y - 2;
+    if (inner_width <= 0 || inner_height <= 0)
+    {
+        return;
+    }
+
+    const Profiler& profiler = Profiler::instance();
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-16s %8s %8s %8s", "zone (us)", "min", "avg", "p99");
+    std::string& text = _text;
+
+    auto draw_line = [&](int row)
+    {
+        if (row >= inner_height)
+        {
+            return;
+        }
+        text.assign(line);
+        text.resize(static_cast<size_t>(inner_width), ' ');
+        renderer->draw_string_coloured(
+            text,
+            glm::ivec2(_location.x + 1, _location.y + 1 + row),
+            config.ui_text_fg,
+            glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    };
+
+    draw_line(0);
+    for (size_t zone = 0; zone < Profiler::kZoneCount; ++zone)
+    {
+        const profile_zone_stats& stats = profiler.get_stats(static_cast<profile_zone>(zone));
+        std::snprintf(
+            line,
+            sizeof(line),
+            "%-16s %8.1f %8.1f %8.1f",
+            get_profile_zone_name(static_cast<profile_zone>(zone)),
+            static_cast<double>(stats.min_ns) / 1000.0,
+            static_cast<double>(stats.avg_ns) / 1000.0,
+            static_cast<double>(stats.p99_ns) / 1000.0);
+        draw_line(1 + static_cast<int>(zone));
+    }
+    std::snprintf(line, sizeof(line), "trace: %zu events", profiler.get_trace_event_count());
+    draw_line(1 + static_cast<int>(Profiler::kZoneCount));
+
+    if (_latency.start_count > 0)
+    {
+        std::snprintf(
+            line,
+            sizeof(line),
+            "start ms: %.1f avg %.1f max %.1f",
+            _latency.last_start_ms,
+            _latency.total_start_ms / _latency.start_count,
+            _latency.max_start_ms);
+    }
+    else
+    {
+        std::snprintf(line, sizeof(line), "start ms: -");
+    }
+    draw_line(2 + static_cast<int>(Profiler::kZoneCount));
+}
+
+void ProfilerOverlay::clear() const
+{
+    if (auto renderer = Renderer::get())
+    {
+        renderer->clear_box(_location, _size);
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "actually_good_module.h"
+#include "alloc_stats.h"
+#include "player.h"
+
+struct app_config;
+
+enum class profile_zone : uint8_t
+{
+    frame = 0,
+    input,
+    metadata,
+    scrubber,
+    analyzer_update,
+    analyzer_draw,
+    particles,
+    eightbitify,
+    emit,
+    flush,
+    count,
+};
+
+const char* get_profile_zone_name(profile_zone zone);
+
+// Allocation zone tags are profile zones shifted up by one, leaving tag 0
+// for allocations outside every scope.
+static_assert(static_cast<size_t>(profile_zone::count) < kAllocZoneCount, "alloc zone tags cannot hold every profile zone");
+const char* get_alloc_zone_name(uint8_t tag);
+
+struct profile_zone_stats
+{
+    uint64_t samples = 0;
+    uint64_t min_ns = 0;
+    uint64_t avg_ns = 0;
+    uint64_t p99_ns = 0;
+};
+
+// Scoped timings from the UI thread. While enabled every zone feeds a
+// log-bucketed histogram that is folded into min/avg/p99 once per window of
+// frames, and a fixed ring of trace events that can be written out as a
+// Chrome trace. Disabled, a scope costs one branch.
+class Profiler
+{
+public:
+    static constexpr size_t kZoneCount = static_cast<size_t>(profile_zone::count);
+
+    static Profiler& instance();
+    static uint64_t now_ns();
+
+    void set_enabled(bool enabled);
+    bool is_enabled() const;
+
+    void record(profile_zone zone, uint64_t start_ns, uint64_t end_ns);
+    void end_frame();
+
+    const profile_zone_stats& get_stats(profile_zone zone) const;
+    size_t get_trace_event_count() const;
+    bool write_trace(const std::string& path) const;
+
+private:
+    Profiler() = default;
+
+    // Four buckets per power of two, up to about 18 minutes.
+    static constexpr int kBucketsPerOctave = 4;
+    static constexpr size_t kBucketCount = 40 * kBucketsPerOctave;
+    static constexpr int kWindowFrames = 60;
+    static constexpr size_t kMaxTraceEvents = 1 << 16;
+
+    struct histogram
+    {
+        uint64_t count = 0;
+        uint64_t sum_ns = 0;
+        uint64_t min_ns = 0;
+        uint64_t max_ns = 0;
+        std::array<uint32_t, kBucketCount> buckets{};
+    };
+
+    struct trace_event
+    {
+        uint64_t start_ns = 0;
+        uint32_t duration_ns = 0;
+        profile_zone zone = profile_zone::frame;
+    };
+
+    static size_t bucket_index(uint64_t ns);
+    static uint64_t bucket_upper_bound(size_t index);
+    void fold_window();
+
+    bool _enabled = false;
+    int _window_frames = 0;
+    std::array<histogram, kZoneCount> _histograms{};
+    std::array<profile_zone_stats, kZoneCount> _stats{};
+    std::vector<trace_event> _trace;
+    size_t _trace_head = 0;
+    size_t _trace_count = 0;
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(profile_zone zone)
+        : _zone(zone),
+          _active(Profiler::instance().is_enabled()),
+          _start_ns(_active ? Profiler::now_ns() : 0)
+    {
+#if defined(AGMP_ALLOC_TRACKING)
+        _previous_alloc_zone = set_thread_alloc_zone(static_cast<uint8_t>(static_cast<uint8_t>(zone) + 1));
+#endif
+    }
+
+    ~ProfileScope()
+    {
+        if (_active)
+        {
+            Profiler::instance().record(_zone, _start_ns, Profiler::now_ns());
+        }
+#if defined(AGMP_ALLOC_TRACKING)
+        set_thread_alloc_zone(_previous_alloc_zone);
+#endif
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    profile_zone _zone;
+    bool _active;
+    uint64_t _start_ns;
+#if defined(AGMP_ALLOC_TRACKING)
+    uint8_t _previous_alloc_zone = 0;
+#endif
+};
+
+class ProfilerOverlay : public ActuallyGoodModule
+{
+public:
+    static constexpr int kWidth = 44;
+    static constexpr int kHeight = static_cast<int>(Profiler::kZoneCount) + 5;
+
+    // Shown under the zones: how long the last track took to reach the
+    // device after it was asked to play.
+    void set_latency(const player_latency_stats& latency);
+    void draw(const app_config& config) const;
+    void clear() const;
+
+private:
+    mutable std::string _text;
+    player_latency_stats _latency;
+};
@@ -83,35 +83,28 @@ public:
                 glm::ivec2(width, height - 1));
         }
     }
-
-    void scan_and_populate(
-        const std::filesystem::path&,
-        Browser*,
-        std::vector<std::unique_ptr<BrowserItem>>& out) const override
-    {
-        (void)out;
-    }
 };
 
 void Queue::enqueue(const std::filesystem::path& path)
 {
     ensure_stop_item();
+    _revision += 1;
 
     std::string name;
-    track_metadata meta;
-    if (read_track_metadata(path.string(), meta) && (!meta.artist.empty() || !meta.title.empty()))
+    track_metadata_ptr meta = MetadataCache::instance().get(path.string());
+    if (meta && (!meta->artist.empty() || !meta->title.empty()))
     {
-        if (!meta.artist.empty() && !meta.title.empty())
+        if (!meta->artist.empty() && !meta->title.empty())
         {
-            name = meta.artist + " - " + meta.title;
+            name = meta->artist + " - " + meta->title;
         }
-        else if (!meta.title.empty())
+        else if (!meta->title.empty())
         {
-            name = meta.title;
+            name = meta->title;
         }
         else
         {
-            name = meta.artist;
+            name = meta->artist;
         }
     }
 
@@ -156,6 +149,7 @@ void Queue::enqueue_front(const std::filesystem::path& path)
         return;
     }
 
+    _revision += 1;
     size_t insert_index = 0;
     _items.insert(
         _items.begin() + static_cast<std::ptrdiff_t>(insert_index),
@@ -175,20 +169,44 @@ bool Queue::pop_next(std::string& out_path)
 
         out_path = _items[i]->get_path().string();
         _items.erase(_items.begin() + static_cast<std::ptrdiff_t>(i));
+        _revision += 1;
         return !out_path.empty();
     }
 
     return false;
 }
 
+bool Queue::peek_next(std::string& out_path) const
+{
+    for (const auto& item : _items)
+    {
+        if (item->get_path().empty())
+        {
+            continue;
+        }
+
+        out_path = item->get_path().string();
+        return !out_path.empty();
+    }
+
+    return false;
+}
+
+uint64_t Queue::get_revision() const
+{
+    return _revision;
+}
+
 void Queue::clear()
 {
     _items.clear();
+    _revision += 1;
 }
 
 void Queue::set_paths(const std::vector<std::string>& paths)
 {
     _items.clear();
+    _revision += 1;
     for (const std::string& path : paths)
     {
         if (!path.empty())
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <vector>
@@ -21,6 +22,8 @@ public:
     void enqueue(const std::filesystem::path& path);
     void enqueue_front(const std::filesystem::path& path);
     bool pop_next(std::string& out_path);
+    bool peek_next(std::string& out_path) const;
+    uint64_t get_revision() const;
     void clear();
     void set_paths(const std::vector<std::string>& paths);
     std::vector<std::string> get_paths() const;
@@ -29,4 +32,5 @@ public:
 private:
     void ensure_stop_item();
     std::vector<std::unique_ptr<BrowserItem>> _items;
+    uint64_t _revision = 0;
 };
@@ -20,5 +20,5 @@ void Rice::run(const app_config& config)
     Canvas* canvas = ActuallyGoodMP::instance().get_canvas();
     canvas->resize(renderer->get_terminal_size());
     canvas->build_logo(config);
-    renderer->set_layer("logo", canvas->get_buffer());
+    renderer->set_layer(Terminal::Layer::logo, canvas->get_buffer());
 }
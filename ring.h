@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace wynott {
+
+// Single-producer/single-consumer ring that keeps the newest samples. write()
+// never refuses data: once the ring is full each write replaces the oldest
+// entries, so a reader that fell behind skips straight to the current
+// samples instead of working through a backlog. Neither side locks or
+// allocates; each side must only ever be called from one thread.
+template <typename T>
+class spsc_ring {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "wynott::spsc_ring requires trivially copyable T");
+
+    explicit spsc_ring(size_t capacity)
+    {
+        size_t rounded = 1;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        _buffer.reset(new std::atomic<T>[rounded]);
+        for (size_t i = 0; i < rounded; ++i)
+        {
+            _buffer[i].store(T{}, std::memory_order_relaxed);
+        }
+        _capacity = rounded;
+        _mask = rounded - 1;
+    }
+
+    spsc_ring() = delete;
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    void write(const T* data, size_t count)
+    {
+        if (count > _capacity)
+        {
+            data += count - _capacity;
+            count = _capacity;
+        }
+
+        // Claim the slots before overwriting them, so a reader copying the
+        // same slots can tell its copy was torn.
+        size_t head = _head.load(std::memory_order_relaxed);
+        _claimed.store(head + count, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < count; ++i)
+        {
+            _buffer[(head + i) & _mask].store(data[i], std::memory_order_relaxed);
+        }
+        _head.store(head + count, std::memory_order_release);
+    }
+
+    // Copies the newest samples written since the last read, oldest first,
+    // at most `max_count` of them. Returns how many were copied.
+    size_t read_latest(T* out, size_t max_count)
+    {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t available = std::min(head - _read, _capacity);
+        size_t n = std::min(available, max_count);
+        size_t start = head - n;
+        for (size_t i = 0; i < n; ++i)
+        {
+            out[i] = _buffer[(start + i) & _mask].load(std::memory_order_relaxed);
+        }
+        _read = head;
+
+        // Anything the writer claimed while we copied may have replaced the
+        // oldest samples we read; drop those.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        size_t claimed = _claimed.load(std::memory_order_relaxed);
+        if (claimed > start + _capacity)
+        {
+            size_t torn = std::min(n, claimed - _capacity - start);
+            std::copy(out + torn, out + n, out);
+            n -= torn;
+        }
+        return n;
+    }
+
+private:
+    std::unique_ptr<std::atomic<T>[]> _buffer;
+    size_t _capacity = 0;
+    size_t _mask = 0;
+    size_t _read = 0;
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _claimed{0};
+};
+
+} // namespace wynott
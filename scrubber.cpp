@@ -4,10 +4,9 @@
 #include <cmath>
 #include <cstdio>
 #include <mutex>
-#include <thread>
 
 #include "draw.h"
-#include "miniaudio.h"
+#include "metadata.h"
 
 static char32_t partial_block(float frac)
 {
@@ -62,125 +61,54 @@ void Scrubber::set_waveform(const std::vector<float>& amplitudes_01)
     _waveform = std::move(clamped);
 }
 
-static std::vector<float> build_waveform(const std::string& path, int columns, float* out_peak)
+static float peak_gain(float peak)
 {
-    if (out_peak)
+    float gain = 1.0f;
+    if (peak > 1.0e-6f)
     {
-        *out_peak = 0.0f;
+        float peak_db = 20.0f * std::log10(peak);
+        float target_db = -1.0f;
+        float gain_db = target_db - peak_db;
+        gain = std::pow(10.0f, gain_db / 20.0f);
+        if (gain < 0.1f) gain = 0.1f;
+        if (gain > 3.0f) gain = 3.0f;
     }
-    if (columns <= 0)
-    {
-        return {};
-    }
-
-    ma_decoder decoder;
-    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 2, 48000);
-    if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS)
-    {
-        return {};
-    }
-
-    ma_uint64 total_frames = 0;
-    if (ma_decoder_get_length_in_pcm_frames(&decoder, &total_frames) != MA_SUCCESS)
-    {
-        ma_decoder_uninit(&decoder);
-        return {};
-    }
-
-    if (total_frames == 0)
-    {
-        ma_decoder_uninit(&decoder);
-        return {};
-    }
-
-    std::vector<float> peaks(static_cast<size_t>(columns), 0.0f);
-    ma_uint64 frames_per_bin = total_frames / static_cast<ma_uint64>(columns);
-    if (frames_per_bin == 0)
-    {
-        frames_per_bin = 1;
-    }
-
-    const ma_uint32 channels = decoder.outputChannels;
-    const ma_uint64 chunk_frames = 4096;
-    std::vector<float> buffer(static_cast<size_t>(chunk_frames * channels));
-    ma_uint64 frame_index = 0;
-    while (frame_index < total_frames)
-    {
-        ma_uint64 frames_read = 0;
-        if (ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunk_frames, &frames_read) != MA_SUCCESS)
-        {
-            break;
-        }
-        if (frames_read == 0)
-        {
-            break;
-        }
-
-        for (ma_uint64 i = 0; i < frames_read; ++i)
-        {
-            float sample = 0.0f;
-            if (channels >= 2)
-            {
-                float left = buffer[static_cast<size_t>(i * channels)];
-                float right = buffer[static_cast<size_t>(i * channels + 1)];
-                sample = 0.5f * (std::fabs(left) + std::fabs(right));
-            }
-            else if (channels == 1)
-            {
-                sample = std::fabs(buffer[static_cast<size_t>(i)]);
-            }
-
-            ma_uint64 absolute_frame = frame_index + i;
-            size_t bin = static_cast<size_t>(absolute_frame / frames_per_bin);
-            if (bin >= peaks.size())
-            {
-                bin = peaks.size() - 1;
-            }
-            if (sample > peaks[bin])
-            {
-                peaks[bin] = sample;
-            }
-        }
+    return gain;
+}
 
-        frame_index += frames_read;
-    }
+void Scrubber::set_cache_directory(const std::string& cache_directory)
+{
+    _cache_directory = cache_directory;
+}
 
-    ma_decoder_uninit(&decoder);
+void Scrubber::apply_peaks(const waveform_peaks& peaks, int columns)
+{
+    std::vector<float> waveform;
+    peaks.reduce(columns, waveform);
 
     float max_peak = 0.0f;
-    for (float peak : peaks)
+    for (float peak : waveform)
     {
-        if (peak > max_peak)
-        {
-            max_peak = peak;
-        }
+        max_peak = std::max(max_peak, peak);
     }
-
-    if (out_peak)
+    for (float& value : waveform)
     {
-        *out_peak = max_peak;
+        value = (max_peak > 1.0e-6f) ? value / max_peak : 0.0f;
     }
-
-    if (max_peak <= 1.0e-6f)
-    {
-        return std::vector<float>(peaks.size(), 0.0f);
-    }
-
-    std::vector<float> normalized;
-    normalized.reserve(peaks.size());
-    for (float peak : peaks)
-    {
-        float norm = peak / max_peak;
-        normalized.push_back(std::clamp(norm, 0.0f, 1.0f));
-    }
-
-    return normalized;
+    set_waveform(waveform);
 }
 
 void Scrubber::request_waveform(const std::string& path, int columns)
 {
+    if (_waveform_task)
+    {
+        _waveform_task->cancel();
+        _waveform_task.reset();
+    }
+
     if (path.empty())
     {
+        _waveform_job_id.fetch_add(1);
         set_waveform({});
         return;
     }
@@ -189,30 +117,58 @@ void Scrubber::request_waveform(const std::string& path, int columns)
     int oversampled_columns = std::max(1, columns * samples_per_column);
 
     int job_id = _waveform_job_id.fetch_add(1) + 1;
-    std::string path_copy = path;
-    std::thread([this, path_copy, oversampled_columns, job_id]()
+    std::shared_ptr<const waveform_peaks> current;
+    {
+        std::lock_guard<std::mutex> lock(_waveform_mutex);
+        if (_peaks_path == path)
+        {
+            current = _peaks;
+        }
+    }
+    if (current)
+    {
+        _pending_peak_gain.store(peak_gain(current->get_peak()));
+        apply_peaks(*current, oversampled_columns);
+        return;
+    }
+
+    std::string cache_directory = _cache_directory;
+    _waveform_task = TaskScheduler::instance().submit(
+        task_priority::normal,
+        [this, path, cache_directory, oversampled_columns, job_id](const TaskToken& token)
     {
-        float peak = 0.0f;
-        std::vector<float> waveform = build_waveform(path_copy, oversampled_columns, &peak);
 
-        float gain = 1.0f;
-        if (peak > 1.0e-6f)
+        auto peaks = std::make_shared<waveform_peaks>();
+        int64_t modified_time = 0;
+        int64_t file_size = 0;
+        bool stamped = read_file_stamp(path, modified_time, file_size);
+        std::string cache_path = waveform_cache_path(cache_directory, path);
+        if (!stamped || !load_waveform_peaks(cache_path, modified_time, file_size, *peaks))
         {
-            float peak_db = 20.0f * std::log10(peak);
-            float target_db = -1.0f;
-            float gain_db = target_db - peak_db;
-            gain = std::pow(10.0f, gain_db / 20.0f);
-            if (gain < 0.1f) gain = 0.1f;
-            if (gain > 3.0f) gain = 3.0f;
+            if (!compute_waveform_peaks(path, *peaks, &token))
+            {
+                peaks->levels.clear();
+            }
+            else if (stamped)
+            {
+                save_waveform_peaks(cache_path, modified_time, file_size, *peaks);
+            }
         }
 
-        if (_waveform_job_id.load() != job_id)
+        float gain = peak_gain(peaks->get_peak());
+
+        if (token.is_cancelled() || _waveform_job_id.load() != job_id)
         {
             return;
         }
+        {
+            std::lock_guard<std::mutex> lock(_waveform_mutex);
+            _peaks_path = path;
+            _peaks = peaks;
+        }
         _pending_peak_gain.store(gain);
-        set_waveform(waveform);
-    }).detach();
+        apply_peaks(*peaks, oversampled_columns);
+    });
 }
 
 float Scrubber::consume_peak_gain()
@@ -299,10 +255,12 @@ void Scrubber::draw(const app_config& config) const
     int progress_x = origin_x + static_cast<int>(std::round(_progress * (inner_width - 1)));
     progress_x = std::clamp(progress_x, origin_x, origin_x + inner_width - 1);
 
-    std::vector<float> waveform;
+    // Copied into storage kept across frames so a steady waveform costs no
+    // allocation.
+    std::vector<float>& waveform = _draw_waveform;
     {
         std::lock_guard<std::mutex> lock(_waveform_mutex);
-        waveform = _waveform;
+        waveform.assign(_waveform.begin(), _waveform.end());
     }
 
     auto compute_fill_ratio = [&](float exponent)
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -11,6 +12,8 @@
 
 #include "actually_good_module.h"
 #include "config.h"
+#include "task_scheduler.h"
+#include "waveform.h"
 
 class Scrubber : public ActuallyGoodModule
 {
@@ -20,17 +23,25 @@ public:
     void set_progress(float progress_01);
     void set_time_ms(int elapsed_ms, int total_ms);
     void set_waveform(const std::vector<float>& amplitudes_01);
+    void set_cache_directory(const std::string& cache_directory);
     void request_waveform(const std::string& path, int columns);
     float consume_peak_gain();
 
     void draw(const app_config& config) const;
 
 private:
+    void apply_peaks(const waveform_peaks& peaks, int columns);
+
     float _progress = 0.0f;
     int _elapsed_ms = 0;
     int _total_ms = 0;
     std::vector<float> _waveform;
+    mutable std::vector<float> _draw_waveform;
     mutable std::mutex _waveform_mutex;
+    std::string _cache_directory;
+    std::string _peaks_path;
+    std::shared_ptr<const waveform_peaks> _peaks;
+    task_token_ptr _waveform_task;
     std::atomic<int> _waveform_job_id{0};
     std::atomic<float> _pending_peak_gain{-1.0f};
     int _waveform_samples_per_column = 8;
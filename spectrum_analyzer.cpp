@@ -6,33 +6,53 @@
 #include <cmath>
 #include <random>
 
-#include "app.h"
+#include "config.h"
 #include "draw.h"
 #include "event.h"
 
-static constexpr float kPi = 3.14159265358979323846f;
+static constexpr int kPushChunkFrames = 256;
 
 SpectrumAnalyzer::SpectrumAnalyzer()
+    : _ring(static_cast<size_t>(RealFft::kMaxSize) * 2)
 {
     ensure_buffer();
 }
 
+void SpectrumAnalyzer::set_fft_size(int fft_size)
+{
+    fft_size = RealFft::clamp_size(fft_size);
+    if (fft_size == _fft_size)
+    {
+        return;
+    }
+    _fft_size = fft_size;
+    ensure_buffer();
+}
+
 void SpectrumAnalyzer::ensure_buffer()
 {
     if (_fft_size <= 0)
     {
-        _fft_size = 256;
+        _fft_size = 4096;
     }
     if (_band_count <= 0)
     {
         _band_count = 24;
     }
 
-    size_t ring_size = static_cast<size_t>(_fft_size * 8);
-    if (_ring.size() != ring_size)
+    if (_fft.get_size() != _fft_size)
     {
-        _ring.assign(ring_size, 0.0f);
-        _ring_head = 0;
+        _fft.resize(_fft_size);
+        _fft_size = _fft.get_size();
+        _window.assign(static_cast<size_t>(_fft_size), 0.0f);
+        _magnitudes.assign(static_cast<size_t>(_fft.get_bin_count()), 0.0f);
+    }
+
+    if (_history.size() != static_cast<size_t>(_fft_size))
+    {
+        _history.assign(static_cast<size_t>(_fft_size), 0.0f);
+        _history_head = 0;
+        _incoming.assign(static_cast<size_t>(_fft_size), 0.0f);
     }
 
     if (static_cast<int>(_bands.size()) != _band_count)
@@ -41,34 +61,63 @@ void SpectrumAnalyzer::ensure_buffer()
     }
 }
 
-void SpectrumAnalyzer::push_samples(const float* interleaved, int frames, int channels)
+void SpectrumAnalyzer::ensure_band_ranges()
 {
-    if (!interleaved || frames <= 0 || channels <= 0)
+    if (static_cast<int>(_band_ranges.size()) == _band_count && _band_ranges_fft_size == _fft_size)
     {
         return;
     }
 
-    ensure_buffer();
+    int bins = _fft.get_bin_count();
+    _band_ranges.assign(static_cast<size_t>(_band_count), band_range{});
+    _band_values.assign(static_cast<size_t>(_band_count), 0.0f);
+    _band_ranges_fft_size = _fft_size;
+
+    float min_bin = 1.0f;
+    float max_bin = static_cast<float>(bins);
+    float band_ratio = max_bin / min_bin;
 
-    std::lock_guard<std::mutex> lock(_mutex);
-    size_t ring_size = _ring.size();
-    if (ring_size == 0)
+    for (int i = 0; i < _band_count; ++i)
+    {
+        float t0 = static_cast<float>(i) / static_cast<float>(_band_count);
+        float t1 = static_cast<float>(i + 1) / static_cast<float>(_band_count);
+        float start_f = min_bin * std::pow(band_ratio, t0);
+        float end_f = min_bin * std::pow(band_ratio, t1);
+
+        int start = std::max(1, static_cast<int>(std::floor(start_f)));
+        int end = std::max(start + 1, static_cast<int>(std::ceil(end_f)));
+        if (end > bins)
+        {
+            end = bins;
+        }
+        _band_ranges[static_cast<size_t>(i)] = band_range{start, end};
+    }
+}
+
+void SpectrumAnalyzer::push_samples(const float* interleaved, int frames, int channels)
+{
+    if (!interleaved || frames <= 0 || channels <= 0)
     {
         return;
     }
 
-    for (int frame = 0; frame < frames; ++frame)
+    float mono[kPushChunkFrames];
+    float inv_channels = 1.0f / static_cast<float>(channels);
+    for (int offset = 0; offset < frames; offset += kPushChunkFrames)
     {
-        float sum = 0.0f;
-        const float* base = interleaved + (frame * channels);
-        for (int ch = 0; ch < channels; ++ch)
+        int count = std::min(kPushChunkFrames, frames - offset);
+        for (int frame = 0; frame < count; ++frame)
         {
-            sum += base[ch];
+            float sum = 0.0f;
+            const float* base = interleaved + ((offset + frame) * channels);
+            for (int ch = 0; ch < channels; ++ch)
+            {
+                sum += base[ch];
+            }
+            mono[frame] = sum * inv_channels;
         }
-        float sample = sum / static_cast<float>(channels);
 
-        _ring[_ring_head] = sample;
-        _ring_head = (_ring_head + 1) % ring_size;
+        _ring.write(mono, static_cast<size_t>(count));
     }
 }
 
@@ -82,108 +131,64 @@ void SpectrumAnalyzer::update()
 
     ensure_buffer();
 
-    std::vector<float> window;
-    {
-        std::lock_guard<std::mutex> lock(_mutex);
-        if (_ring.empty())
-        {
-            return;
-        }
-
-        window.resize(static_cast<size_t>(_fft_size), 0.0f);
-        size_t ring_size = _ring.size();
-        size_t start = (_ring_head + ring_size - static_cast<size_t>(_fft_size)) % ring_size;
-        for (int i = 0; i < _fft_size; ++i)
-        {
-            size_t index = (start + static_cast<size_t>(i)) % ring_size;
-            window[static_cast<size_t>(i)] = _ring[index];
-        }
-    }
-
-    if (window.empty())
+    size_t history_size = _history.size();
+    if (history_size == 0)
     {
+        _animating = false;
         return;
     }
 
-    if (_fft_size > 1)
-    {
-        for (int i = 0; i < _fft_size; ++i)
-        {
-            float t = static_cast<float>(i) / static_cast<float>(_fft_size - 1);
-            float w = 0.5f * (1.0f - std::cos(2.0f * kPi * t));
-            window[static_cast<size_t>(i)] *= w;
-        }
-    }
-
-    compute_bands(window);
+    // After a stall only the newest window is taken; older samples the
+    // audio thread has since overwritten are skipped.
+    size_t read = _ring.read_latest(_incoming.data(), history_size);
+    bool received = read > 0;
+    size_t tail_room = std::min(read, history_size - _history_head);
+    std::copy(_incoming.begin(), _incoming.begin() + static_cast<std::ptrdiff_t>(tail_room),
+              _history.begin() + static_cast<std::ptrdiff_t>(_history_head));
+    std::copy(_incoming.begin() + static_cast<std::ptrdiff_t>(tail_room), _incoming.begin() + static_cast<std::ptrdiff_t>(read),
+              _history.begin());
+    _history_head = (_history_head + read) % history_size;
+
+    size_t first = history_size - _history_head;
+    std::copy(_history.begin() + static_cast<std::ptrdiff_t>(_history_head), _history.end(), _window.begin());
+    std::copy(_history.begin(), _history.begin() + static_cast<std::ptrdiff_t>(_history_head),
+              _window.begin() + static_cast<std::ptrdiff_t>(first));
+
+    // Without new samples the bars ease towards a fixed shape; once they
+    // stop moving visibly there is nothing left to animate.
+    float change = compute_bands();
+    _animating = received || change > 0.002f;
 }
 
-void SpectrumAnalyzer::compute_bands(const std::vector<float>& window)
+bool SpectrumAnalyzer::is_animating() const
 {
-    if (window.empty() || _fft_size <= 0)
-    {
-        return;
-    }
+    return _animating;
+}
 
-    int bins = _fft_size / 2;
-    if (bins <= 0)
+float SpectrumAnalyzer::compute_bands()
+{
+    if (_window.empty() || _magnitudes.empty())
     {
-        return;
+        return 0.0f;
     }
 
-    std::vector<float> magnitudes(static_cast<size_t>(bins), 0.0f);
-    float inv_count = 1.0f / static_cast<float>(_fft_size);
-
-    for (int k = 0; k < bins; ++k)
-    {
-        float re = 0.0f;
-        float im = 0.0f;
-        float k_factor = 2.0f * kPi * static_cast<float>(k) / static_cast<float>(_fft_size);
-        for (int n = 0; n < _fft_size; ++n)
-        {
-            float angle = k_factor * static_cast<float>(n);
-            float sample = window[static_cast<size_t>(n)];
-            re += sample * std::cos(angle);
-            im -= sample * std::sin(angle);
-        }
-        float mag = std::sqrt(re * re + im * im) * inv_count;
-        magnitudes[static_cast<size_t>(k)] = mag;
-    }
-
-    std::vector<float> bands(static_cast<size_t>(_band_count), 0.0f);
-    float min_bin = 1.0f;
-    float max_bin = static_cast<float>(bins);
-    float band_ratio = max_bin / min_bin;
+    _fft.windowed_magnitudes(_window.data(), _magnitudes.data());
+    ensure_band_ranges();
 
     for (int i = 0; i < _band_count; ++i)
     {
-        float t0 = static_cast<float>(i) / static_cast<float>(_band_count);
-        float t1 = static_cast<float>(i + 1) / static_cast<float>(_band_count);
-        float start_f = min_bin * std::pow(band_ratio, t0);
-        float end_f = min_bin * std::pow(band_ratio, t1);
-
-        int start = std::max(1, static_cast<int>(std::floor(start_f)));
-        int end = std::max(start + 1, static_cast<int>(std::ceil(end_f)));
-        if (end > bins)
-        {
-            end = bins;
-        }
-
+        const band_range& range = _band_ranges[static_cast<size_t>(i)];
         float sum = 0.0f;
-        int count = 0;
-        for (int k = start; k < end; ++k)
-        {
-            sum += magnitudes[static_cast<size_t>(k)];
-            count += 1;
-        }
-        if (count > 0)
+        for (int k = range.start; k < range.end; ++k)
         {
-            bands[static_cast<size_t>(i)] = sum / static_cast<float>(count);
+            sum += _magnitudes[static_cast<size_t>(k)];
         }
+        int count = range.end - range.start;
+        _band_values[static_cast<size_t>(i)] = (count > 0) ? sum / static_cast<float>(count) : 0.0f;
     }
 
     float peak = 0.0f;
-    for (float value : bands)
+    for (float value : _band_values)
     {
         if (value > peak)
         {
@@ -195,14 +200,10 @@ void SpectrumAnalyzer::compute_bands(const std::vector<float>& window)
         peak = 1.0f;
     }
 
-    if (static_cast<int>(_bands.size()) != _band_count)
-    {
-        _bands.assign(static_cast<size_t>(_band_count), 0.0f);
-    }
-
+    float change = 0.0f;
     for (int i = 0; i < _band_count; ++i)
     {
-        float normalized = bands[static_cast<size_t>(i)] / peak;
+        float normalized = _band_values[static_cast<size_t>(i)] / peak;
         if (normalized < 0.0f)
         {
             normalized = 0.0f;
@@ -214,6 +215,7 @@ void SpectrumAnalyzer::compute_bands(const std::vector<float>& window)
         float compressed = std::sqrt(normalized);
 
         float previous = _bands[static_cast<size_t>(i)];
+        float original = previous;
         float next = compressed;
         if (next > previous)
         {
@@ -224,10 +226,12 @@ void SpectrumAnalyzer::compute_bands(const std::vector<float>& window)
             previous = previous * 0.85f + next * 0.15f;
         }
         _bands[static_cast<size_t>(i)] = previous;
+        change = std::max(change, std::abs(previous - original));
     }
+    return change;
 }
 
-void SpectrumAnalyzer::draw()
+void SpectrumAnalyzer::draw(const app_config& config)
 {
     spdlog::trace("SpectrumAnalyzer::draw()");
     
@@ -242,7 +246,6 @@ void SpectrumAnalyzer::draw()
         return;
     }
 
-    const app_config& config = ActuallyGoodMP::instance().get_config();
     glm::vec4 bar_colour = config.ui_text_fg;
     glm::ivec2 terminal_size = renderer->get_terminal_size();
     if (terminal_size.x <= 0 || terminal_size.y <= 0)
@@ -341,9 +344,7 @@ void SpectrumAnalyzer::draw()
             }
             int emit_y = max_y - top_y;
             int emit_x = min_x + x;
-            EventBus::instance().publish(Event{
-                "debug.particle_emit",
-                std::to_string(emit_x) + "," + std::to_string(emit_y) + "," + std::to_string(freq_t)});
+            EventBus::instance().publish(topics::particle_emit, particle_emit_event{emit_x, emit_y, freq_t});
         }
 
         glm::vec4 low = config.spectrum_colour_low;
@@ -3,13 +3,15 @@
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
 
-#include <mutex>
 #include <vector>
 
 #include "actually_good_module.h"
+#include "fft.h"
+#include "ring.h"
 #include "terminal.h"
 
 class Renderer;
+struct app_config;
 
 class SpectrumAnalyzer : public ActuallyGoodModule
 {
@@ -18,18 +20,35 @@ public:
 
     void push_samples(const float* interleaved, int frames, int channels);
     void update();
-    void draw();
+    void draw(const app_config& config);
     void set_gain(float gain);
+    void set_fft_size(int fft_size);
+    bool is_animating() const;
 
 private:
-    void ensure_buffer();
-    void compute_bands(const std::vector<float>& window);
+    struct band_range
+    {
+        int start = 0;
+        int end = 0;
+    };
 
-    std::mutex _mutex;
-    std::vector<float> _ring;
-    size_t _ring_head = 0;
-    int _fft_size = 256;
+    void ensure_buffer();
+    void ensure_band_ranges();
+    float compute_bands();
+
+    wynott::spsc_ring<float> _ring;
+    std::vector<float> _history;
+    size_t _history_head = 0;
+    std::vector<float> _incoming;
+    int _fft_size = 4096;
     int _band_count = 24;
+    RealFft _fft;
+    std::vector<float> _window;
+    std::vector<float> _magnitudes;
+    std::vector<band_range> _band_ranges;
+    int _band_ranges_fft_size = 0;
+    std::vector<float> _band_values;
     std::vector<float> _bands;
     float _gain = 1.0f;
+    bool _animating = false;
 };
@@ -0,0 +1,173 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "event_loop.h"
+
+void TaskToken::cancel()
+{
+    _cancelled.store(true, std::memory_order_release);
+}
+
+bool TaskToken::is_cancelled() const
+{
+    return _cancelled.load(std::memory_order_acquire);
+}
+
+TaskScheduler& TaskScheduler::instance()
+{
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    stop();
+}
+
+void TaskScheduler::start(int thread_count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_threads.empty())
+    {
+        return;
+    }
+
+    if (thread_count <= 0)
+    {
+        int hardware = static_cast<int>(std::thread::hardware_concurrency());
+        thread_count = std::clamp(hardware - 1, 1, 4);
+    }
+
+    _stopping = false;
+    _running.assign(static_cast<size_t>(thread_count), nullptr);
+    for (int i = 0; i < thread_count; ++i)
+    {
+        _threads.emplace_back(&TaskScheduler::worker_loop, this, static_cast<size_t>(i));
+    }
+    spdlog::info("TaskScheduler: started {} workers", thread_count);
+}
+
+void TaskScheduler::stop()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        for (auto& queue : _queues)
+        {
+            for (Task& task : queue)
+            {
+                task.token->cancel();
+            }
+            queue.clear();
+        }
+        for (auto& token : _running)
+        {
+            if (token)
+            {
+                token->cancel();
+            }
+        }
+        threads.swap(_threads);
+    }
+    _condition.notify_all();
+
+    for (auto& thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+task_token_ptr TaskScheduler::submit(task_priority priority, task_function task)
+{
+    auto token = std::make_shared<TaskToken>();
+    if (!task)
+    {
+        token->cancel();
+        return token;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopping || _threads.empty())
+        {
+            token->cancel();
+            return token;
+        }
+        size_t index = std::min(static_cast<size_t>(priority), kPriorityCount - 1);
+        _queues[index].push_back(Task{token, std::move(task)});
+    }
+    _condition.notify_one();
+    return token;
+}
+
+int TaskScheduler::get_thread_count() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<int>(_threads.size());
+}
+
+size_t TaskScheduler::get_pending_count() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (const auto& queue : _queues)
+    {
+        count += queue.size();
+    }
+    return count;
+}
+
+bool TaskScheduler::pop_task_locked(Task& task)
+{
+    for (auto& queue : _queues)
+    {
+        while (!queue.empty())
+        {
+            Task next = std::move(queue.front());
+            queue.pop_front();
+            if (!next.token->is_cancelled())
+            {
+                task = std::move(next);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::worker_loop(size_t worker_index)
+{
+    while (true)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _running[worker_index].reset();
+            _condition.wait(lock, [this, &task]() { return _stopping || pop_task_locked(task); });
+            if (_stopping)
+            {
+                return;
+            }
+            _running[worker_index] = task.token;
+        }
+
+        try
+        {
+            task.function(*task.token);
+        }
+        catch (const std::exception& ex)
+        {
+            spdlog::error("TaskScheduler: task failed: {}", ex.what());
+        }
+
+        // Finished work usually leaves results for the UI thread to pick up.
+        EventLoop::instance().wake();
+    }
+}
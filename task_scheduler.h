@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class task_priority
+{
+    high = 0,
+    normal = 1,
+    low = 2,
+};
+
+class TaskToken
+{
+public:
+    void cancel();
+    bool is_cancelled() const;
+
+private:
+    std::atomic<bool> _cancelled{false};
+};
+
+using task_token_ptr = std::shared_ptr<TaskToken>;
+using task_function = std::function<void(const TaskToken&)>;
+
+class TaskScheduler
+{
+public:
+    static TaskScheduler& instance();
+
+    void start(int thread_count);
+    void stop();
+    task_token_ptr submit(task_priority priority, task_function task);
+    int get_thread_count() const;
+    size_t get_pending_count() const;
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+private:
+    TaskScheduler() = default;
+    ~TaskScheduler();
+
+    struct Task
+    {
+        task_token_ptr token;
+        task_function function;
+    };
+
+    void worker_loop(size_t worker_index);
+    bool pop_task_locked(Task& task);
+
+    static constexpr size_t kPriorityCount = 3;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    std::array<std::deque<Task>, kPriorityCount> _queues;
+    std::vector<task_token_ptr> _running;
+    std::vector<std::thread> _threads;
+    bool _stopping = false;
+};
@@ -2,9 +2,11 @@
 #include "terminal.h"
 
 #include "app.h"
+#include "profiler.h"
 #include "spdlog/spdlog.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <cstdint>
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
@@ -13,6 +15,7 @@
 #include <string>
 
 #if defined(_WIN32)
+#include <io.h>
 #include <windows.h>
 #else
 #include <sys/ioctl.h>
@@ -52,6 +55,10 @@ static glm::ivec2 query_terminal_size_vec()
 
 void Terminal::init()
 {
+    std::cout << "\x1b[?25l";
+    std::cout.flush();
+    spdlog::info("Terminal: compositing with {}", get_composite_isa_name(_composite_isa));
+
 #if defined(_WIN32)
     HANDLE handle = GetStdHandle(STD_OUTPUT_HANDLE);
     if (handle != INVALID_HANDLE_VALUE)
@@ -123,11 +130,6 @@ static bool decode_utf8_first(const std::string& value, char32_t& out)
     return false;
 }
 
-static bool vec4_equal(const glm::vec4& a, const glm::vec4& b)
-{
-    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
-}
-
 static glm::vec4 normalize_colour(const glm::vec4& colour)
 {
     bool clamped = false;
@@ -181,93 +183,361 @@ static glm::vec4 normalize_colour(const glm::vec4& colour)
     return result;
 }
 
-static bool is_empty_glyph(const Terminal::Character& value)
+static uint8_t unit_to_u8(float value)
 {
-    static const glm::vec4 kDefaultColour(0.0f);
-    if (value.get_glyph() != U' ')
-    {
-        return false;
-    }
-    if (value.get_glyph_colour() != kDefaultColour)
-    {
-        return false;
-    }
-    if (!vec4_equal(value.get_background_colour(), kDefaultColour))
-    {
-        return false;
-    }
-    return true;
+    value = std::clamp(value, 0.0f, 1.0f);
+    return static_cast<uint8_t>(value * 255.0f + 0.5f);
+}
+
+// Callers pass colours already checked by normalize_colour.
+static uint32_t pack_unit_colour(const glm::vec4& colour)
+{
+    float scale = colour.a * 255.0f;
+    int r = static_cast<int>(colour.r * scale + 0.5f);
+    int g = static_cast<int>(colour.g * scale + 0.5f);
+    int b = static_cast<int>(colour.b * scale + 0.5f);
+    int a = static_cast<int>(scale + 0.5f);
+    return static_cast<uint32_t>(r | (g << 8) | (b << 16)) | (static_cast<uint32_t>(a) << 24);
 }
 
-static std::string encode_utf8_char(char32_t value)
+static glm::u8vec3 packed_rgb(uint32_t colour)
+{
+    return glm::u8vec3(
+        static_cast<uint8_t>(colour),
+        static_cast<uint8_t>(colour >> 8),
+        static_cast<uint8_t>(colour >> 16));
+}
+
+static void append_utf8(std::string& output, char32_t value)
 {
-    std::string output;
     if (value <= 0x7F)
     {
         output.push_back(static_cast<char>(value));
-        return output;
+        return;
     }
     if (value <= 0x7FF)
     {
         output.push_back(static_cast<char>(0xC0 | ((value >> 6) & 0x1F)));
         output.push_back(static_cast<char>(0x80 | (value & 0x3F)));
-        return output;
+        return;
     }
     if (value <= 0xFFFF)
     {
         output.push_back(static_cast<char>(0xE0 | ((value >> 12) & 0x0F)));
         output.push_back(static_cast<char>(0x80 | ((value >> 6) & 0x3F)));
         output.push_back(static_cast<char>(0x80 | (value & 0x3F)));
-        return output;
+        return;
     }
     output.push_back(static_cast<char>(0xF0 | ((value >> 18) & 0x07)));
     output.push_back(static_cast<char>(0x80 | ((value >> 12) & 0x3F)));
     output.push_back(static_cast<char>(0x80 | ((value >> 6) & 0x3F)));
     output.push_back(static_cast<char>(0x80 | (value & 0x3F)));
-    return output;
 }
 
-
 static bool u8vec3_equal(const glm::u8vec3& a, const glm::u8vec3& b)
 {
     return a.r == b.r && a.g == b.g && a.b == b.b;
 }
 
-static std::string to_ansi_channel(const glm::u8vec3& colour, bool background)
+static bool same_appearance(const Terminal::Character8& a, const Terminal::Character8& b)
+{
+    return a.get_glyph() == b.get_glyph()
+        && u8vec3_equal(a.get_glyph_colour(), b.get_glyph_colour())
+        && u8vec3_equal(a.get_background_colour(), b.get_background_colour());
+}
+
+// Glyphs outside these ranges may be double width, so the cursor position is
+// no longer trusted after emitting one.
+static bool is_narrow_glyph(char32_t glyph)
+{
+    return glyph < 0x1100 || (glyph >= 0x2000 && glyph < 0x2C00);
+}
+
+struct digit_table
+{
+    char pairs[200];
+
+    constexpr digit_table()
+        : pairs()
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            pairs[i * 2] = static_cast<char>('0' + i / 10);
+            pairs[i * 2 + 1] = static_cast<char>('0' + i % 10);
+        }
+    }
+};
+
+static constexpr digit_table kDigits;
+
+static void append_decimal(std::string& output, uint32_t value)
+{
+    char digits[10];
+    char* end = digits + sizeof(digits);
+    char* cursor = end;
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        cursor -= 2;
+        cursor[0] = kDigits.pairs[pair];
+        cursor[1] = kDigits.pairs[pair + 1];
+    }
+    if (value >= 10)
+    {
+        cursor -= 2;
+        cursor[0] = kDigits.pairs[value * 2];
+        cursor[1] = kDigits.pairs[value * 2 + 1];
+    }
+    else
+    {
+        *--cursor = static_cast<char>('0' + value);
+    }
+    output.append(cursor, static_cast<size_t>(end - cursor));
+}
+
+static size_t decimal_length(uint32_t value)
+{
+    size_t length = 1;
+    while (value >= 10)
+    {
+        value /= 10;
+        ++length;
+    }
+    return length;
+}
+
+// Tracks where the terminal cursor is and which colours are active so each
+// changed cell only pays for the motion and SGR it actually needs.
+struct ansi_emitter
+{
+    std::string& output;
+    int width = 0;
+    int cursor_x = -1;
+    int cursor_y = -1;
+    bool have_colours = false;
+    glm::u8vec3 foreground = glm::u8vec3(0);
+    glm::u8vec3 background = glm::u8vec3(0);
+    size_t runs = 0;
+
+    bool cursor_known() const
+    {
+        return cursor_x >= 0 && cursor_y >= 0;
+    }
+
+    bool matches_colours(const Terminal::Character8& cell) const
+    {
+        return have_colours
+            && u8vec3_equal(cell.get_glyph_colour(), foreground)
+            && u8vec3_equal(cell.get_background_colour(), background);
+    }
+
+    // Rewriting a short gap of unchanged cells is cheaper than a cursor move
+    // when they are plain ASCII in the colours already active.
+    bool fill_gap(const Terminal::Character8* row, int x, int y)
+    {
+        if (!cursor_known() || cursor_y != y || x <= cursor_x)
+        {
+            return false;
+        }
+
+        int gap = x - cursor_x;
+        size_t move_cost = gap == 1 ? 3 : 3 + decimal_length(static_cast<uint32_t>(gap));
+        if (static_cast<size_t>(gap) > move_cost)
+        {
+            return false;
+        }
+
+        for (int i = cursor_x; i < x; ++i)
+        {
+            if (row[i].get_glyph() > 0x7E || row[i].get_glyph() < 0x20 || !matches_colours(row[i]))
+            {
+                return false;
+            }
+        }
+
+        for (int i = cursor_x; i < x; ++i)
+        {
+            output.push_back(static_cast<char>(row[i].get_glyph()));
+        }
+        cursor_x = x;
+        return true;
+    }
+
+    void move_to(int x, int y)
+    {
+        if (cursor_known() && cursor_x == x && cursor_y == y)
+        {
+            return;
+        }
+
+        ++runs;
+        if (cursor_known() && cursor_y == y)
+        {
+            if (x == 0)
+            {
+                output.push_back('\r');
+            }
+            else if (x > cursor_x)
+            {
+                output.append("\x1b[", 2);
+                if (x - cursor_x > 1)
+                {
+                    append_decimal(output, static_cast<uint32_t>(x - cursor_x));
+                }
+                output.push_back('C');
+            }
+            else
+            {
+                output.append("\x1b[", 2);
+                if (cursor_x - x > 1)
+                {
+                    append_decimal(output, static_cast<uint32_t>(cursor_x - x));
+                }
+                output.push_back('D');
+            }
+        }
+        else if (cursor_known() && cursor_y + 1 == y && x == 0)
+        {
+            output.append("\r\n", 2);
+        }
+        else
+        {
+            output.append("\x1b[", 2);
+            if (y > 0 || x > 0)
+            {
+                append_decimal(output, static_cast<uint32_t>(y + 1));
+            }
+            if (x > 0)
+            {
+                output.push_back(';');
+                append_decimal(output, static_cast<uint32_t>(x + 1));
+            }
+            output.push_back('H');
+        }
+
+        cursor_x = x;
+        cursor_y = y;
+    }
+
+    void set_colours(const glm::u8vec3& fg, const glm::u8vec3& bg)
+    {
+        bool fg_changed = !have_colours || !u8vec3_equal(fg, foreground);
+        bool bg_changed = !have_colours || !u8vec3_equal(bg, background);
+        if (!fg_changed && !bg_changed)
+        {
+            return;
+        }
+
+        output.append("\x1b[", 2);
+        if (fg_changed)
+        {
+            output.append("38;2;", 5);
+            append_decimal(output, fg.r);
+            output.push_back(';');
+            append_decimal(output, fg.g);
+            output.push_back(';');
+            append_decimal(output, fg.b);
+        }
+        if (bg_changed)
+        {
+            if (fg_changed)
+            {
+                output.push_back(';');
+            }
+            output.append("48;2;", 5);
+            append_decimal(output, bg.r);
+            output.push_back(';');
+            append_decimal(output, bg.g);
+            output.push_back(';');
+            append_decimal(output, bg.b);
+        }
+        output.push_back('m');
+
+        foreground = fg;
+        background = bg;
+        have_colours = true;
+    }
+
+    void put(const Terminal::Character8& cell)
+    {
+        set_colours(cell.get_glyph_colour(), cell.get_background_colour());
+        append_utf8(output, cell.get_glyph());
+
+        // Writing the last column leaves the cursor in the pending-wrap state,
+        // which terminals disagree on, so force an absolute move afterwards.
+        ++cursor_x;
+        if (cursor_x >= width || !is_narrow_glyph(cell.get_glyph()))
+        {
+            cursor_x = -1;
+            cursor_y = -1;
+        }
+    }
+};
+
+static void write_output(int fd, const std::string& data)
 {
-    std::string sequence;
-    sequence.reserve(24);
-    sequence += "\x1b[";
-    sequence += background ? "48" : "38";
-    sequence += ";2;";
-    sequence += std::to_string(colour.r);
-    sequence += ";";
-    sequence += std::to_string(colour.g);
-    sequence += ";";
-    sequence += std::to_string(colour.b);
-    sequence += "m";
-    return sequence;
+    if (data.empty())
+    {
+        return;
+    }
+
+#if defined(_WIN32)
+    if (fd != 1)
+    {
+        _write(fd, data.data(), static_cast<unsigned int>(data.size()));
+        return;
+    }
+    std::fwrite(data.data(), 1, data.size(), stdout);
+    std::fflush(stdout);
+#else
+    if (fd == STDOUT_FILENO)
+    {
+        std::fflush(stdout);
+    }
+    const char* cursor = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0)
+    {
+        ssize_t written = ::write(fd, cursor, remaining);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            spdlog::warn("Terminal: write failed: {}", std::strerror(errno));
+            return;
+        }
+        cursor += written;
+        remaining -= static_cast<size_t>(written);
+    }
+#endif
 }
 
 Terminal::Terminal()
+    : _composite_isa(detect_composite_isa()),
+      _composite_kernel(get_composite_kernel(_composite_isa))
 {
-    std::cout << "\x1b[?25l";
-    std::cout.flush();
     on_terminal_resize();
 }
 
 void Terminal::shutdown()
 {
+    if (_frame_stats.frame_count > 0)
+    {
+        spdlog::info(
+            "Terminal: {} frames, {} bytes, {:.1f} bytes/frame",
+            _frame_stats.frame_count,
+            _frame_stats.total_bytes,
+            static_cast<double>(_frame_stats.total_bytes) / static_cast<double>(_frame_stats.frame_count));
+    }
     clear_screen();
     std::fwrite("\x1b[0m\x1b[?25h", 1, 10, stdout);
     std::fflush(stdout);
 }
 
-Terminal::BackingStore::BackingStore()
-    : layers("terminal.layers")
-{
-    layer_order = {"wallpaper", "logo", "buffer", "juice"};
-}
+Terminal::BackingStore::BackingStore() = default;
 
 Terminal::BackingStore::BackingStore(int width, int height)
     : BackingStore()
@@ -279,30 +549,100 @@ void Terminal::BackingStore::resize(int width, int height)
 {
     this->width = std::max(0, width);
     this->height = std::max(0, height);
-    size_t count = static_cast<size_t>(this->width * this->height);
-    for (const auto& name : layer_order)
-    {
-        auto& layer_ref = layers.get_or_emplace(name);
-        layer_ref.assign(count, Character{});
-    }
-    this->pending_frame.assign(count, Character8{});
-    this->previous_frame.assign(count, Character8{});
-    dirty.assign(count, true);
+    cell_count = static_cast<size_t>(this->width * this->height);
+
+    constexpr size_t kAlignment = 64;
+    constexpr size_t kCellsPerLine = kAlignment / sizeof(char32_t);
+    _plane_stride = (cell_count + kCellsPerLine - 1) / kCellsPerLine * kCellsPerLine;
+    size_t plane_bytes = _plane_stride * kLayerCount * sizeof(uint32_t);
+    _storage.assign(plane_bytes * 3 + kAlignment, 0);
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(_storage.data());
+    unsigned char* aligned = _storage.data() + ((kAlignment - base % kAlignment) % kAlignment);
+    _glyphs = reinterpret_cast<char32_t*>(aligned);
+    _foregrounds = reinterpret_cast<uint32_t*>(aligned + plane_bytes);
+    _backgrounds = reinterpret_cast<uint32_t*>(aligned + plane_bytes * 2);
+    std::fill(_glyphs, _glyphs + _plane_stride * kLayerCount, U' ');
+
+    this->pending_frame.assign(cell_count, Character8{});
+    this->previous_frame.assign(cell_count, Character8{});
+    dirty.assign(cell_count, true);
+    dirty_rows.assign(static_cast<size_t>(this->height), row_span{0, this->width});
 }
 
-std::vector<Terminal::Character>& Terminal::BackingStore::layer(const std::string& name)
+char32_t* Terminal::BackingStore::glyphs(Layer layer)
 {
-    return layers.at(name);
+    return _glyphs + static_cast<size_t>(layer) * _plane_stride;
 }
 
-const std::vector<Terminal::Character>& Terminal::BackingStore::layer(const std::string& name) const
+const char32_t* Terminal::BackingStore::glyphs(Layer layer) const
 {
-    return layers.at(name);
+    return _glyphs + static_cast<size_t>(layer) * _plane_stride;
 }
 
-bool Terminal::BackingStore::has_layer(const std::string& name) const
+uint32_t* Terminal::BackingStore::foregrounds(Layer layer)
 {
-    return layers.contains(name);
+    return _foregrounds + static_cast<size_t>(layer) * _plane_stride;
+}
+
+const uint32_t* Terminal::BackingStore::foregrounds(Layer layer) const
+{
+    return _foregrounds + static_cast<size_t>(layer) * _plane_stride;
+}
+
+uint32_t* Terminal::BackingStore::backgrounds(Layer layer)
+{
+    return _backgrounds + static_cast<size_t>(layer) * _plane_stride;
+}
+
+const uint32_t* Terminal::BackingStore::backgrounds(Layer layer) const
+{
+    return _backgrounds + static_cast<size_t>(layer) * _plane_stride;
+}
+
+bool Terminal::BackingStore::is_empty(Layer layer, size_t index) const
+{
+    return glyphs(layer)[index] == U' '
+        && foregrounds(layer)[index] == 0
+        && backgrounds(layer)[index] == 0;
+}
+
+Terminal::packed_cell Terminal::BackingStore::get_cell(Layer layer, size_t index) const
+{
+    return packed_cell{glyphs(layer)[index], foregrounds(layer)[index], backgrounds(layer)[index]};
+}
+
+void Terminal::BackingStore::set_cell(Layer layer, size_t index, const packed_cell& cell)
+{
+    glyphs(layer)[index] = cell.glyph;
+    foregrounds(layer)[index] = cell.foreground;
+    backgrounds(layer)[index] = cell.background;
+}
+
+void Terminal::BackingStore::clear_cell(Layer layer, size_t index)
+{
+    glyphs(layer)[index] = U' ';
+    foregrounds(layer)[index] = 0;
+    backgrounds(layer)[index] = 0;
+}
+
+void Terminal::BackingStore::mark_changed(size_t index)
+{
+    if (width <= 0)
+    {
+        return;
+    }
+
+    int x = static_cast<int>(index % static_cast<size_t>(width));
+    row_span& span = dirty_rows[index / static_cast<size_t>(width)];
+    if (span.begin >= span.end)
+    {
+        span.begin = x;
+        span.end = x + 1;
+        return;
+    }
+    span.begin = std::min(span.begin, x);
+    span.end = std::max(span.end, x + 1);
 }
 
 Terminal::Character::Character()
@@ -430,9 +770,59 @@ const glm::vec4& Terminal::Character::get_background_colour() const
     return _background_colour;
 }
 
+Terminal::packed_cell Terminal::Character::pack() const
+{
+    return packed_cell{_glyph, pack_colour(_glyph_colour), pack_colour(_background_colour)};
+}
+
+uint32_t Terminal::pack_colour(const glm::vec4& colour)
+{
+    float alpha = std::clamp(colour.a, 0.0f, 1.0f);
+    return static_cast<uint32_t>(unit_to_u8(colour.r * alpha))
+        | (static_cast<uint32_t>(unit_to_u8(colour.g * alpha)) << 8)
+        | (static_cast<uint32_t>(unit_to_u8(colour.b * alpha)) << 16)
+        | (static_cast<uint32_t>(unit_to_u8(alpha)) << 24);
+}
+
+glm::vec4 Terminal::unpack_colour(uint32_t colour)
+{
+    float alpha = static_cast<float>(colour >> 24) / 255.0f;
+    if (alpha <= 0.0f)
+    {
+        return glm::vec4(0.0f);
+    }
+
+    glm::u8vec3 rgb = packed_rgb(colour);
+    return glm::vec4(
+        std::min(1.0f, static_cast<float>(rgb.r) / 255.0f / alpha),
+        std::min(1.0f, static_cast<float>(rgb.g) / 255.0f / alpha),
+        std::min(1.0f, static_cast<float>(rgb.b) / 255.0f / alpha),
+        alpha);
+}
+
+
+void Terminal::set_fixed_size(const glm::ivec2& size)
+{
+    _fixed_size = true;
+    if (size != _size)
+    {
+        _size = size;
+        _store.resize(_size.x, _size.y);
+    }
+}
+
+void Terminal::set_output_fd(int fd)
+{
+    _output_fd = fd;
+}
 
 void Terminal::on_terminal_resize()
 {
+    if (_fixed_size)
+    {
+        return;
+    }
+
     glm::ivec2 size = query_terminal_size_vec();
     if (size != _size)
     {
@@ -482,14 +872,12 @@ glm::vec4 Terminal::get_canvas_sample(const glm::ivec2& location) const
     }
 
     size_t index = get_index(location);
-    const auto& canvas_layer = _store.layer("wallpaper");
-    if (index >= canvas_layer.size())
+    if (index >= _store.cell_count)
     {
         return glm::vec4(0.0f);
     }
 
-    const Character& cell = canvas_layer[index];
-    return cell.get_background_colour();
+    return unpack_colour(_store.backgrounds(Layer::wallpaper)[index]);
 }
 
 void Terminal::set_glyph(char32_t glyph, const glm::ivec2& location)
@@ -500,13 +888,12 @@ void Terminal::set_glyph(char32_t glyph, const glm::ivec2& location)
     }
 
     size_t index = get_index(location);
-    auto& buffer_layer = _store.layer("buffer");
-    if (index >= buffer_layer.size())
+    if (index >= _store.cell_count)
     {
         return;
     }
 
-    buffer_layer[index].set_glyph(glyph);
+    _store.glyphs(Layer::buffer)[index] = glyph;
     _store.pending_frame[index].set_particle_id(0u);
     _store.dirty[index] = true;
 }
@@ -519,18 +906,14 @@ void Terminal::set_glyph(const glm::ivec2& location, char32_t glyph, const glm::
     }
 
     size_t index = get_index(location);
-    auto& buffer_layer = _store.layer("buffer");
-    if (index >= buffer_layer.size())
+    if (index >= _store.cell_count)
     {
         return;
     }
 
-    Terminal::Character& cell = buffer_layer[index];
-    cell.set_glyph(glyph);
-    glm::vec4 fg = normalize_colour(foreground);
-    glm::vec4 bg = normalize_colour(background);
-    cell.set_glyph_colour(fg);
-    cell.set_background_colour(bg);
+    _store.glyphs(Layer::buffer)[index] = glyph;
+    _store.foregrounds(Layer::buffer)[index] = pack_unit_colour(normalize_colour(foreground));
+    _store.backgrounds(Layer::buffer)[index] = pack_unit_colour(normalize_colour(background));
     _store.pending_frame[index].set_particle_id(0u);
     _store.dirty[index] = true;
 }
@@ -543,18 +926,14 @@ void Terminal::set_particle_glyph(const glm::ivec2& location, char32_t glyph, co
     }
 
     size_t index = get_index(location);
-    auto& juice_layer = _store.layer("juice");
-    if (index >= juice_layer.size())
+    if (index >= _store.cell_count)
     {
         return;
     }
 
-    Terminal::Character& cell = juice_layer[index];
-    cell.set_glyph(glyph);
-    glm::vec4 fg = normalize_colour(foreground);
-    glm::vec4 bg = normalize_colour(background);
-    cell.set_glyph_colour(fg);
-    cell.set_background_colour(bg);
+    _store.glyphs(Layer::juice)[index] = glyph;
+    _store.foregrounds(Layer::juice)[index] = pack_unit_colour(normalize_colour(foreground));
+    _store.backgrounds(Layer::juice)[index] = pack_unit_colour(normalize_colour(background));
     _store.pending_frame[index].set_particle_id(particle_id);
     _store.dirty[index] = true;
 }
@@ -567,33 +946,23 @@ void Terminal::clear_cell(const glm::ivec2& location)
     }
 
     size_t index = get_index(location);
-    auto& buffer_layer = _store.layer("buffer");
-    if (index >= buffer_layer.size())
+    if (index >= _store.cell_count)
     {
         return;
     }
 
-    Terminal::Character& cell = buffer_layer[index];
-    cell.set_glyph(U' ');
-    cell.set_glyph_colour(glm::vec4(0.0f));
-    cell.set_background_colour(glm::vec4(0.0f));
+    _store.clear_cell(Layer::buffer, index);
     _store.pending_frame[index].set_particle_id(0u);
     _store.dirty[index] = true;
 }
 
 void Terminal::clear_juice()
 {
-    auto& juice_layer = _store.layer("juice");
-    if (juice_layer.empty())
-    {
-        return;
-    }
-
-    for (size_t index = 0; index < juice_layer.size(); ++index)
+    for (size_t index = 0; index < _store.cell_count; ++index)
     {
-        if (!is_empty_glyph(juice_layer[index]))
+        if (!_store.is_empty(Layer::juice, index))
         {
-            juice_layer[index] = Character{};
+            _store.clear_cell(Layer::juice, index);
             _store.pending_frame[index].set_particle_id(0u);
             _store.dirty[index] = true;
         }
@@ -602,25 +971,19 @@ void Terminal::clear_juice()
 
 void Terminal::set_canvas(const std::vector<Character>& source)
 {
-    set_layer("wallpaper", source);
+    set_layer(Layer::wallpaper, source);
 }
 
-void Terminal::set_layer(const std::string& name, const std::vector<Character>& source)
+void Terminal::set_layer(Layer layer, const std::vector<Character>& source)
 {
-    if (!_store.has_layer(name))
-    {
-        return;
-    }
-
-    auto& layer_ref = _store.layer(name);
-    if (source.size() != layer_ref.size())
+    if (layer >= Layer::count || source.size() != _store.cell_count)
     {
         return;
     }
 
     for (size_t i = 0; i < source.size(); ++i)
     {
-        layer_ref[i] = source[i];
+        _store.set_cell(layer, i, source[i].pack());
         _store.dirty[i] = true;
     }
 }
@@ -641,18 +1004,15 @@ void Terminal::select_region(const glm::ivec2& location, const glm::ivec2& size)
         return;
     }
 
-    glm::vec4 highlight(0.2f, 0.2f, 0.2f, 1.0f);
+    const uint32_t highlight = pack_colour(glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+    uint32_t* backgrounds = _store.backgrounds(Layer::buffer);
     for (int y = min_y; y <= max_y; ++y)
     {
+        size_t row = get_index(glm::ivec2(min_x, y));
         for (int x = min_x; x <= max_x; ++x)
         {
-            size_t index = get_index(glm::ivec2(x, y));
-            auto& buffer_layer = _store.layer("buffer");
-            if (index >= buffer_layer.size())
-            {
-                continue;
-            }
-            buffer_layer[index].set_background_colour(highlight);
+            size_t index = row + static_cast<size_t>(x - min_x);
+            backgrounds[index] = highlight;
             _store.dirty[index] = true;
         }
     }
@@ -674,18 +1034,15 @@ void Terminal::deselect_region(const glm::ivec2& location, const glm::ivec2& siz
         return;
     }
 
-    glm::vec4 clear_bg(0.0f);
+    const uint32_t clear_bg = 0;
+    uint32_t* backgrounds = _store.backgrounds(Layer::buffer);
     for (int y = min_y; y <= max_y; ++y)
     {
+        size_t row = get_index(glm::ivec2(min_x, y));
         for (int x = min_x; x <= max_x; ++x)
         {
-            size_t index = get_index(glm::ivec2(x, y));
-            auto& buffer_layer = _store.layer("buffer");
-            if (index >= buffer_layer.size())
-            {
-                continue;
-            }
-            buffer_layer[index].set_background_colour(clear_bg);
+            size_t index = row + static_cast<size_t>(x - min_x);
+            backgrounds[index] = clear_bg;
             _store.dirty[index] = true;
         }
     }
@@ -707,6 +1064,11 @@ bool Terminal::is_dirty(const glm::ivec2& location) const
     return _store.dirty[index];
 }
 
+const terminal_frame_stats& Terminal::get_frame_stats() const
+{
+    return _frame_stats;
+}
+
 void Terminal::update()
 {
     on_terminal_resize();
@@ -722,102 +1084,58 @@ void Terminal::update()
 
 void Terminal::eightbitify()
 {
-    if (_store.layer("buffer").empty() || _store.dirty.empty())
+    ProfileScope scope(profile_zone::eightbitify);
+    if (_store.cell_count == 0 || _store.dirty.empty())
     {
         return;
     }
 
-
-    auto to_u8 = [](float value)
+    composite_planes planes;
+    for (size_t layer = 0; layer < kLayerCount; ++layer)
     {
-        value = std::clamp(value, 0.0f, 1.0f);
-        return static_cast<uint8_t>(value * 255.0f + 0.5f);
-    };
+        planes.glyphs[layer] = _store.glyphs(static_cast<Layer>(layer));
+        planes.foregrounds[layer] = _store.foregrounds(static_cast<Layer>(layer));
+        planes.backgrounds[layer] = _store.backgrounds(static_cast<Layer>(layer));
+    }
 
-    auto& buffer_layer = _store.layer("buffer");
-    auto& juice_layer = _store.layer("juice");
-    const auto& wallpaper_layer = _store.layer("wallpaper");
-    const auto& logo_layer = _store.layer("logo");
-    for (size_t index = 0; index < buffer_layer.size(); ++index)
+    constexpr size_t kBlock = 64;
+    char32_t glyphs[kBlock];
+    uint32_t foregrounds[kBlock];
+    uint32_t backgrounds[kBlock];
+    uint8_t* dirty = _store.dirty.data();
+    for (size_t begin = 0; begin < _store.cell_count; begin += kBlock)
     {
-        if (!_store.dirty[index])
+        size_t count = std::min(kBlock, _store.cell_count - begin);
+        if (!std::memchr(dirty + begin, 1, count))
         {
             continue;
         }
 
-        const Character& buffer_cell = buffer_layer[index];
-        const Character& juice_cell = juice_layer[index];
-        const Character& logo_cell = logo_layer[index];
-        const Character* wallpaper_cell = &wallpaper_layer[index];
-        const Character* desired = &buffer_cell;
-
-        if (is_empty_glyph(buffer_cell))
+        _composite_kernel(planes, begin, count, glyphs, foregrounds, backgrounds);
+        for (size_t i = 0; i < count; ++i)
         {
-            if (!is_empty_glyph(logo_cell))
+            size_t index = begin + i;
+            if (!dirty[index])
             {
-                desired = &logo_cell;
-            }
-            else
-            {
-                desired = wallpaper_cell;
+                continue;
             }
-        }
-
-        const Character* overlay = nullptr;
-        if (!is_empty_glyph(juice_cell))
-        {
-            overlay = &juice_cell;
-        }
-
-
-        glm::vec4 fg = desired->get_glyph_colour();
-        glm::vec4 bg = desired->get_background_colour();
-
-        if (desired == &logo_cell)
-        {
-            bg = wallpaper_cell->get_background_colour();
-        }
 
-        if (desired == &buffer_cell && bg.w < 1.0f)
-        {
-            glm::vec4 canvas_bg = wallpaper_cell->get_background_colour();
-            float inv = 1.0f - bg.w;
-            bg = glm::vec4(
-                bg.r * bg.w + canvas_bg.r * inv,
-                bg.g * bg.w + canvas_bg.g * inv,
-                bg.b * bg.w + canvas_bg.b * inv,
-                1.0f);
-        }
-
-        if (overlay)
-        {
-            glm::vec4 overlay_fg = overlay->get_glyph_colour();
-            glm::vec4 overlay_bg = overlay->get_background_colour();
-            if (overlay_bg.w < 1.0f)
+            Character8& out = _store.pending_frame[index];
+            out.set_glyph(glyphs[i]);
+            out.set_glyph_colour(packed_rgb(foregrounds[i]));
+            out.set_background_colour(packed_rgb(backgrounds[i]));
+            if (!same_appearance(out, _store.previous_frame[index]))
             {
-                float inv = 1.0f - overlay_bg.w;
-                overlay_bg = glm::vec4(
-                    overlay_bg.r * overlay_bg.w + bg.r * inv,
-                    overlay_bg.g * overlay_bg.w + bg.g * inv,
-                    overlay_bg.b * overlay_bg.w + bg.b * inv,
-                    1.0f);
+                _store.mark_changed(index);
             }
-            fg = overlay_fg;
-            bg = overlay_bg;
-            desired = overlay;
+            dirty[index] = 0;
         }
-
-        Character8& out = _store.pending_frame[index];
-        out.set_glyph(desired->get_glyph());
-        out.set_glyph_colour(glm::u8vec3(to_u8(fg.r), to_u8(fg.g), to_u8(fg.b)));
-        out.set_background_colour(glm::u8vec3(to_u8(bg.r), to_u8(bg.g), to_u8(bg.b)));
-
-        _store.dirty[index] = false;
     }
 }
 
 void Terminal::update_eightbit()
 {
+    ProfileScope scope(profile_zone::emit);
     on_terminal_resize();
     if (_size.x <= 0 || _size.y <= 0)
     {
@@ -831,57 +1149,52 @@ void Terminal::update_eightbit()
         return;
     }
 
-    std::string sequence;
-    sequence.reserve(64 + total * 6);
-
-    bool have_fg = false;
-    bool have_bg = false;
-    glm::u8vec3 current_fg(0);
-    glm::u8vec3 current_bg(0);
-
-    for (size_t index = 0; index < total; ++index)
+    _output.clear();
+    ansi_emitter emitter{_output, _size.x};
+    size_t cells = 0;
+    int width = _store.width;
+    for (int y = 0; y < _store.height && y < _size.y; ++y)
     {
-        const Character8& next = _store.pending_frame[index];
-        const Character8& prev = _store.previous_frame[index];
-        if (next == prev)
+        row_span& span = _store.dirty_rows[static_cast<size_t>(y)];
+        if (span.begin >= span.end)
         {
             continue;
         }
 
-        glm::ivec2 location = get_location(index);
-        if (location.x < 0 || location.y < 0 || location.x >= _size.x || location.y >= _size.y)
+        size_t row_start = static_cast<size_t>(y) * static_cast<size_t>(width);
+        const Character8* row = &_store.pending_frame[row_start];
+        int end = std::min(span.end, _size.x);
+        for (int x = span.begin; x < end; ++x)
         {
-            continue;
-        }
-
-        sequence += "\x1b[" + std::to_string(location.y + 1) + ";" + std::to_string(location.x + 1) + "H";
-
-        const glm::u8vec3& fg = next.get_glyph_colour();
-        const glm::u8vec3& bg = next.get_background_colour();
-
-        if (!have_fg || !u8vec3_equal(fg, current_fg))
-        {
-            sequence += to_ansi_channel(fg, false);
-            current_fg = fg;
-            have_fg = true;
-        }
+            const Character8& next = row[x];
+            Character8& prev = _store.previous_frame[row_start + static_cast<size_t>(x)];
+            if (same_appearance(next, prev))
+            {
+                prev = next;
+                continue;
+            }
 
-        if (!have_bg || !u8vec3_equal(bg, current_bg))
-        {
-            sequence += to_ansi_channel(bg, true);
-            current_bg = bg;
-            have_bg = true;
+            if (!emitter.fill_gap(row, x, y))
+            {
+                emitter.move_to(x, y);
+            }
+            emitter.put(next);
+            prev = next;
+            ++cells;
         }
-
-        sequence += encode_utf8_char(next.get_glyph());
-        _store.previous_frame[index] = next;
+        span = row_span{};
     }
 
-    if (!sequence.empty())
     {
-        std::fwrite(sequence.data(), 1, sequence.size(), stdout);
-        std::fflush(stdout);
+        ProfileScope flush_scope(profile_zone::flush);
+        write_output(_output_fd, _output);
     }
+
+    _frame_stats.bytes_written = _output.size();
+    _frame_stats.cells_written = cells;
+    _frame_stats.runs = emitter.runs;
+    _frame_stats.total_bytes += _output.size();
+    ++_frame_stats.frame_count;
 }
 
 void Terminal::mark_all_dirty()
@@ -891,7 +1204,7 @@ void Terminal::mark_all_dirty()
         return;
     }
 
-    std::fill(_store.dirty.begin(), _store.dirty.end(), true);
+    std::fill(_store.dirty.begin(), _store.dirty.end(), 1);
 }
 
 void Terminal::clear_screen()
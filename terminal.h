@@ -10,11 +10,50 @@
 #include <glm/vec4.hpp>
 #include <glm/ext/vector_uint3_sized.hpp>
 
-#include "map.h"
+#include "composite.h"
+
+struct terminal_frame_stats
+{
+    size_t bytes_written = 0;
+    size_t cells_written = 0;
+    size_t runs = 0;
+    size_t total_bytes = 0;
+    uint64_t frame_count = 0;
+};
 
 class Terminal
 {
 public:
+    enum class Layer : uint8_t
+    {
+        wallpaper = 0,
+        logo,
+        buffer,
+        juice,
+        count,
+    };
+
+    static constexpr size_t kLayerCount = static_cast<size_t>(Layer::count);
+
+    // Colours are premultiplied RGBA8 packed with red in the low byte.
+    struct packed_cell
+    {
+        char32_t glyph = U' ';
+        uint32_t foreground = 0;
+        uint32_t background = 0;
+    };
+
+    static_assert(sizeof(packed_cell) == 12, "packed_cell must stay at 12 bytes");
+
+    static uint32_t pack_colour(const glm::vec4& colour);
+    static glm::vec4 unpack_colour(uint32_t colour);
+
+    struct row_span
+    {
+        int begin = 0;
+        int end = 0;
+    };
+
     class Character
     {
     public:
@@ -28,6 +67,7 @@ public:
         void set_background_colour(const glm::vec4& colour);
         const glm::vec4& get_glyph_colour() const;
         const glm::vec4& get_background_colour() const;
+        packed_cell pack() const;
 
     private:
         char32_t _glyph = U' ';
@@ -66,17 +106,36 @@ public:
     public:
         BackingStore();
         BackingStore(int width, int height);
+        BackingStore(const BackingStore&) = delete;
+        BackingStore& operator=(const BackingStore&) = delete;
         void resize(int width, int height);
-        std::vector<Character>& layer(const std::string& name);
-        const std::vector<Character>& layer(const std::string& name) const;
-        bool has_layer(const std::string& name) const;
+        char32_t* glyphs(Layer layer);
+        const char32_t* glyphs(Layer layer) const;
+        uint32_t* foregrounds(Layer layer);
+        const uint32_t* foregrounds(Layer layer) const;
+        uint32_t* backgrounds(Layer layer);
+        const uint32_t* backgrounds(Layer layer) const;
+        bool is_empty(Layer layer, size_t index) const;
+        packed_cell get_cell(Layer layer, size_t index) const;
+        void set_cell(Layer layer, size_t index, const packed_cell& cell);
+        void clear_cell(Layer layer, size_t index);
+        void mark_changed(size_t index);
         int width = 0;
         int height = 0;
-        wynott::map<std::string, std::vector<Character>> layers;
-        std::vector<std::string> layer_order;
+        size_t cell_count = 0;
         std::vector<Character8> pending_frame;
         std::vector<Character8> previous_frame;
-        std::vector<bool> dirty;
+        std::vector<uint8_t> dirty;
+        std::vector<row_span> dirty_rows;
+
+    private:
+        // Every layer's glyph, foreground and background planes share one
+        // allocation; each plane starts on a 64-byte boundary.
+        std::vector<unsigned char> _storage;
+        char32_t* _glyphs = nullptr;
+        uint32_t* _foregrounds = nullptr;
+        uint32_t* _backgrounds = nullptr;
+        size_t _plane_stride = 0;
     };
 
     Terminal();
@@ -84,6 +143,8 @@ public:
     void on_terminal_resize();
     void shutdown();
     void init();
+    void set_fixed_size(const glm::ivec2& size);
+    void set_output_fd(int fd);
     
     void update();
     void eightbitify();
@@ -95,13 +156,14 @@ public:
     std::size_t get_index(const glm::ivec2& location) const;
     glm::vec4 get_canvas_sample(const glm::ivec2& location) const;
     bool is_dirty(const glm::ivec2& location) const;
+    const terminal_frame_stats& get_frame_stats() const;
 
     void set_glyph(char32_t glyph, const glm::ivec2& location);
     void set_glyph(const glm::ivec2& location, char32_t glyph, const glm::vec4& foreground, const glm::vec4& background);
     void set_particle_glyph(const glm::ivec2& location, char32_t glyph, const glm::vec4& foreground, const glm::vec4& background, uint32_t particle_id);
     void clear_cell(const glm::ivec2& location);
     void set_canvas(const std::vector<Character>& source);
-    void set_layer(const std::string& name, const std::vector<Character>& source);
+    void set_layer(Layer layer, const std::vector<Character>& source);
     void clear_juice();
     void select_region(const glm::ivec2& location, const glm::ivec2& size);
     void deselect_region(const glm::ivec2& location, const glm::ivec2& size);
@@ -116,5 +178,11 @@ private:
 
 private:
     glm::ivec2 _size = glm::ivec2(0);
+    bool _fixed_size = false;
+    int _output_fd = 1;
     BackingStore _store;
+    std::string _output;
+    composite_isa _composite_isa = composite_isa::scalar;
+    composite_kernel _composite_kernel = nullptr;
+    terminal_frame_stats _frame_stats;
 };
@@ -0,0 +1,357 @@
+#include "waveform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.h"
+#include "miniaudio.h"
+#include "task_scheduler.h"
+
+static constexpr char kPeakMagic[4] = {'A', 'G', 'P', 'K'};
+static constexpr uint32_t kPeakVersion = 1;
+static constexpr uint32_t kPeakSampleRate = 48000;
+static constexpr uint32_t kBaseFramesPerBlock = 1024;
+static constexpr uint32_t kLevelFactor = 4;
+static constexpr int kMaxLevels = 6;
+
+struct peak_file_header
+{
+    char magic[4];
+    uint32_t version;
+    int64_t modified_time;
+    int64_t file_size;
+    uint32_t sample_rate;
+    uint32_t level_count;
+    uint64_t total_frames;
+};
+
+static uint64_t hash_path(const std::string& path)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char ch : path)
+    {
+        hash ^= ch;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static int16_t quantize_signed(float value)
+{
+    float clamped = std::clamp(value, -1.0f, 1.0f);
+    return static_cast<int16_t>(std::lround(clamped * 32767.0f));
+}
+
+static uint16_t quantize_unsigned(float value)
+{
+    float clamped = std::clamp(value, 0.0f, 1.0f);
+    return static_cast<uint16_t>(std::lround(clamped * 65535.0f));
+}
+
+static float block_amplitude(const waveform_level& level, size_t block)
+{
+    int lo = std::abs(static_cast<int>(level.min[block]));
+    int hi = std::abs(static_cast<int>(level.max[block]));
+    return static_cast<float>(std::max(lo, hi)) / 32767.0f;
+}
+
+bool waveform_peaks::empty() const
+{
+    return levels.empty() || levels.front().max.empty();
+}
+
+float waveform_peaks::get_peak() const
+{
+    if (empty())
+    {
+        return 0.0f;
+    }
+
+    const waveform_level& level = levels.back();
+    float peak = 0.0f;
+    for (size_t i = 0; i < level.max.size(); ++i)
+    {
+        peak = std::max(peak, block_amplitude(level, i));
+    }
+    return peak;
+}
+
+void waveform_peaks::reduce(int columns, std::vector<float>& amplitudes) const
+{
+    amplitudes.clear();
+    if (columns <= 0 || empty())
+    {
+        return;
+    }
+
+    const waveform_level* chosen = &levels.front();
+    for (auto it = levels.rbegin(); it != levels.rend(); ++it)
+    {
+        if (it->max.size() >= static_cast<size_t>(columns))
+        {
+            chosen = &(*it);
+            break;
+        }
+    }
+
+    size_t blocks = chosen->max.size();
+    amplitudes.assign(static_cast<size_t>(columns), 0.0f);
+    for (int x = 0; x < columns; ++x)
+    {
+        size_t start = (static_cast<size_t>(x) * blocks) / static_cast<size_t>(columns);
+        size_t end = (static_cast<size_t>(x + 1) * blocks) / static_cast<size_t>(columns);
+        end = std::min(blocks, std::max(end, start + 1));
+
+        float peak = 0.0f;
+        for (size_t i = start; i < end; ++i)
+        {
+            peak = std::max(peak, block_amplitude(*chosen, i));
+        }
+        amplitudes[static_cast<size_t>(x)] = peak;
+    }
+}
+
+std::string waveform_cache_path(const std::string& cache_directory, const std::string& audio_path)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.peaks", static_cast<unsigned long long>(hash_path(audio_path)));
+    std::filesystem::path path = std::filesystem::path(cache_directory.empty() ? "." : cache_directory) / "peaks" / name;
+    return path.string();
+}
+
+bool load_waveform_peaks(
+    const std::string& cache_path,
+    int64_t modified_time,
+    int64_t file_size,
+    waveform_peaks& peaks)
+{
+    std::ifstream file(cache_path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    peak_file_header header{};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file
+        || !std::equal(std::begin(kPeakMagic), std::end(kPeakMagic), header.magic)
+        || header.version != kPeakVersion
+        || header.modified_time != modified_time
+        || header.file_size != file_size
+        || header.level_count == 0
+        || header.level_count > static_cast<uint32_t>(kMaxLevels))
+    {
+        return false;
+    }
+
+    waveform_peaks loaded;
+    loaded.sample_rate = header.sample_rate;
+    loaded.total_frames = header.total_frames;
+    loaded.levels.resize(header.level_count);
+    for (waveform_level& level : loaded.levels)
+    {
+        uint32_t block_count = 0;
+        file.read(reinterpret_cast<char*>(&level.frames_per_block), sizeof(level.frames_per_block));
+        file.read(reinterpret_cast<char*>(&block_count), sizeof(block_count));
+        if (!file || level.frames_per_block == 0
+            || block_count > header.total_frames / level.frames_per_block + 1)
+        {
+            return false;
+        }
+
+        level.min.resize(block_count);
+        level.max.resize(block_count);
+        level.rms.resize(block_count);
+        file.read(reinterpret_cast<char*>(level.min.data()), static_cast<std::streamsize>(block_count * sizeof(int16_t)));
+        file.read(reinterpret_cast<char*>(level.max.data()), static_cast<std::streamsize>(block_count * sizeof(int16_t)));
+        file.read(reinterpret_cast<char*>(level.rms.data()), static_cast<std::streamsize>(block_count * sizeof(uint16_t)));
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    peaks = std::move(loaded);
+    return true;
+}
+
+bool save_waveform_peaks(
+    const std::string& cache_path,
+    int64_t modified_time,
+    int64_t file_size,
+    const waveform_peaks& peaks)
+{
+    if (peaks.empty())
+    {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), error);
+
+    std::string temp_path = cache_path + ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+
+        peak_file_header header{};
+        std::copy(std::begin(kPeakMagic), std::end(kPeakMagic), header.magic);
+        header.version = kPeakVersion;
+        header.modified_time = modified_time;
+        header.file_size = file_size;
+        header.sample_rate = peaks.sample_rate;
+        header.level_count = static_cast<uint32_t>(peaks.levels.size());
+        header.total_frames = peaks.total_frames;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (const waveform_level& level : peaks.levels)
+        {
+            uint32_t block_count = static_cast<uint32_t>(level.max.size());
+            file.write(reinterpret_cast<const char*>(&level.frames_per_block), sizeof(level.frames_per_block));
+            file.write(reinterpret_cast<const char*>(&block_count), sizeof(block_count));
+            file.write(reinterpret_cast<const char*>(level.min.data()), static_cast<std::streamsize>(block_count * sizeof(int16_t)));
+            file.write(reinterpret_cast<const char*>(level.max.data()), static_cast<std::streamsize>(block_count * sizeof(int16_t)));
+            file.write(reinterpret_cast<const char*>(level.rms.data()), static_cast<std::streamsize>(block_count * sizeof(uint16_t)));
+        }
+        if (!file)
+        {
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error)
+    {
+        spdlog::warn("save_waveform_peaks: failed to write '{}': {}", cache_path, error.message());
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+bool compute_waveform_peaks(const std::string& audio_path, waveform_peaks& peaks, const TaskToken* token)
+{
+    ma_decoder decoder;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 2, kPeakSampleRate);
+    if (ma_decoder_init_vfs(MappedFileCache::instance().vfs(), audio_path.c_str(), &config, &decoder) != MA_SUCCESS)
+    {
+        return false;
+    }
+
+    const ma_uint32 channels = std::max<ma_uint32>(1, decoder.outputChannels);
+    waveform_level base;
+    base.frames_per_block = kBaseFramesPerBlock;
+
+    ma_uint64 total_frames = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&decoder, &total_frames) == MA_SUCCESS && total_frames > 0)
+    {
+        size_t expected = static_cast<size_t>(total_frames / kBaseFramesPerBlock + 1);
+        base.min.reserve(expected);
+        base.max.reserve(expected);
+        base.rms.reserve(expected);
+    }
+
+    const ma_uint64 chunk_frames = kBaseFramesPerBlock;
+    std::vector<float> buffer(static_cast<size_t>(chunk_frames * channels));
+    ma_uint64 frames_decoded = 0;
+    bool cancelled = false;
+    while (true)
+    {
+        if (token && token->is_cancelled())
+        {
+            cancelled = true;
+            break;
+        }
+
+        ma_uint64 frames_read = 0;
+        ma_result result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunk_frames, &frames_read);
+        if (frames_read == 0)
+        {
+            break;
+        }
+
+        float lo = 0.0f;
+        float hi = 0.0f;
+        double sum_squares = 0.0;
+        size_t sample_count = static_cast<size_t>(frames_read * channels);
+        for (size_t i = 0; i < sample_count; ++i)
+        {
+            float sample = buffer[i];
+            lo = std::min(lo, sample);
+            hi = std::max(hi, sample);
+            sum_squares += static_cast<double>(sample) * static_cast<double>(sample);
+        }
+
+        base.min.push_back(quantize_signed(lo));
+        base.max.push_back(quantize_signed(hi));
+        base.rms.push_back(quantize_unsigned(static_cast<float>(std::sqrt(sum_squares / static_cast<double>(sample_count)))));
+        frames_decoded += frames_read;
+
+        if (result != MA_SUCCESS)
+        {
+            break;
+        }
+    }
+
+    ma_decoder_uninit(&decoder);
+
+    if (cancelled || base.max.empty())
+    {
+        return false;
+    }
+
+    waveform_peaks computed;
+    computed.sample_rate = kPeakSampleRate;
+    computed.total_frames = frames_decoded;
+    computed.levels.push_back(std::move(base));
+
+    while (static_cast<int>(computed.levels.size()) < kMaxLevels)
+    {
+        const waveform_level& finer = computed.levels.back();
+        size_t finer_count = finer.max.size();
+        if (finer_count <= kLevelFactor)
+        {
+            break;
+        }
+
+        waveform_level coarser;
+        coarser.frames_per_block = finer.frames_per_block * kLevelFactor;
+        size_t count = (finer_count + kLevelFactor - 1) / kLevelFactor;
+        coarser.min.resize(count);
+        coarser.max.resize(count);
+        coarser.rms.resize(count);
+        for (size_t block = 0; block < count; ++block)
+        {
+            size_t start = block * kLevelFactor;
+            size_t end = std::min(finer_count, start + kLevelFactor);
+            int16_t lo = finer.min[start];
+            int16_t hi = finer.max[start];
+            double sum_squares = 0.0;
+            for (size_t i = start; i < end; ++i)
+            {
+                lo = std::min(lo, finer.min[i]);
+                hi = std::max(hi, finer.max[i]);
+                double rms = static_cast<double>(finer.rms[i]);
+                sum_squares += rms * rms;
+            }
+            coarser.min[block] = lo;
+            coarser.max[block] = hi;
+            coarser.rms[block] = static_cast<uint16_t>(std::lround(std::sqrt(sum_squares / static_cast<double>(end - start))));
+        }
+        computed.levels.push_back(std::move(coarser));
+    }
+
+    peaks = std::move(computed);
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TaskToken;
+
+struct waveform_level
+{
+    uint32_t frames_per_block = 0;
+    std::vector<int16_t> min;
+    std::vector<int16_t> max;
+    std::vector<uint16_t> rms;
+};
+
+struct waveform_peaks
+{
+    uint32_t sample_rate = 0;
+    uint64_t total_frames = 0;
+    std::vector<waveform_level> levels;
+
+    bool empty() const;
+    float get_peak() const;
+    void reduce(int columns, std::vector<float>& amplitudes) const;
+};
+
+std::string waveform_cache_path(const std::string& cache_directory, const std::string& audio_path);
+bool load_waveform_peaks(
+    const std::string& cache_path,
+    int64_t modified_time,
+    int64_t file_size,
+    waveform_peaks& peaks);
+bool save_waveform_peaks(
+    const std::string& cache_path,
+    int64_t modified_time,
+    int64_t file_size,
+    const waveform_peaks& peaks);
+bool compute_waveform_peaks(const std::string& audio_path, waveform_peaks& peaks, const TaskToken* token = nullptr);